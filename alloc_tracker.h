@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// --- Contabilidade de Alocações ---
+// Substitui os operator new/delete globais para contar alocações e bytes alocados
+// (inclusive os feitos dentro da libspatialindex). Como a substituição é global, este
+// header deve ser incluído em exatamente uma unidade de tradução por executável.
+// O custo é de dois incrementos atômicos relaxados por alocação.
+
+struct AllocSnapshot {
+  uint64_t count = 0;  // número de alocações
+  uint64_t bytes = 0;  // bytes pedidos
+};
+
+inline std::atomic<uint64_t> g_allocCount{0};
+inline std::atomic<uint64_t> g_allocBytes{0};
+
+inline AllocSnapshot allocSnapshot() {
+  AllocSnapshot s;
+  s.count = g_allocCount.load(std::memory_order_relaxed);
+  s.bytes = g_allocBytes.load(std::memory_order_relaxed);
+  return s;
+}
+
+// Diferença entre dois instantâneos (alocações feitas entre eles)
+inline AllocSnapshot allocDelta(const AllocSnapshot& before, const AllocSnapshot& after) {
+  AllocSnapshot d;
+  d.count = after.count - before.count;
+  d.bytes = after.bytes - before.bytes;
+  return d;
+}
+
+inline void* trackedAlloc(std::size_t n) {
+  g_allocCount.fetch_add(1, std::memory_order_relaxed);
+  g_allocBytes.fetch_add(n, std::memory_order_relaxed);
+  return std::malloc(n ? n : 1);
+}
+
+void* operator new(std::size_t n) {
+  void* p = trackedAlloc(n);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t n) {
+  void* p = trackedAlloc(n);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { return trackedAlloc(n); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return trackedAlloc(n); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
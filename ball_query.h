@@ -0,0 +1,91 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+// --- Consulta por Bola L2 ---
+// A Range Query original usa um hipercubo de lado 2·raio e filtra os resultados no
+// visitor. Em dimensão alta o cubo é muito maior que a bola (em 282-d praticamente todo
+// o volume do cubo fica fora dela), então a árvore desce em nós que não podem conter
+// nenhum resultado.
+//
+// BallRegion é um Region (o MBR da bola, usado para serialização/getMBR) que redefine os
+// testes de interseção: a RTree chama query.intersectsShape(mbrDoFilho) tanto para
+// decidir se desce num nó quanto para aceitar uma entrada de folha, e aqui esse teste é
+// MINDIST(centro, MBR)² <= raio². Subárvores fora da bola nunca são lidas e as entradas
+// aceitas já são exatamente os pontos dentro da bola (sem pós-filtro).
+
+class BallRegion : public SpatialIndex::Region {
+  public:
+    BallRegion(const double* c, double r, uint32_t dim)
+        : SpatialIndex::Region(offset(c, dim, -r).data(), offset(c, dim, r).data(), dim),
+          center(c, c + dim), radius(r), radius2(r * r) {}
+
+    bool intersectsShape(const SpatialIndex::IShape& in) const override {
+      return minDistance2(in) <= radius2;
+    }
+
+    // Contido se o canto mais distante do MBR estiver dentro da bola
+    bool containsShape(const SpatialIndex::IShape& in) const override {
+      SpatialIndex::Region mbr;
+      in.getMBR(mbr);
+      double sum = 0;
+      for (uint32_t d = 0; d < m_dimension; d++) {
+        double diff = std::max(std::fabs(center[d] - mbr.m_pLow[d]), std::fabs(mbr.m_pHigh[d] - center[d]));
+        sum += diff * diff;
+        if (sum > radius2) return false;
+      }
+      return true;
+    }
+
+    bool touchesShape(const SpatialIndex::IShape& in) const override { return minDistance2(in) == radius2; }
+
+    // Distância da superfície da bola até a forma (0 se houver interseção)
+    double getMinimumDistance(const SpatialIndex::IShape& in) const override {
+      return std::max(0.0, std::sqrt(minDistance2(in)) - radius);
+    }
+
+    // Volume da bola: pi^(d/2) / Gamma(d/2 + 1) · r^d (em log para não estourar em 282-d)
+    double getArea() const override {
+      double d = m_dimension;
+      return std::exp((d / 2) * std::log(M_PI) - std::lgamma(d / 2 + 1) + d * std::log(radius));
+    }
+
+  private:
+    std::vector<double> center;
+    double radius;
+    double radius2;
+
+    static std::vector<double> offset(const double* c, uint32_t dim, double delta) {
+      std::vector<double> v(c, c + dim);
+      for (double& x : v) x += delta;
+      return v;
+    }
+
+    // MINDIST² do centro até a caixa [low, high]; para assim que passar do raio²
+    double minDistance2(const double* low, const double* high) const {
+      double sum = 0;
+      for (uint32_t d = 0; d < m_dimension; d++) {
+        double q = center[d];
+        double diff = q < low[d] ? low[d] - q : (q > high[d] ? q - high[d] : 0.0);
+        sum += diff * diff;
+        if (sum > radius2) return sum;
+      }
+      return sum;
+    }
+
+    double minDistance2(const SpatialIndex::IShape& in) const {
+      // Os filhos dos nós chegam como Region; pontos avulsos como Point
+      if (const SpatialIndex::Region* r = dynamic_cast<const SpatialIndex::Region*>(&in)) {
+        return minDistance2(r->m_pLow, r->m_pHigh);
+      }
+      if (const SpatialIndex::Point* p = dynamic_cast<const SpatialIndex::Point*>(&in)) {
+        return minDistance2(p->m_pCoords, p->m_pCoords);
+      }
+      SpatialIndex::Region mbr;
+      in.getMBR(mbr);
+      return minDistance2(mbr.m_pLow, mbr.m_pHigh);
+    }
+};
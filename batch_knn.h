@@ -0,0 +1,186 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+// --- k-NN em Lote ---
+// nearestNeighborQuery percorre a árvore uma vez por query, relendo os mesmos níveis
+// superiores e folhas quentes. BatchKnnStrategy atende um bloco de queries numa única
+// travessia via IQueryStrategy (RTree::queryStrategy), que lê cada nó no máximo uma vez:
+//
+//  * cada nó pendente guarda a lista de queries que ainda precisam dele e o MINDIST² de
+//    cada uma até o seu MBR;
+//  * a fila compartilhada é ordenada pelo menor MINDIST² entre essas queries;
+//  * ao sair da fila, uma query só continua associada ao nó se o MINDIST² dela não passar
+//    da k-ésima melhor distância atual (heap de resultados por query); se nenhuma restar,
+//    o nó nem é lido;
+//  * nas folhas, cada ponto é comparado com todas as queries ativas do nó.
+//
+// O resultado é exato (mesmas distâncias de nearestNeighborQuery; empates podem trocar IDs).
+//
+// Modo aproximado (KnnSearchBudget): com epsilon > 0 um nó só é visitado se
+// (1+ε)·MINDIST < k-ésima distância atual, o que garante vizinhos no máximo (1+ε) vezes
+// mais distantes que os exatos; com maxLeaves > 0 a busca para depois de ler esse número
+// de folhas e devolve o melhor encontrado até ali.
+
+struct KnnSearchBudget {
+  double epsilon = 0.0;     // Relaxamento da poda: (1+ε)·MINDIST contra a k-ésima distância
+  uint64_t maxLeaves = 0;   // Máximo de folhas lidas por travessia (0 = sem limite)
+
+  bool isExact() const { return epsilon <= 0.0 && maxLeaves == 0; }
+};
+
+struct KnnNeighbor {
+  double dist2;                  // Distância L2 ao quadrado
+  SpatialIndex::id_type id;
+
+  bool operator<(const KnnNeighbor& o) const { return dist2 < o.dist2; }
+};
+
+class BatchKnnStrategy : public SpatialIndex::IQueryStrategy {
+  public:
+    BatchKnnStrategy(const std::vector<const double*>& queryPoints, uint32_t dim, uint32_t k,
+                     const KnnSearchBudget& searchBudget = KnnSearchBudget())
+        : queries(queryPoints), dimension(dim), kNeighbors(k), heaps(queryPoints.size()), budget(searchBudget),
+          pruneScale((1.0 + searchBudget.epsilon) * (1.0 + searchBudget.epsilon)) {}
+
+    void getNextEntry(const SpatialIndex::IEntry& entry, SpatialIndex::id_type& nextEntry, bool& fetchNextEntry) override {
+      const SpatialIndex::INode* node = dynamic_cast<const SpatialIndex::INode*>(&entry);
+      nodesRead++;
+
+      // A primeira chamada recebe a raiz, necessária para todas as queries
+      std::vector<QueryBound> active;
+      if (!started) {
+        started = true;
+        for (uint32_t q = 0; q < queries.size(); q++) active.push_back({q, 0.0});
+      } else {
+        auto it = pending.find(entry.getIdentifier());
+        if (it != pending.end()) {
+          active.swap(it->second);
+          pending.erase(it);
+        }
+      }
+      if (node != nullptr) {
+        if (node->isLeaf()) leavesRead++;
+        expand(*node, active);
+      }
+
+      fetchNextEntry = false;
+      if (budget.maxLeaves > 0 && leavesRead >= budget.maxLeaves) return;
+      while (!frontier.empty()) {
+        SpatialIndex::id_type id = frontier.top().second;
+        frontier.pop();
+        // Descarta as queries cujo k-ésimo vizinho atual já está mais perto que o nó
+        std::vector<QueryBound>& bounds = pending[id];
+        bounds.erase(std::remove_if(bounds.begin(), bounds.end(),
+                                    [&](const QueryBound& b) { return pruned(b.query, b.mindist2); }),
+                     bounds.end());
+        if (bounds.empty()) {
+          pending.erase(id);
+          continue;
+        }
+        nextEntry = id;
+        fetchNextEntry = true;
+        return;
+      }
+    }
+
+    // Vizinhos da query q em ordem crescente de distância
+    std::vector<KnnNeighbor> results(size_t q) const {
+      std::priority_queue<KnnNeighbor> heap = heaps[q];
+      std::vector<KnnNeighbor> out(heap.size());
+      for (size_t i = out.size(); i-- > 0; heap.pop()) out[i] = heap.top();
+      return out;
+    }
+
+    size_t size() const { return queries.size(); }
+    uint64_t getNodesRead() const { return nodesRead; }
+    uint64_t getLeavesRead() const { return leavesRead; }
+
+  private:
+    struct QueryBound {
+      uint32_t query;
+      double mindist2;
+    };
+
+    std::vector<const double*> queries;
+    uint32_t dimension;
+    uint32_t kNeighbors;
+    std::vector<std::priority_queue<KnnNeighbor>> heaps;  // max-heap: topo = k-ésimo atual
+    std::unordered_map<SpatialIndex::id_type, std::vector<QueryBound>> pending;
+    // Fila compartilhada de nós: (menor MINDIST² entre as queries do nó, id), menor primeiro
+    std::priority_queue<std::pair<double, SpatialIndex::id_type>, std::vector<std::pair<double, SpatialIndex::id_type>>,
+                        std::greater<std::pair<double, SpatialIndex::id_type>>> frontier;
+    KnnSearchBudget budget;
+    double pruneScale;          // (1+ε)², aplicado ao MINDIST² na poda
+    bool started = false;
+    uint64_t nodesRead = 0;
+    uint64_t leavesRead = 0;
+
+    bool pruned(uint32_t q, double mindist2) const { return mindist2 * pruneScale > kthDistance2(q); }
+
+    double kthDistance2(uint32_t q) const {
+      if (heaps[q].size() < kNeighbors) return std::numeric_limits<double>::infinity();
+      return heaps[q].top().dist2;
+    }
+
+    double minDistance2(const double* q, const double* low, const double* high) const {
+      double sum = 0;
+      for (uint32_t d = 0; d < dimension; d++) {
+        double diff = q[d] < low[d] ? low[d] - q[d] : (q[d] > high[d] ? q[d] - high[d] : 0.0);
+        sum += diff * diff;
+      }
+      return sum;
+    }
+
+    void expand(const SpatialIndex::INode& node, const std::vector<QueryBound>& active) {
+      for (uint32_t c = 0; c < node.getChildrenCount(); c++) {
+        SpatialIndex::IShape* shape;
+        node.getChildShape(c, &shape);
+        SpatialIndex::Region mbr;
+        shape->getMBR(mbr);
+        delete shape;
+        SpatialIndex::id_type childId = node.getChildIdentifier(c);
+
+        if (node.isLeaf()) {
+          // Pontos: low == high == coordenadas
+          for (const QueryBound& b : active) {
+            double d2 = minDistance2(queries[b.query], mbr.m_pLow, mbr.m_pHigh);
+            std::priority_queue<KnnNeighbor>& heap = heaps[b.query];
+            if (heap.size() < kNeighbors) heap.push({d2, childId});
+            else if (d2 < heap.top().dist2) { heap.pop(); heap.push({d2, childId}); }
+          }
+          continue;
+        }
+
+        std::vector<QueryBound> childBounds;
+        double key = std::numeric_limits<double>::infinity();
+        for (const QueryBound& b : active) {
+          double d2 = minDistance2(queries[b.query], mbr.m_pLow, mbr.m_pHigh);
+          if (pruned(b.query, d2)) continue;
+          childBounds.push_back({b.query, d2});
+          key = std::min(key, d2);
+        }
+        if (childBounds.empty()) continue;
+        pending[childId] = std::move(childBounds);
+        frontier.push({key, childId});
+      }
+    }
+};
+
+// Executa o k-NN em lote para queries[begin, end) numa única travessia da árvore
+inline BatchKnnStrategy batchNearestNeighbors(SpatialIndex::ISpatialIndex& tree,
+                                              const std::vector<std::vector<double>>& queries,
+                                              size_t begin, size_t end, uint32_t dimension, uint32_t k,
+                                              const KnnSearchBudget& budget = KnnSearchBudget()) {
+  std::vector<const double*> points;
+  for (size_t i = begin; i < end; i++) points.push_back(queries[i].data());
+  BatchKnnStrategy strategy(points, dimension, k, budget);
+  tree.queryStrategy(strategy);
+  return strategy;
+}
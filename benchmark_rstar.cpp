@@ -12,6 +12,31 @@
 #include <iomanip>
 #include <algorithm>
 #include <random>
+#include <memory>
+
+#include "cli_options.h"
+#include "bulk_load.h"
+#include "packed_tree.h"
+#include "dataset_io.h"
+#include "parallel.h"
+#include "concurrent_queries.h"
+#include "page_cache.h"
+#include "alloc_tracker.h"
+#include "ball_query.h"
+#include "tree_params.h"
+#include "batch_knn.h"
+#include "quantized_storage.h"
+#include "pca_projection.h"
+#include "traversal_trace.h"
+#include "external_build.h"
+#include "parallel_build.h"
+#include "timing_harness.h"
+#include "perf_counters.h"
+#include "flat_index.h"
+#include "mixed_workload.h"
+#include "result_buffer.h"
+#include "query_workload.h"
+#include "prefetch_storage.h"
 
 namespace fs = std::filesystem;
 using namespace SpatialIndex;
@@ -19,14 +44,6 @@ using namespace std;
 
 // --- Funções Utilitárias ---
 
-// Obtém o uso de RAM atual em MB
-double getRAMUsageMB() {
-  long rss = 0L;
-  ifstream stat_stream("/proc/self/statm", ios_base::in);
-  if (stat_stream >> rss) return (rss * sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
-  return 0.0;
-}
-
 // Calcula a Distância Euclidiana (L2) entre dois pontos
 double calculateL2(const double* p1, const double* p2, uint32_t dim) {
   double sum = 0;
@@ -37,6 +54,18 @@ double calculateL2(const double* p1, const double* p2, uint32_t dim) {
   return std::sqrt(sum);
 }
 
+// Abre o dataset (binário via mmap ou CSV com parseThreads threads, 0 = todos os núcleos),
+// encerrando o programa em caso de erro
+void openDatasetOrExit(Dataset& data, const string& path, uint32_t dimension, bool allowBinary = true,
+                       unsigned parseThreads = 0) {
+  try {
+    data.open(path, dimension, allowBinary, parseThreads);
+  } catch (std::exception& e) {
+    cerr << "Erro ao abrir dataset: " << e.what() << endl;
+    exit(1);
+  }
+}
+
 // Gera arquivos de queries (k-NN e Range) usando Reservoir Sampling
 void generateQueryFiles(const string& datasetPath, const string& datasetName, uint32_t dimension, int queriesPerType = 100) {
   string queriesDir = "queries";
@@ -48,6 +77,18 @@ void generateQueryFiles(const string& datasetPath, const string& datasetName, ui
   if (fs::exists(knnPath) && fs::exists(rangePath)) return;
 
   cout << "Gerando arquivos de queries em " << queriesDir << " ..." << endl;
+
+  // Dataset binário: sorteia as linhas pelo mesmo Reservoir Sampling e as grava em CSV
+  if (fs::path(datasetPath).extension() == ".bin") {
+    Dataset data;
+    openDatasetOrExit(data, datasetPath, dimension);
+    QueryReservoir reservoir(queriesPerType * 2);
+    vector<double> scratch(dimension);
+    for (uint64_t i = 0; i < data.size(); i++) reservoir.offer(data.row(i, scratch.data()), dimension);
+    reservoir.write(knnPath, rangePath, queriesPerType);
+    cout << "Arquivos gerados: " << knnPath << " e " << rangePath << endl;
+    return;
+  }
   
   ifstream file(datasetPath);
   if (!file.is_open()) {
@@ -92,33 +133,309 @@ void generateQueryFiles(const string& datasetPath, const string& datasetName, ui
   cout << "Arquivos gerados: " << knnPath << " e " << rangePath << endl;
 }
 
+// Prepara as queries k-NN e Range: o conjunto padrão (generateQueryFiles, raio fixo) ou um
+// conjunto calibrado (query_workload.h). --selectivity / --query-dist geram o conjunto, se
+// ainda não existir, e --queries=<nome> seleciona um já gerado; nos dois casos o raio passa a
+// ser o calibrado. Devolve o nome do conjunto ("" no padrão).
+// O raio calibrado é o de uma bola L2: com --range-shape=box o hipercubo de mesmo meio-lado
+// examina muito mais que N pontos em dimensão alta, então a combinação é recusada (o custo do
+// hipercubo nesse raio continua disponível com --range-compare).
+string prepareQueries(int argc, char** argv, const string& datasetPath, const string& datasetName, uint32_t dimension,
+                      bool useBinary, bool ballShape, vector<vector<double>>& knnQueries,
+                      vector<vector<double>>& rangeQueries, double& rangeRadius) {
+  string setName = getOption(argc, argv, "queries", "");
+  if (hasOption(argc, argv, "selectivity") || hasOption(argc, argv, "query-dist")) {
+    QueryWorkloadSpec spec;
+    try {
+      spec.distribution = parseQueryDistribution(getOption(argc, argv, "query-dist", "dataset"));
+      spec.selectivity = stoull(getOption(argc, argv, "selectivity", "0"));
+      spec.count = stoul(getOption(argc, argv, "query-count", "100"));
+      spec.zipfExponent = stod(getOption(argc, argv, "zipf-s", "1.1"));
+      spec.hotspots = static_cast<uint32_t>(stoul(getOption(argc, argv, "hotspots", "16")));
+    } catch (std::exception& e) {
+      cerr << "Parâmetro do conjunto de consultas inválido: " << e.what() << endl;
+      exit(1);
+    }
+    setName = spec.name();
+    // Recusa antes da calibração (busca exata do N-ésimo vizinho), que é cara em datasets grandes
+    if (spec.selectivity > 0 && !ballShape) {
+      cerr << "--selectivity calibra o raio para a bola L2; use --range-shape=ball"
+           << " (e --range-compare para medir o hipercubo no mesmo raio)." << endl;
+      exit(1);
+    }
+    QueryWorkloadPaths paths = queryWorkloadPaths(datasetName, setName);
+    if (!fs::exists(paths.params)) {
+      if (!fs::exists("queries")) fs::create_directory("queries");
+      Dataset data;
+      openDatasetOrExit(data, datasetPath, dimension, useBinary);
+      auto start = chrono::high_resolution_clock::now();
+      QueryWorkloadInfo info = generateQueryWorkload(data, spec, knnQueries, rangeQueries, resolveThreadCount("auto"));
+      writeQueryWorkload(paths, info, knnQueries, rangeQueries);
+      cout << "Conjunto de consultas " << setName << " gerado em "
+           << chrono::duration<double>(chrono::high_resolution_clock::now() - start).count() << " s: " << paths.knn
+           << ", " << paths.range << ", " << paths.params << endl;
+    }
+  }
+
+  if (setName.empty()) {
+    generateQueryFiles(datasetPath, datasetName, dimension);
+    knnQueries = loadQueries("queries/" + datasetName + "_knn.csv", dimension);
+    rangeQueries = loadQueries("queries/" + datasetName + "_range.csv", dimension);
+    return "";
+  }
+
+  QueryWorkloadPaths paths = queryWorkloadPaths(datasetName, setName);
+  QueryWorkloadInfo info;
+  try {
+    info = QueryWorkloadInfo::load(paths.params);
+  } catch (std::exception& e) {
+    cerr << e.what() << " (gere o conjunto com --selectivity / --query-dist)" << endl;
+    exit(1);
+  }
+  if (info.selectivity > 0 && !ballShape) {
+    cerr << "O conjunto " << setName << " tem raio calibrado para a bola L2; use --range-shape=ball"
+         << " (e --range-compare para medir o hipercubo no mesmo raio)." << endl;
+    exit(1);
+  }
+  knnQueries = loadQueries(paths.knn, dimension);
+  rangeQueries = loadQueries(paths.range, dimension);
+  if (info.radius > 0) rangeRadius = info.radius;
+  cout << "Conjunto de consultas " << setName << ": " << knnQueries.size() << " k-NN + " << rangeQueries.size()
+       << " Range, distribuição " << info.distribution;
+  if (info.selectivity > 0) {
+    cout << ", raio calibrado " << info.radius << " para " << info.selectivity << " resultados (p10-p90 do "
+         << info.selectivity << "º vizinho: " << info.radiusP10 << " - " << info.radiusP90 << ")";
+  }
+  cout << endl;
+  return setName;
+}
+
+// Monta a pilha de storage usada pela árvore: contador de leituras -> buffer (opcional) -> disco
+IStorageManager* buildStorageStack(IStorageManager* disk, const PageCacheConfig& cfg, PageCache*& cache,
+                                   CountingStorageManager*& counter) {
+  IStorageManager* below = disk;
+  if (cfg.enabled()) {
+    cache = new PageCache(*disk, cfg);
+    below = cache;
+  }
+  counter = new CountingStorageManager(*below);
+  return counter;
+}
+
+// Construção com memória limitada (modo external): lê o dataset em blocos, ordena os pontos
+// externamente pela chave de Hilbert e empacota os nós direto do merge (packed_tree.h). As
+// queries que ainda não existirem são sorteadas na mesma passada de leitura, sem reler o
+// arquivo depois.
+ISpatialIndex* buildTreeExternal(IStorageManager& storage, const TreeParams& params, const string& datasetPath,
+                                 uint32_t dimension, bool useBinary, uint64_t memoryBudget, id_type& indexIdentifier,
+                                 ExternalSortStats* statsOut = nullptr) {
+  DatasetChunkReader reader;
+  try {
+    reader.open(datasetPath, dimension, useBinary);
+  } catch (std::exception& e) {
+    cerr << "Erro ao abrir dataset: " << e.what() << endl;
+    exit(1);
+  }
+  string datasetName = fs::path(datasetPath).stem().string();
+  string knnPath = "queries/" + datasetName + "_knn.csv";
+  string rangePath = "queries/" + datasetName + "_range.csv";
+  bool sampleQueries = !(fs::exists(knnPath) && fs::exists(rangePath));
+  const int queriesPerType = 100;
+  QueryReservoir reservoir(queriesPerType * 2);
+
+  HilbertExternalSorter sorter("external_sort", dimension, memoryBudget);
+  sorter.scan(reader, [&](const double* row) {
+    if (sampleQueries) reservoir.offer(row, dimension);
+  });
+  if (sampleQueries) {
+    if (!fs::exists("queries")) fs::create_directory("queries");
+    reservoir.write(knnPath, rangePath, queriesPerType);
+    cout << "Arquivos gerados na passada de leitura: " << knnPath << " e " << rangePath << endl;
+  }
+  sorter.writeRuns(reader);
+  ISpatialIndex* tree = packedBulkLoad(storage, params, dimension, indexIdentifier, [&](PackedTreeWriter& writer) {
+    sorter.merge([&](id_type id, const double* coords) { writer.add(id, coords); });
+  });
+
+  const ExternalSortStats& st = sorter.getStats();
+  cout << "Ordenação externa (" << reader.sourcePath() << "): " << st.rows << " pontos, " << st.runs << " runs de até "
+       << st.rowsPerRun << " linhas; leitura " << st.scanSeconds << " s, runs " << st.runSeconds << " s, merge + empacotamento "
+       << st.mergeSeconds << " s" << endl;
+  if (statsOut) *statsOut = st;
+  return tree;
+}
+
+// Construção paralela (modo parallel): parsing do CSV e subárvores STR com "threads" threads
+ISpatialIndex* buildTreeParallel(IStorageManager& storage, const TreeParams& params, const string& datasetPath,
+                                 uint32_t dimension, bool useBinary, unsigned threads, id_type& indexIdentifier,
+                                 ParallelBuildStats* statsOut = nullptr, double* parseSeconds = nullptr) {
+  Dataset data;
+  openDatasetOrExit(data, datasetPath, dimension, useBinary, threads);
+  cout << "Dataset carregado (" << data.formatName() << ", " << threads << " threads): " << data.size() << " pontos em "
+       << data.loadSeconds << " s" << endl;
+  ParallelBuildStats st;
+  ISpatialIndex* tree = parallelBulkLoad(data, storage, params, threads, "parallel_build", indexIdentifier, &st);
+  cout << "Construção paralela: " << st.subtrees << " subárvores, altura " << st.height << "; partição "
+       << st.partitionSeconds << " s, subárvores " << st.subtreeSeconds << " s, merge " << st.mergeSeconds << " s" << endl;
+  if (statsOut) *statsOut = st;
+  if (parseSeconds) *parseSeconds = data.loadSeconds;
+  return tree;
+}
+
+// Constrói o índice sobre "storage" no modo escolhido (incremental, str, hilbert, external ou
+// parallel). Com "pca", a árvore guarda os pontos projetados (pca->outputDim dimensões).
+// buildThreads é o número de threads do parsing do CSV e da construção paralela (0 = todos).
+ISpatialIndex* buildTree(const string& buildMode, IStorageManager& storage, const TreeParams& params,
+                         const string& datasetPath, uint32_t dimension, bool useBinary, id_type& indexIdentifier,
+                         const PcaProjection* pca = nullptr, uint64_t memoryBudget = 256ull << 20,
+                         unsigned buildThreads = 0) {
+  if (buildMode == "external") {
+    return buildTreeExternal(storage, params, datasetPath, dimension, useBinary, memoryBudget, indexIdentifier);
+  }
+  if (buildThreads == 0) buildThreads = resolveThreadCount("auto");
+  if (buildMode == "parallel") {
+    return buildTreeParallel(storage, params, datasetPath, dimension, useBinary, buildThreads, indexIdentifier);
+  }
+  ISpatialIndex* tree = nullptr;
+  // Usa a versão binária (mmap) do dataset quando existir, senão faz o parsing do CSV
+  string binaryPath = useBinary ? findBinaryDataset(datasetPath) : "";
+  uint32_t treeDim = pca ? pca->outputDim : dimension;
+
+  if (buildMode == "str") {
+    // Sort-Tile-Recursive: o bulk loader lê o dataset em streaming e empacota os nós
+    Dataset data;
+    unique_ptr<IDataStream> stream;
+    if (pca) {
+      openDatasetOrExit(data, datasetPath, dimension, useBinary, buildThreads);
+      stream.reset(new ProjectedDataStream(data, *pca));
+    } else if (!binaryPath.empty()) {
+      openDatasetOrExit(data, binaryPath, dimension);
+      stream.reset(new DatasetDataStream(data));
+    } else {
+      stream.reset(new CsvDataStream(datasetPath, dimension));
+    }
+    tree = RTree::createAndBulkLoadNewRTree(RTree::BLM_STR, *stream, storage, params.bulkFillFactor,
+                                            params.indexCapacity, params.leafCapacity, treeDim, params.variant, indexIdentifier);
+  } else {
+    Dataset data;
+    openDatasetOrExit(data, datasetPath, dimension, useBinary, buildThreads);
+    cout << "Dataset carregado (" << data.formatName() << "): " << data.size() << " pontos em "
+         << data.loadSeconds << " s, RSS " << getResidentMemoryMB() << " MB" << endl;
+    vector<double> scratch(dimension), reduced(treeDim);
+    // Coordenadas inseridas: a linha original ou a sua projeção PCA
+    auto treePoint = [&](uint64_t idx) {
+      const double* r = data.row(idx, scratch.data());
+      if (!pca) return r;
+      pca->project(r, reduced.data());
+      return static_cast<const double*>(reduced.data());
+    };
+
+    if (buildMode == "hilbert") {
+      // Empacota os pontos na ordem da curva de Hilbert em nós cheios (packed_tree.h). Com
+      // PCA a curva percorre o espaço projetado, o mesmo em que os MBRs dos nós são medidos.
+      vector<uint64_t> order = hilbertOrder(data.size(), treeDim, treeDim > 16 ? 8 : 16, treePoint);
+      tree = packedBulkLoad(storage, params, treeDim, indexIdentifier, [&](PackedTreeWriter& writer) {
+        // O ID continua sendo a posição original da linha no dataset
+        for (uint64_t idx : order) writer.add(static_cast<id_type>(idx), treePoint(idx));
+      });
+    } else {
+      // Cria a R-Tree (variante configurável, R* por padrão) e insere ponto a ponto
+      tree = RTree::createNewRTree(storage, params.fillFactor, params.indexCapacity, params.leafCapacity, treeDim,
+                                   params.variant, indexIdentifier);
+      for (uint64_t id = 0; id < data.size(); id++) {
+        Point p(treePoint(id), treeDim);
+        // Insere dados: (payload size, payload ptr, shape, object ID)
+        tree->insertData(0, nullptr, p, static_cast<id_type>(id));
+      }
+    }
+  }
+  return tree;
+}
+
+// Registra a construção em results/construcao_<dataset>.csv e imprime o comparativo
+// entre os modos já executados (incremental, str, hilbert) lado a lado.
+void recordBuild(ISpatialIndex* tree, const string& baseName, const string& datasetName, const string& buildMode,
+                 double buildTime, uint32_t indexCapacity, uint32_t leafCapacity) {
+  TreeShapeStrategy shape;
+  tree->queryStrategy(shape);
+
+  IStatistics* stats; tree->getStatistics(&stats);
+  uint64_t numPoints = stats->getNumberOfData();
+  delete stats;
+
+  double diskMB = (fs::file_size(baseName + ".idx") + fs::file_size(baseName + ".dat")) / (1024.0 * 1024.0);
+
+  string buildFile = "results/construcao_" + datasetName + ".csv";
+  bool newFile = !fs::exists(buildFile);
+  ofstream out(buildFile, ios::app);
+  if (newFile) out << "Modo,Tempo_s,Disco_MB,Pontos,Nos,Altura,Ocupacao_Folhas,Ocupacao_Internos\n";
+  out << buildMode << "," << buildTime << "," << diskMB << "," << numPoints << ","
+      << shape.totalNodes() << "," << shape.height() << ","
+      << shape.leafFill(leafCapacity) << "," << shape.indexFill(indexCapacity) << "\n";
+  out.close();
+
+  cout << "\n--- COMPARATIVO DE CONSTRUCAO (" << buildFile << ") ---" << endl;
+  ifstream in(buildFile);
+  string line;
+  while (getline(in, line)) {
+    stringstream ss(line); string val;
+    while (getline(ss, val, ',')) cout << setw(18) << val;
+    cout << endl;
+  }
+}
+
 // --- Visitante para Consultas ---
 // Esta classe é chamada para cada nó ou dado encontrado durante a busca na árvore.
 class BenchmarkVisitor : public IVisitor {
   public:
     uint32_t resultCount = 0;
+    uint32_t candidates = 0;           // Entradas de folha aceitas pelo teste da consulta (antes do filtro L2)
     const double* queryPoint; 
     double queryRadius; 
     uint32_t dimension; 
     bool isRangeQuery;
     double minDistanceFound = 999999.0; // Distância mínima encontrada (útil para debug ou k-NN)
+    // Índice em precisão reduzida: distâncias calculadas com as coordenadas completas do dataset
+    const Dataset* exactRows = nullptr;
+    vector<double> scratch;
+    TraversalTrace* trace = nullptr;   // Nós lidos por nível e geometria (opcional)
 
-    BenchmarkVisitor(const double* q, double r, uint32_t d, bool range) 
-      : queryPoint(q), queryRadius(r), dimension(d), isRangeQuery(range) {}
+    BenchmarkVisitor(const double* q, double r, uint32_t d, bool range, const Dataset* exact = nullptr) 
+      : queryPoint(q), queryRadius(r), dimension(d), isRangeQuery(range), exactRows(exact) {
+      if (exactRows != nullptr) scratch.resize(dimension);
+    }
 
-    // VisitNode é chamado para nós internos da árvore (não folhas).
-    void visitNode(const INode& n) override {}
+    // VisitNode é chamado para cada nó lido da árvore (internos e folhas).
+    void visitNode(const INode& n) override {
+      if (trace != nullptr) trace->recordNode(n);
+    }
     
     // VisitData é chamado quando um objeto de dados (folha) é encontrado.
     void visitData(const IData& d) override {
-      IShape* shape;
-      d.getShape(&shape);
-      Region mbr;
-      shape->getMBR(mbr);
-      
-      // Calcula a distância do ponto de consulta até o MBR do dado encontrado
-      // Como nossos dados são pontos, o MBR low é igual ao próprio ponto.
-      double currentDistance = calculateL2(queryPoint, mbr.m_pLow, dimension);
+      candidates++;
+      if (exactRows != nullptr) {
+        accountResult(exactRows->row(static_cast<uint64_t>(d.getIdentifier()), scratch.data()));
+        return;
+      }
+      // A RTree entrega objetos RTree::Data, cujo MBR é público: lemos as coordenadas
+      // direto dele em vez de alocar uma cópia da forma com getShape a cada resultado.
+      const RTree::Data* data = dynamic_cast<const RTree::Data*>(&d);
+      if (data == nullptr) {
+        IShape* shape;
+        d.getShape(&shape);
+        Region mbr;
+        shape->getMBR(mbr);
+        accountResult(mbr.m_pLow);
+        delete shape;
+        return;
+      }
+      accountResult(data->m_region.m_pLow);
+    }
+
+    // Calcula a distância do ponto de consulta até o MBR do dado encontrado
+    // Como nossos dados são pontos, o MBR low é igual ao próprio ponto.
+    void accountResult(const double* point) {
+      double currentDistance = calculateL2(queryPoint, point, dimension);
       
       // Atualiza a menor distância encontrada (apenas para estatísticas).
       if (currentDistance < minDistanceFound) minDistanceFound = currentDistance;
@@ -130,18 +447,832 @@ class BenchmarkVisitor : public IVisitor {
         // Para k-NN, o R-Tree já filtra os vizinhos mais próximos.
         resultCount++;
       }
-      delete shape;
     }
 
     // Método para visitar múltiplos dados de uma vez.
     void visitData(std::vector<const IData*>& v) override {}
 };
 
+// Executa uma Range Query com a forma escolhida: bola L2 exata (poda por MINDIST) ou o
+// hipercubo de lado 2·raio original, cujos falsos positivos são descartados pelo visitor.
+void runRangeQuery(ISpatialIndex& tree, const vector<double>& q, double radius, uint32_t dimension,
+                   bool ballShape, IVisitor& visitor) {
+  if (ballShape) {
+    BallRegion ball(q.data(), radius, dimension);
+    tree.intersectsWithQuery(ball, visitor);
+    return;
+  }
+  vector<double> lowV(dimension), highV(dimension);
+  for (uint32_t d = 0; d < dimension; d++) {
+    lowV[d] = q[d] - radius;
+    highV[d] = q[d] + radius;
+  }
+  Region queryRegion(lowV.data(), highV.data(), dimension);
+  tree.intersectsWithQuery(queryRegion, visitor);
+}
+
+// Colunas de travessia do CSV por consulta (sobreposição e espaço morto vazios sem --trace)
+void writeTraceColumns(ostream& log, const TraversalTrace& trace) {
+  log << trace.internalNodes() << "," << trace.leafNodes() << ",";
+  trace.writeLevels(log);
+  log << "," << trace.pruningEfficiency() << ",";
+  if (trace.geometry) log << trace.overlapFraction() << "," << trace.deadSpace();
+  else log << ",";
+}
+
+// Colunas de repetição do CSV por consulta: número de repetições, mediana, desvio, IC de 95%
+// da média (Tempo_ms) e o estado do cache ("quente" ou "frio")
+void writeTimingColumns(ostream& log, const TimingSummary& t, const string& cacheMode) {
+  log << t.samples << "," << t.median << "," << t.stddev << "," << t.ciLow << "," << t.ciHigh << "," << cacheMode;
+}
+
+// Totais de uma passada de Range Queries, para comparar bola x caixa
+struct RangeShapeTotals {
+  size_t queries = 0;
+  uint64_t pages = 0;
+  uint64_t candidates = 0;
+  uint64_t results = 0;
+  double timeMs = 0;
+
+  void add(uint64_t p, uint64_t c, uint64_t r, double ms) {
+    queries++; pages += p; candidates += c; results += r; timeMs += ms;
+  }
+};
+
+// Executa as queries k-NN e Range com 1, 2, 4, ... maxThreads threads (um handle da árvore
+// por thread) e grava QPS, percentis de latência e eficiência de escala em
+// results/concorrencia_<dataset>.csv.
+void runConcurrencyBenchmark(const string& baseName, id_type indexIdentifier, const string& datasetName,
+                             const vector<vector<double>>& knnQueries, const vector<vector<double>>& rangeQueries,
+                             int kNeighbors, double rangeRadius, uint32_t dimension,
+                             bool ballShape, unsigned maxThreads, unsigned repeat) {
+  auto runKnn = [&](ISpatialIndex& t, const vector<double>& q) {
+    BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, false);
+    Point queryPoint(q.data(), dimension);
+    t.nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+  };
+  auto runRange = [&](ISpatialIndex& t, const vector<double>& q) {
+    BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, true);
+    runRangeQuery(t, q, rangeRadius, dimension, ballShape, visitor);
+  };
+
+  string concurrencyFile = "results/concorrencia_" + datasetName + ".csv";
+  ofstream out(concurrencyFile);
+  out << "Threads,Tipo,Consultas,Tempo_s,QPS,p50_ms,p95_ms,p99_ms,max_ms,Eficiencia\n";
+
+  cout << "\n--- MODO CONCORRENTE (ate " << maxThreads << " threads) ---" << endl;
+  double knnBaseQps = 0, rangeBaseQps = 0;
+  for (unsigned t = 1; ; t = min(t * 2, maxThreads)) {
+    for (int type = 0; type < 2; type++) {
+      bool isRange = (type == 1);
+      const vector<vector<double>>& queries = isRange ? rangeQueries : knnQueries;
+      if (queries.empty()) continue;
+
+      ConcurrencyResult r = isRange ? runConcurrentQueries(baseName, indexIdentifier, queries, t, repeat, runRange)
+                                    : runConcurrentQueries(baseName, indexIdentifier, queries, t, repeat, runKnn);
+      double& baseQps = isRange ? rangeBaseQps : knnBaseQps;
+      if (t == 1) baseQps = r.qps;
+      double efficiency = baseQps > 0 ? r.qps / (baseQps * t) : 0.0;
+
+      out << t << "," << (isRange ? "Range" : "kNN") << "," << r.queries << "," << r.wallSeconds << ","
+          << r.qps << "," << r.p50 << "," << r.p95 << "," << r.p99 << "," << r.maxMs << "," << efficiency << "\n";
+      cout << (isRange ? "Range" : "kNN  ") << " threads=" << t << " QPS=" << r.qps
+           << " p50=" << r.p50 << "ms p99=" << r.p99 << "ms eficiencia=" << efficiency << endl;
+    }
+    if (t == maxThreads) break;
+  }
+  cout << "Resultados concorrentes salvos em " << concurrencyFile << endl;
+}
+
+// Compara o k-NN de uma query por vez (nearestNeighborQuery) com o k-NN em lote para os
+// tamanhos de lote pedidos: latência amortizada por query e páginas lidas no total.
+// As distâncias de cada lote são conferidas contra o lote de tamanho 1.
+void runBatchKnnBenchmark(ISpatialIndex& tree, CountingStorageManager& counter, const string& datasetName,
+                          const vector<vector<double>>& knnQueries, int kNeighbors, double rangeRadius,
+                          uint32_t dimension, const vector<size_t>& batchSizes) {
+  string batchFile = "results/knn_lote_" + datasetName + ".csv";
+  ofstream out(batchFile);
+  out << "Lote,Consultas,Tempo_Total_ms,Latencia_Amortizada_ms,Paginas_Total,Paginas_por_Consulta,Divergencias\n";
+  cout << "\n--- k-NN EM LOTE (k=" << kNeighbors << ", " << knnQueries.size() << " queries) ---" << endl;
+  cout << left << setw(12) << "Lote" << right << setw(16) << "Amortizada_ms" << setw(14) << "Paginas"
+       << setw(14) << "Pag/query" << setw(14) << "Divergencias" << endl;
+
+  auto report = [&](const string& label, double totalMs, uint64_t pages, size_t mismatches) {
+    double n = max<size_t>(1, knnQueries.size());
+    out << label << "," << knnQueries.size() << "," << totalMs << "," << totalMs / n << "," << pages << ","
+        << pages / n << "," << mismatches << "\n";
+    cout << left << setw(12) << label << right << setw(16) << totalMs / n << setw(14) << pages
+         << setw(14) << pages / n << setw(14) << mismatches << endl;
+  };
+
+  // Referência: uma travessia por query
+  uint64_t readsPre = counter.reads();
+  auto start = chrono::high_resolution_clock::now();
+  for (const auto& q : knnQueries) {
+    BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, false);
+    Point queryPoint(q.data(), dimension);
+    tree.nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+  }
+  double totalMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+  report("sequencial", totalMs, counter.reads() - readsPre, 0);
+
+  vector<double> referenceKth;  // k-ésima distância² de cada query no lote de tamanho 1
+  for (size_t batch : batchSizes) {
+    vector<double> kth(knnQueries.size(), 0.0);
+    readsPre = counter.reads();
+    start = chrono::high_resolution_clock::now();
+    for (size_t begin = 0; begin < knnQueries.size(); begin += batch) {
+      size_t end = min(knnQueries.size(), begin + batch);
+      BatchKnnStrategy result = batchNearestNeighbors(tree, knnQueries, begin, end, dimension, kNeighbors);
+      for (size_t i = begin; i < end; i++) {
+        vector<KnnNeighbor> neighbors = result.results(i - begin);
+        if (!neighbors.empty()) kth[i] = neighbors.back().dist2;
+      }
+    }
+    totalMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    uint64_t pages = counter.reads() - readsPre;
+
+    if (referenceKth.empty()) referenceKth = kth;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < kth.size(); i++) {
+      if (fabs(kth[i] - referenceKth[i]) > 1e-9 * max(1.0, referenceKth[i])) mismatches++;
+    }
+    report(to_string(batch), totalMs, pages, mismatches);
+  }
+  cout << "k-NN em lote salvo em " << batchFile << endl;
+}
+
+// Carrega o índice no motor em memória (flat_index.h) a partir das páginas gravadas e
+// executa as mesmas queries k-NN e Range nele e na árvore em disco, com o mesmo visitor.
+// Latências (média das repetições por consulta) e divergências de resultado vão para
+// results/memoria_plana_<dataset>.csv.
+void runFlatComparison(ISpatialIndex& tree, IStorageManager& pages, id_type indexIdentifier, const string& datasetName,
+                       const vector<vector<double>>& knnQueries, const vector<vector<double>>& rangeQueries,
+                       int kNeighbors, double rangeRadius, uint32_t dimension, bool ballShape, unsigned repetitions) {
+  auto startLoad = chrono::high_resolution_clock::now();
+  FlatRTree flat(pages, indexIdentifier, dimension);
+  double loadSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - startLoad).count();
+  cout << "\n--- MOTOR EM MEMORIA x DISCO ---" << endl;
+  cout << "Índice plano: " << flat.nodeCount() << " nós, altura " << flat.height() << ", "
+       << flat.memoryBytes() / (1024.0 * 1024.0) << " MB, carregado em " << loadSeconds << " s (kernel "
+       << flat.kernelName() << ")" << endl;
+
+  string flatFile = "results/memoria_plana_" + datasetName + ".csv";
+  ofstream out(flatFile);
+  out << "Motor,Tipo,Consultas,Tempo_ms_Media,p50_ms,p99_ms,Speedup,Resultados_Media,Divergencias\n";
+  cout << left << setw(8) << "Motor" << setw(8) << "Tipo" << right << setw(14) << "Media_ms" << setw(12) << "p50_ms"
+       << setw(12) << "p99_ms" << setw(10) << "Speedup" << setw(14) << "Divergencias" << endl;
+
+  vector<double> lowV(dimension), highV(dimension);
+  for (int type = 0; type < 2; type++) {
+    bool isRange = (type == 1);
+    const vector<vector<double>>& queries = isRange ? rangeQueries : knnQueries;
+    if (queries.empty()) continue;
+
+    // Resultado por consulta de cada motor: quantidade e menor distância
+    vector<uint32_t> counts[2];
+    vector<double> nearest[2];
+    double baseMean = 0;
+    for (int engine = 0; engine < 2; engine++) {
+      bool useFlat = (engine == 1);
+      vector<double> latencies;
+      uint64_t results = 0;
+      for (const auto& q : queries) {
+        double totalMs = 0;
+        BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, isRange);
+        for (unsigned r = 0; r < repetitions; r++) {
+          visitor = BenchmarkVisitor(q.data(), rangeRadius, dimension, isRange);
+          auto startQuery = chrono::high_resolution_clock::now();
+          if (!useFlat && isRange) {
+            runRangeQuery(tree, q, rangeRadius, dimension, ballShape, visitor);
+          } else if (!useFlat) {
+            Point queryPoint(q.data(), dimension);
+            tree.nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+          } else if (isRange && ballShape) {
+            flat.intersectsWithBall(q.data(), rangeRadius, visitor);
+          } else if (isRange) {
+            for (uint32_t d = 0; d < dimension; d++) {
+              lowV[d] = q[d] - rangeRadius;
+              highV[d] = q[d] + rangeRadius;
+            }
+            flat.intersectsWithQuery(lowV.data(), highV.data(), visitor);
+          } else {
+            flat.nearestNeighborQuery(kNeighbors, q.data(), visitor);
+          }
+          totalMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startQuery).count();
+        }
+        latencies.push_back(totalMs / repetitions);
+        results += visitor.resultCount;
+        counts[engine].push_back(visitor.resultCount);
+        nearest[engine].push_back(visitor.minDistanceFound);
+      }
+
+      double meanMs = accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+      sort(latencies.begin(), latencies.end());
+      if (!useFlat) baseMean = meanMs;
+      double speedup = meanMs > 0 ? baseMean / meanMs : 0.0;
+      size_t mismatches = 0;
+      if (useFlat) {
+        for (size_t i = 0; i < queries.size(); i++) {
+          if (counts[0][i] != counts[1][i] || fabs(nearest[0][i] - nearest[1][i]) > 1e-9 * max(1.0, nearest[0][i])) mismatches++;
+        }
+      }
+      const char* engineName = useFlat ? "plano" : "disco";
+      const char* typeName = isRange ? "Range" : "kNN";
+      out << engineName << "," << typeName << "," << queries.size() << "," << meanMs << "," << percentile(latencies, 50)
+          << "," << percentile(latencies, 99) << "," << speedup << "," << (double)results / queries.size() << ","
+          << mismatches << "\n";
+      cout << left << setw(8) << engineName << setw(8) << typeName << right << setw(14) << meanMs << setw(12)
+           << percentile(latencies, 50) << setw(12) << percentile(latencies, 99) << setw(10) << speedup << setw(14)
+           << mismatches << endl;
+    }
+  }
+  cout << "Comparação salva em " << flatFile << endl;
+}
+
+// Visitor no estilo original: para cada resultado, copia a forma com getShape, extrai o MBR e
+// recalcula a distância. Linha de base do modo --result-buffer.
+class ShapeCopyVisitor : public IVisitor {
+  public:
+    uint32_t resultCount = 0;
+
+    ShapeCopyVisitor(const double* q, double r, uint32_t d, bool range)
+      : queryPoint(q), queryRadius(r), dimension(d), isRangeQuery(range) {}
+
+    void visitNode(const INode&) override {}
+
+    void visitData(const IData& d) override {
+      IShape* shape;
+      d.getShape(&shape);
+      Region mbr;
+      shape->getMBR(mbr);
+      if (!isRangeQuery || calculateL2(queryPoint, mbr.m_pLow, dimension) <= queryRadius) resultCount++;
+      delete shape;
+    }
+
+    void visitData(std::vector<const IData*>&) override {}
+
+  private:
+    const double* queryPoint;
+    double queryRadius;
+    uint32_t dimension;
+    bool isRangeQuery;
+};
+
+// Modo --result-buffer: custo de materializar os resultados. As mesmas queries k-NN e Range
+// rodam na árvore em disco com getShape por resultado (original), com BenchmarkVisitor e com
+// um ResultBuffer reservado uma vez (result_buffer.h), e no motor plano com visitor e com
+// buffer. Tempo por resultado, realocações do buffer e divergências em relação à linha de base
+// vão para results/materializacao_<dataset>.csv.
+void runResultMaterialization(ISpatialIndex& tree, IStorageManager& pages, id_type indexIdentifier, const string& datasetName,
+                              const vector<vector<double>>& knnQueries, const vector<vector<double>>& rangeQueries,
+                              int kNeighbors, double rangeRadius, uint32_t dimension, bool ballShape, unsigned repetitions) {
+  FlatRTree flat(pages, indexIdentifier, dimension);
+  cout << "\n--- MATERIALIZACAO DE RESULTADOS ---" << endl;
+
+  string outFile = "results/materializacao_" + datasetName + ".csv";
+  ofstream out(outFile);
+  out << "Motor,Coleta,Tipo,Consultas,Resultados_Media,Tempo_ms_Media,ns_por_Resultado,Realocacoes,Divergencias\n";
+  cout << left << setw(8) << "Motor" << setw(10) << "Coleta" << setw(8) << "Tipo" << right << setw(14) << "Resultados"
+       << setw(14) << "Media_ms" << setw(14) << "ns/result" << setw(14) << "Realocacoes" << setw(14) << "Divergencias" << endl;
+
+  vector<double> lowV(dimension), highV(dimension);
+  ResultBuffer buffer;
+  for (int type = 0; type < 2; type++) {
+    bool isRange = (type == 1);
+    const vector<vector<double>>& queries = isRange ? rangeQueries : knnQueries;
+    if (queries.empty()) continue;
+
+    // Executa uma consulta com a coleta "method" e devolve o número de resultados
+    auto runQuery = [&](int method, const vector<double>& q) -> uint32_t {
+      switch (method) {
+        case 0: {
+          ShapeCopyVisitor visitor(q.data(), rangeRadius, dimension, isRange);
+          if (isRange) runRangeQuery(tree, q, rangeRadius, dimension, ballShape, visitor);
+          else {
+            Point queryPoint(q.data(), dimension);
+            tree.nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+          }
+          return visitor.resultCount;
+        }
+        case 1: {
+          BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, isRange);
+          if (isRange) runRangeQuery(tree, q, rangeRadius, dimension, ballShape, visitor);
+          else {
+            Point queryPoint(q.data(), dimension);
+            tree.nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+          }
+          return visitor.resultCount;
+        }
+        case 2:
+          if (isRange) collectRange(tree, q.data(), dimension, rangeRadius, ballShape, buffer);
+          else collectNearestNeighbors(tree, q.data(), dimension, kNeighbors, buffer);
+          return static_cast<uint32_t>(buffer.size());
+        case 3: {
+          BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, isRange);
+          if (isRange && ballShape) {
+            flat.intersectsWithBall(q.data(), rangeRadius, visitor);
+          } else if (isRange) {
+            for (uint32_t d = 0; d < dimension; d++) {
+              lowV[d] = q[d] - rangeRadius;
+              highV[d] = q[d] + rangeRadius;
+            }
+            flat.intersectsWithQuery(lowV.data(), highV.data(), visitor);
+          } else {
+            flat.nearestNeighborQuery(kNeighbors, q.data(), visitor);
+          }
+          return visitor.resultCount;
+        }
+        default:
+          if (isRange) flat.rangeQuery(q.data(), rangeRadius, ballShape, buffer);
+          else flat.nearestNeighborQuery(kNeighbors, q.data(), buffer);
+          return static_cast<uint32_t>(buffer.size());
+      }
+    };
+
+    static const char* engines[5] = {"disco", "disco", "disco", "plano", "plano"};
+    static const char* methods[5] = {"getShape", "visitor", "buffer", "visitor", "buffer"};
+    vector<uint32_t> baseline;
+    for (int method = 0; method < 5; method++) {
+      bool usesBuffer = (method == 2 || method == 4);
+      if (usesBuffer) {
+        // Capacidade do maior resultado da linha de base (k-NN: k), reservada fora do tempo
+        uint32_t largest = isRange ? *max_element(baseline.begin(), baseline.end()) : static_cast<uint32_t>(kNeighbors);
+        buffer = ResultBuffer(largest);
+      }
+      double totalMs = 0;
+      uint64_t results = 0;
+      size_t mismatches = 0;
+      for (size_t i = 0; i < queries.size(); i++) {
+        uint32_t count = 0;
+        auto startQuery = chrono::high_resolution_clock::now();
+        for (unsigned r = 0; r < repetitions; r++) count = runQuery(method, queries[i]);
+        totalMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startQuery).count() / repetitions;
+        results += count;
+        if (method == 0) baseline.push_back(count);
+        else if (count != baseline[i]) mismatches++;
+      }
+
+      double meanMs = totalMs / queries.size();
+      double meanResults = (double)results / queries.size();
+      double nsPerResult = results > 0 ? totalMs * 1e6 / results : 0.0;
+      const char* typeName = isRange ? "Range" : "kNN";
+      out << engines[method] << "," << methods[method] << "," << typeName << "," << queries.size() << "," << meanResults
+          << "," << meanMs << "," << nsPerResult << ",";
+      if (usesBuffer) out << buffer.growths();
+      out << "," << mismatches << "\n";
+      cout << left << setw(8) << engines[method] << setw(10) << methods[method] << setw(8) << typeName << right
+           << setw(14) << meanResults << setw(14) << meanMs << setw(14) << nsPerResult << setw(14)
+           << (usesBuffer ? to_string(buffer.growths()) : string("-")) << setw(14) << mismatches << endl;
+    }
+  }
+  cout << "Comparação salva em " << outFile << endl;
+}
+
+// Modo --prefetch: as mesmas queries k-NN e Range com o índice frio (arquivos retirados do
+// cache do SO antes de cada consulta), no DiskStorageManager síncrono e no storage com
+// leituras antecipadas (prefetch_storage.h). Latência, páginas, aproveitamento das leituras
+// antecipadas e a profundidade de I/O atingida vão para results/prefetch_<dataset>.csv.
+void runPrefetchComparison(const string& baseName, id_type indexIdentifier, const string& datasetName,
+                           const vector<vector<double>>& knnQueries, const vector<vector<double>>& rangeQueries,
+                           int kNeighbors, double rangeRadius, uint32_t dimension, bool ballShape,
+                           const string& backend, uint32_t depth, uint32_t lookahead) {
+  unique_ptr<PrefetchingStorageManager> prefetch;
+  try {
+    prefetch.reset(new PrefetchingStorageManager(baseName, dimension, backend, depth, lookahead));
+  } catch (std::exception& e) {
+    cerr << "Prefetch indisponível: " << e.what() << endl;
+    return;
+  }
+  string diskBase = baseName;  // loadDiskStorageManager recebe string não const
+  unique_ptr<IStorageManager> disk(StorageManager::loadDiskStorageManager(diskBase));
+  CountingStorageManager counter(*disk);
+  unique_ptr<ISpatialIndex> syncTree(RTree::loadRTree(counter, indexIdentifier));
+  unique_ptr<ISpatialIndex> prefetchTree(RTree::loadRTree(*prefetch, indexIdentifier));
+
+  cout << "\n--- PREFETCH ASSINCRONO (indice frio, backend " << prefetch->backendName() << ", profundidade " << depth
+       << ", janela k-NN " << lookahead << ") ---" << endl;
+  string prefetchFile = "results/prefetch_" + datasetName + ".csv";
+  ofstream out(prefetchFile);
+  out << "Backend,Tipo,Consultas,Tempo_ms_Media,p50_ms,p99_ms,Speedup,Paginas_Media,Prefetch_Aproveitados_Media,"
+         "Leituras_Sincronas_Media,Prefetch_Desperdicados_Media,Profundidade_IO_Media,Profundidade_IO_Max,Divergencias\n";
+  cout << left << setw(10) << "Backend" << setw(8) << "Tipo" << right << setw(12) << "Media_ms" << setw(12) << "p99_ms"
+       << setw(10) << "Speedup" << setw(12) << "Paginas" << setw(12) << "Antecip." << setw(12) << "Desperd." << setw(12)
+       << "Prof_IO" << setw(14) << "Divergencias" << endl;
+
+  bool dropOk = true;
+  vector<double> lowV(dimension), highV(dimension);
+  for (int type = 0; type < 2; type++) {
+    bool isRange = (type == 1);
+    const vector<vector<double>>& queries = isRange ? rangeQueries : knnQueries;
+    if (queries.empty()) continue;
+    vector<uint32_t> baseCounts;
+    double baseMean = 0;
+    for (int engine = 0; engine < 2; engine++) {
+      bool usePrefetch = (engine == 1);
+      ISpatialIndex& tree = usePrefetch ? *prefetchTree : *syncTree;
+      prefetch->resetStats();
+      vector<double> latencies;
+      uint64_t pages = 0;
+      size_t mismatches = 0;
+      for (size_t i = 0; i < queries.size(); i++) {
+        const vector<double>& q = queries[i];
+        dropOk &= dropFileFromPageCache(baseName + ".idx");
+        dropOk &= dropFileFromPageCache(baseName + ".dat");
+        BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, isRange);
+        uint64_t readsPre = counter.reads();
+        auto startQuery = chrono::high_resolution_clock::now();
+        if (usePrefetch && isRange && ballShape) {
+          prefetch->beginBall(q.data(), rangeRadius);
+        } else if (usePrefetch && isRange) {
+          for (uint32_t d = 0; d < dimension; d++) {
+            lowV[d] = q[d] - rangeRadius;
+            highV[d] = q[d] + rangeRadius;
+          }
+          prefetch->beginRange(lowV.data(), highV.data());
+        } else if (usePrefetch) {
+          prefetch->beginKnn(q.data());
+        }
+        if (isRange) {
+          runRangeQuery(tree, q, rangeRadius, dimension, ballShape, visitor);
+        } else {
+          Point queryPoint(q.data(), dimension);
+          tree.nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+        }
+        latencies.push_back(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startQuery).count());
+        // Leituras em voo que a consulta não usou terminam fora do tempo medido
+        if (usePrefetch) prefetch->endQuery();
+        pages += usePrefetch ? 0 : counter.reads() - readsPre;
+        if (!usePrefetch) baseCounts.push_back(visitor.resultCount);
+        else if (visitor.resultCount != baseCounts[i]) mismatches++;
+      }
+
+      const PrefetchStats& st = prefetch->stats();
+      double n = queries.size();
+      if (usePrefetch) pages = st.loads;
+      double meanMs = accumulate(latencies.begin(), latencies.end(), 0.0) / n;
+      sort(latencies.begin(), latencies.end());
+      if (!usePrefetch) baseMean = meanMs;
+      double speedup = meanMs > 0 ? baseMean / meanMs : 0.0;
+      string name = usePrefetch ? prefetch->backendName() : "sincrono";
+      // O backend síncrono lê uma página por vez: profundidade 1, nenhuma leitura antecipada
+      double hits = usePrefetch ? st.prefetchHits / n : 0.0;
+      double syncReads = usePrefetch ? st.syncReads / n : pages / n;
+      double wasted = usePrefetch ? st.wasted / n : 0.0;
+      double ioDepth = usePrefetch ? st.averageDepth() : 1.0;
+      uint32_t maxDepth = usePrefetch ? st.maxDepth : 1;
+      const char* typeName = isRange ? "Range" : "kNN";
+      out << name << "," << typeName << "," << queries.size() << "," << meanMs << "," << percentile(latencies, 50) << ","
+          << percentile(latencies, 99) << "," << speedup << "," << pages / n << "," << hits << "," << syncReads << ","
+          << wasted << "," << ioDepth << "," << maxDepth << "," << mismatches << "\n";
+      cout << left << setw(10) << name << setw(8) << typeName << right << setw(12) << meanMs << setw(12)
+           << percentile(latencies, 99) << setw(10) << speedup << setw(12) << pages / n << setw(12) << hits << setw(12)
+           << wasted << setw(12) << ioDepth << setw(14) << mismatches << endl;
+    }
+  }
+  if (!dropOk) cerr << "Aviso: posix_fadvise(DONTNEED) falhou em algum arquivo do índice; as consultas podem não ter sido frias" << endl;
+  cout << "Comparação salva em " << prefetchFile << endl;
+}
+
+// Modo --workload: copia o índice para <índice>_churn e executa nele "operations" operações
+// sorteadas na proporção de "mix" (inserção, remoção, k-NN, Range). A cada "window" operações
+// grava a vazão da janela, as páginas lidas por consulta e a forma da árvore (a travessia da
+// forma fica fora do tempo) em results/carga_mista_<dataset>.csv; os percentis de latência por
+// tipo de operação vão para results/carga_mista_latencia_<dataset>.csv. Ao final, o conjunto
+// de mudanças é salvo em <índice>_churn.churn para o validar --churn.
+void runMixedWorkload(const string& baseName, id_type indexIdentifier, const TreeParams& params,
+                      const string& datasetPath, const string& datasetName, uint32_t dimension, bool useBinary,
+                      const WorkloadMix& mix, uint64_t operations, uint64_t window,
+                      const vector<vector<double>>& knnQueries, const vector<vector<double>>& rangeQueries,
+                      int kNeighbors, double rangeRadius, bool ballShape) {
+  Dataset data;
+  openDatasetOrExit(data, datasetPath, dimension, useBinary);
+
+  string churnBase = baseName + "_churn";
+  fs::copy_file(baseName + ".idx", churnBase + ".idx", fs::copy_options::overwrite_existing);
+  fs::copy_file(baseName + ".dat", churnBase + ".dat", fs::copy_options::overwrite_existing);
+  IStorageManager* disk = StorageManager::loadDiskStorageManager(churnBase);
+  CountingStorageManager counter(*disk);
+  ISpatialIndex* tree = RTree::loadRTree(counter, indexIdentifier);
+
+  cout << "\n--- CARGA MISTA (" << operations << " operações, inserção/remoção/kNN/Range = " << mix.describe()
+       << "%) ---" << endl;
+  string windowFile = "results/carga_mista_" + datasetName + ".csv";
+  ofstream out(windowFile);
+  out << "Janela,Operacoes,Tempo_s,Ops_por_s,Insercoes,Remocoes,Consultas_kNN,Consultas_Range,"
+         "Paginas_kNN_Media,Paginas_Range_Media,Pontos,Nos,Altura,Ocupacao_Folhas,Disco_MB\n";
+  cout << left << setw(8) << "Janela" << right << setw(12) << "Ops/s" << setw(12) << "Pag_kNN" << setw(12)
+       << "Pag_Range" << setw(12) << "Pontos" << setw(10) << "Nos" << setw(8) << "Altura" << setw(12) << "Ocup_Folhas" << endl;
+
+  LivePointSet points(data, 54321);
+  WorkloadGenerator generator(mix, 12345);
+  vector<double> coords(dimension);
+  vector<double> latencies[WORKLOAD_OP_COUNT];
+  uint64_t windowOps[WORKLOAD_OP_COUNT] = {0, 0, 0, 0}, windowPages[WORKLOAD_OP_COUNT] = {0, 0, 0, 0};
+  double firstPages[2] = {-1, -1}, lastPages[2] = {0, 0};
+  size_t knnNext = 0, rangeNext = 0;
+  uint64_t failedDeletes = 0, windowIndex = 0, done = 0;
+  double elapsed = 0;
+
+  auto windowStart = chrono::high_resolution_clock::now();
+  for (uint64_t i = 0; i < operations; i++) {
+    WorkloadOp op = generator.next();
+    // Sem queries do tipo sorteado ou sem pontos para remover, a operação vira uma inserção
+    if ((op == WorkloadOp::Knn && knnQueries.empty()) || (op == WorkloadOp::Range && rangeQueries.empty()) ||
+        (op == WorkloadOp::Delete && points.size() == 0)) {
+      op = WorkloadOp::Insert;
+    }
+
+    // Preparação fora do tempo: coordenadas do ponto e query da vez
+    id_type id = 0;
+    if (op == WorkloadOp::Insert) id = points.prepareInsert(coords);
+    else if (op == WorkloadOp::Delete) id = points.prepareDelete(coords);
+    const vector<double>& q = (op == WorkloadOp::Knn) ? knnQueries[knnNext++ % knnQueries.size()]
+                            : (op == WorkloadOp::Range) ? rangeQueries[rangeNext++ % rangeQueries.size()] : coords;
+    Point point(q.data(), dimension);
+    BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, op == WorkloadOp::Range);
+
+    uint64_t readsPre = counter.reads();
+    auto startOp = chrono::high_resolution_clock::now();
+    switch (op) {
+      case WorkloadOp::Insert: tree->insertData(0, nullptr, point, id); break;
+      case WorkloadOp::Delete: if (!tree->deleteData(point, id)) failedDeletes++; break;
+      case WorkloadOp::Knn: tree->nearestNeighborQuery(kNeighbors, point, visitor); break;
+      case WorkloadOp::Range: runRangeQuery(*tree, q, rangeRadius, dimension, ballShape, visitor); break;
+    }
+    auto endOp = chrono::high_resolution_clock::now();
+    int type = static_cast<int>(op);
+    latencies[type].push_back(chrono::duration<double, milli>(endOp - startOp).count());
+    windowOps[type]++;
+    windowPages[type] += counter.reads() - readsPre;
+    done++;
+
+    if (done % window != 0 && i + 1 != operations) continue;
+
+    // Fim da janela: vazão sem a travessia da forma da árvore
+    double windowSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - windowStart).count();
+    elapsed += windowSeconds;
+    uint64_t windowTotal = accumulate(windowOps, windowOps + WORKLOAD_OP_COUNT, uint64_t(0));
+    double pages[2];
+    for (int t = 0; t < 2; t++) {
+      int opType = static_cast<int>(t == 0 ? WorkloadOp::Knn : WorkloadOp::Range);
+      pages[t] = windowOps[opType] > 0 ? (double)windowPages[opType] / windowOps[opType] : 0.0;
+      if (windowOps[opType] > 0) {
+        if (firstPages[t] < 0) firstPages[t] = pages[t];
+        lastPages[t] = pages[t];
+      }
+    }
+    TreeShapeStrategy shape;
+    tree->queryStrategy(shape);
+    double diskMB = fs::file_size(churnBase + ".dat") / (1024.0 * 1024.0);
+    double opsPerSecond = windowSeconds > 0 ? windowTotal / windowSeconds : 0.0;
+
+    out << ++windowIndex << "," << done << "," << elapsed << "," << opsPerSecond << "," << windowOps[0] << ","
+        << windowOps[1] << "," << windowOps[2] << "," << windowOps[3] << "," << pages[0] << "," << pages[1] << ","
+        << points.size() << "," << shape.totalNodes() << "," << shape.height() << ","
+        << shape.leafFill(params.leafCapacity) << "," << diskMB << "\n";
+    cout << left << setw(8) << windowIndex << right << setw(12) << opsPerSecond << setw(12) << pages[0] << setw(12)
+         << pages[1] << setw(12) << points.size() << setw(10) << shape.totalNodes() << setw(8) << shape.height()
+         << setw(12) << shape.leafFill(params.leafCapacity) << endl;
+    fill(windowOps, windowOps + WORKLOAD_OP_COUNT, 0);
+    fill(windowPages, windowPages + WORKLOAD_OP_COUNT, 0);
+    windowStart = chrono::high_resolution_clock::now();
+  }
+  out.close();
+
+  string latencyFile = "results/carga_mista_latencia_" + datasetName + ".csv";
+  ofstream latencyLog(latencyFile);
+  latencyLog << "Operacao,Quantidade,Media_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+  cout << "Vazão sustentada: " << (elapsed > 0 ? done / elapsed : 0.0) << " ops/s em " << elapsed << " s" << endl;
+  for (int t = 0; t < WORKLOAD_OP_COUNT; t++) {
+    vector<double>& lat = latencies[t];
+    if (lat.empty()) continue;
+    double mean = accumulate(lat.begin(), lat.end(), 0.0) / lat.size();
+    sort(lat.begin(), lat.end());
+    latencyLog << workloadOpName(static_cast<WorkloadOp>(t)) << "," << lat.size() << "," << mean << ","
+               << percentile(lat, 50) << "," << percentile(lat, 95) << "," << percentile(lat, 99) << "," << lat.back() << "\n";
+    cout << "  " << left << setw(10) << workloadOpName(static_cast<WorkloadOp>(t)) << right << setw(8) << lat.size()
+         << " ops, média " << mean << " ms, p50 " << percentile(lat, 50) << " ms, p99 " << percentile(lat, 99) << " ms" << endl;
+  }
+  for (int t = 0; t < 2; t++) {
+    if (firstPages[t] < 0) continue;
+    cout << "Páginas por consulta " << (t == 0 ? "kNN" : "Range") << ": " << firstPages[t] << " na primeira janela, "
+         << lastPages[t] << " na última" << endl;
+  }
+  if (failedDeletes > 0) cerr << "Aviso: " << failedDeletes << " remoções não encontraram o ponto no índice" << endl;
+
+  delete tree;  // Grava o cabeçalho atualizado
+  delete disk;
+  points.log().save(churnBase + ".churn");
+  cout << "Janelas salvas em " << windowFile << ", latências em " << latencyFile << endl;
+  cout << "Índice após a carga em " << churnBase << " (confira com validar --churn)" << endl;
+}
+
+// Modo --sweep: para cada combinação de parâmetros constrói um índice próprio em
+// sweep/rtree_index_<dataset>_<modo>_<config>, executa as mesmas queries k-NN e Range e
+// grava uma linha por configuração e tipo de query em results/sweep_<dataset>.csv.
+// Configurações rejeitadas pela biblioteca (ex: fill factor > 0.5 nas variantes linear e
+// quadratic) são puladas com aviso.
+void runParameterSweep(const vector<TreeParams>& configs, const string& buildMode, const string& datasetPath,
+                       const string& datasetName, uint32_t dimension, bool useBinary,
+                       const vector<vector<double>>& knnQueries, const vector<vector<double>>& rangeQueries,
+                       int kNeighbors, double rangeRadius, bool ballShape, bool keepIndexes) {
+  if (!fs::exists("sweep")) fs::create_directory("sweep");
+  string sweepFile = "results/sweep_" + datasetName + ".csv";
+  ofstream out(sweepFile);
+  out << "Modo,Variante,Pagina,Cap_Internos,Cap_Folhas,Fill_Factor,Tempo_Construcao_s,Disco_MB,Nos,Altura,"
+         "Tipo,Consultas,Latencia_Media_ms,p99_ms,Paginas_Media\n";
+
+  cout << "\n--- VARREDURA DE PARAMETROS (" << configs.size() << " configurações, modo " << buildMode << ") ---" << endl;
+  for (size_t c = 0; c < configs.size(); c++) {
+    const TreeParams& params = configs[c];
+    string tag = treeParamsTag(params, buildMode);
+    string sweepBase = "sweep/rtree_index_" + datasetName + "_" + buildMode + "_" + tag;
+    fs::remove(sweepBase + ".idx");
+    fs::remove(sweepBase + ".dat");
+    cout << "[" << c + 1 << "/" << configs.size() << "] " << tag << endl;
+
+    IStorageManager* disk = StorageManager::createNewDiskStorageManager(sweepBase, params.pageSize);
+    CountingStorageManager counter(*disk);
+    ISpatialIndex* tree = nullptr;
+    id_type indexIdentifier = 1;
+    auto startBuild = chrono::high_resolution_clock::now();
+    try {
+      tree = buildTree(buildMode, counter, params, datasetPath, dimension, useBinary, indexIdentifier);
+      tree->flush();
+      counter.flush();
+    } catch (Tools::Exception& e) {
+      cerr << "  Configuração rejeitada: " << e.what() << endl;
+      delete tree; delete disk;
+      fs::remove(sweepBase + ".idx");
+      fs::remove(sweepBase + ".dat");
+      continue;
+    }
+    double buildTime = chrono::duration<double>(chrono::high_resolution_clock::now() - startBuild).count();
+    double diskMB = (fs::file_size(sweepBase + ".idx") + fs::file_size(sweepBase + ".dat")) / (1024.0 * 1024.0);
+    TreeShapeStrategy shape;
+    tree->queryStrategy(shape);
+
+    for (int type = 0; type < 2; type++) {
+      bool isRange = (type == 1);
+      const vector<vector<double>>& queries = isRange ? rangeQueries : knnQueries;
+      if (queries.empty()) continue;
+
+      vector<double> latencies;
+      uint64_t pages = 0;
+      for (const auto& q : queries) {
+        BenchmarkVisitor visitor(q.data(), rangeRadius, dimension, isRange);
+        uint64_t readsPre = counter.reads();
+        auto startQuery = chrono::high_resolution_clock::now();
+        if (isRange) {
+          runRangeQuery(*tree, q, rangeRadius, dimension, ballShape, visitor);
+        } else {
+          Point queryPoint(q.data(), dimension);
+          tree->nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+        }
+        auto endQuery = chrono::high_resolution_clock::now();
+        latencies.push_back(chrono::duration<double, milli>(endQuery - startQuery).count());
+        pages += counter.reads() - readsPre;
+      }
+      sort(latencies.begin(), latencies.end());
+      double meanMs = accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+      double p99 = percentile(latencies, 99);
+      double meanPages = (double)pages / queries.size();
+
+      out << buildMode << "," << treeVariantName(params.variant) << "," << params.pageSize << ","
+          << params.indexCapacity << "," << params.leafCapacity << "," << params.activeFillFactor(buildMode) << ","
+          << buildTime << "," << diskMB << "," << shape.totalNodes() << "," << shape.height() << ","
+          << (isRange ? "Range" : "kNN") << "," << queries.size() << "," << meanMs << "," << p99 << ","
+          << meanPages << "\n";
+      cout << "  " << (isRange ? "Range" : "kNN  ") << " construcao=" << buildTime << "s disco=" << diskMB
+           << "MB media=" << meanMs << "ms p99=" << p99 << "ms paginas=" << meanPages << endl;
+    }
+    out.flush();
+
+    delete tree; delete disk;
+    if (!keepIndexes) {
+      fs::remove(sweepBase + ".idx");
+      fs::remove(sweepBase + ".dat");
+    }
+  }
+  cout << "Varredura salva em " << sweepFile << endl;
+}
+
+// Constrói o índice no modo external com cada orçamento de memória e grava tempo total e
+// pico de RSS (zerado antes de cada construção) em results/memoria_<dataset>.csv. A referência
+// é o bulk loading STR da biblioteca (modo str), construído uma vez antes dos orçamentos.
+void runMemoryBudgetSweep(const vector<uint64_t>& budgets, const TreeParams& params, const string& datasetPath,
+                          const string& datasetName, uint32_t dimension, bool useBinary, bool keepIndexes) {
+  if (!fs::exists("sweep")) fs::create_directory("sweep");
+  string memoryFile = "results/memoria_" + datasetName + ".csv";
+  ofstream out(memoryFile);
+  out << "Orcamento_MB,Tempo_s,Pico_RSS_MB,Pico_Isolado,Pontos,Runs,Linhas_por_Run,Leitura_s,Runs_s,Merge_Empacotamento_s,"
+         "Tempo_STR_s,Pico_RSS_STR_MB,Relacao_Tempo_STR\n";
+
+  cout << "\n--- CONSTRUCAO COM MEMORIA LIMITADA (" << budgets.size() << " orçamentos) ---" << endl;
+  string strBase = "sweep/rtree_index_" + datasetName + "_str";
+  fs::remove(strBase + ".idx");
+  fs::remove(strBase + ".dat");
+  resetPeakResidentMemory();
+  auto startStr = chrono::high_resolution_clock::now();
+  IStorageManager* strDisk = StorageManager::createNewDiskStorageManager(strBase, params.pageSize);
+  id_type strIdentifier = 1;
+  ISpatialIndex* strTree = buildTree("str", *strDisk, params, datasetPath, dimension, useBinary, strIdentifier);
+  strTree->flush();
+  strDisk->flush();
+  double strTime = chrono::duration<double>(chrono::high_resolution_clock::now() - startStr).count();
+  double strPeakMB = getPeakResidentMemoryMB();
+  delete strTree; delete strDisk;
+  if (!keepIndexes) {
+    fs::remove(strBase + ".idx");
+    fs::remove(strBase + ".dat");
+  }
+  cout << "  referência str: tempo=" << strTime << "s pico_rss=" << strPeakMB << "MB" << endl;
+  for (uint64_t budget : budgets) {
+    double budgetMB = budget / (1024.0 * 1024.0);
+    string sweepBase = "sweep/rtree_index_" + datasetName + "_external_" + to_string((uint64_t)budgetMB) + "MB";
+    fs::remove(sweepBase + ".idx");
+    fs::remove(sweepBase + ".dat");
+
+    // Sem o reset (kernel sem clear_refs) o pico é acumulado desde o início do processo
+    bool isolated = resetPeakResidentMemory();
+    auto startBuild = chrono::high_resolution_clock::now();
+    IStorageManager* disk = StorageManager::createNewDiskStorageManager(sweepBase, params.pageSize);
+    id_type indexIdentifier = 1;
+    ExternalSortStats stats;
+    ISpatialIndex* tree = buildTreeExternal(*disk, params, datasetPath, dimension, useBinary, budget, indexIdentifier, &stats);
+    tree->flush();
+    disk->flush();
+    double buildTime = chrono::duration<double>(chrono::high_resolution_clock::now() - startBuild).count();
+    double peakMB = getPeakResidentMemoryMB();
+    delete tree; delete disk;
+
+    out << budgetMB << "," << buildTime << "," << peakMB << "," << (isolated ? 1 : 0) << "," << stats.rows << ","
+        << stats.runs << "," << stats.rowsPerRun << "," << stats.scanSeconds << "," << stats.runSeconds << ","
+        << stats.mergeSeconds << "," << strTime << "," << strPeakMB << "," << buildTime / strTime << "\n";
+    out.flush();
+    cout << "  orçamento=" << budgetMB << "MB tempo=" << buildTime << "s (" << buildTime / strTime << "x str) pico_rss="
+         << peakMB << "MB runs=" << stats.runs << endl;
+
+    if (!keepIndexes) {
+      fs::remove(sweepBase + ".idx");
+      fs::remove(sweepBase + ".dat");
+    }
+  }
+  cout << "Resultados salvos em " << memoryFile << endl;
+}
+
+// Constrói o índice no modo parallel com cada número de threads e grava o tempo de cada fase
+// (parsing, partição, subárvores, merge) e o speedup sobre a primeira contagem da lista em
+// results/paralelo_<dataset>.csv.
+void runThreadSweep(const vector<unsigned>& threadCounts, const TreeParams& params, const string& datasetPath,
+                    const string& datasetName, uint32_t dimension, bool useBinary, bool keepIndexes) {
+  if (!fs::exists("sweep")) fs::create_directory("sweep");
+  string threadsFile = "results/paralelo_" + datasetName + ".csv";
+  ofstream out(threadsFile);
+  out << "Threads,Tempo_s,Speedup,Parsing_s,Particao_s,Subarvores_s,Merge_s,Pontos,Subarvores,Altura,Nos\n";
+
+  cout << "\n--- CONSTRUCAO PARALELA (" << threadCounts.size() << " contagens de threads) ---" << endl;
+  double baseline = 0;
+  for (unsigned threads : threadCounts) {
+    string sweepBase = "sweep/rtree_index_" + datasetName + "_parallel_" + to_string(threads) + "t";
+    fs::remove(sweepBase + ".idx");
+    fs::remove(sweepBase + ".dat");
+
+    auto startBuild = chrono::high_resolution_clock::now();
+    IStorageManager* disk = StorageManager::createNewDiskStorageManager(sweepBase, params.pageSize);
+    id_type indexIdentifier = 1;
+    ParallelBuildStats stats;
+    double parseSeconds = 0;
+    ISpatialIndex* tree = buildTreeParallel(*disk, params, datasetPath, dimension, useBinary, threads, indexIdentifier,
+                                            &stats, &parseSeconds);
+    tree->flush();
+    disk->flush();
+    double buildTime = chrono::duration<double>(chrono::high_resolution_clock::now() - startBuild).count();
+    delete tree; delete disk;
+    if (baseline == 0) baseline = buildTime;
+
+    out << threads << "," << buildTime << "," << baseline / buildTime << "," << parseSeconds << ","
+        << stats.partitionSeconds << "," << stats.subtreeSeconds << "," << stats.mergeSeconds << "," << stats.rows << ","
+        << stats.subtrees << "," << stats.height << "," << stats.nodes << "\n";
+    out.flush();
+    cout << "  threads=" << threads << " tempo=" << buildTime << "s speedup=" << baseline / buildTime << endl;
+
+    if (!keepIndexes) {
+      fs::remove(sweepBase + ".idx");
+      fs::remove(sweepBase + ".dat");
+    }
+  }
+  cout << "Resultados salvos em " << threadsFile << endl;
+}
+
 int main(int argc, char** argv) {
   // --- VERIFICAÇÃO DE ARGUMENTOS ---
   if (argc < 3) {
-    cerr << "Uso: " << argv[0] << " <caminho_dataset> <dimensao>" << endl;
-    cerr << "Exemplo: " << argv[0] << " ../datasets/data.txt 128" << endl;
+    cerr << "Uso: " << argv[0] << " <caminho_dataset> <dimensao> [--build=incremental|str|hilbert|external|parallel] [--build-threads=N] [--build-threads-sweep=1,2,4,...] [--memory-budget=256MB] [--memory-budgets=64MB,256MB,...] [--format=auto|csv] [--warmup=W] [--repeat=N] [--cold-cache] [--pin-cpu=C] [--concurrency=N] [--concurrency-repeat=R] [--buffer=64MB|2000p] [--buffer-policy=lru|2q] [--range-shape=ball|box] [--range-compare] [--queries=nome | --selectivity=N [--query-dist=dataset|ood|zipf] [--query-count=N] [--zipf-s=S] [--hotspots=H]] [--flat] [--result-buffer] [--prefetch[=auto|uring|threads] [--prefetch-depth=32] [--prefetch-knn=4]] [--workload=90/5/5 [--workload-ops=N] [--workload-window=W]] [--knn-batch[=1,8,64,256]] [--precision=float64|float32|int8] [--approx-eps=E] [--approx-leaves=N] [--pca=M [--pca-sample=N]] [--trace]"
+         << " [--page-size=B] [--index-capacity=N] [--leaf-capacity=N] [--fill-factor=F] [--variant=rstar|quadratic|linear]"
+         << " [--sweep --page-sizes=... --index-capacities=... --leaf-capacities=... --fill-factors=... --variants=... [--sweep-keep]]" << endl;
+    cerr << "Exemplo: " << argv[0] << " ../datasets/data.txt 128 --build=str" << endl;
     return 1;
   }
 
@@ -155,9 +1286,148 @@ int main(int argc, char** argv) {
   // --- PARÂMETROS CONFIGURÁVEIS ---
   int kNeighbors = 5;                   // K para consulta k-NN
   double rangeRadius = 0.1;               // Raio para Range Query
+
+  // Modo de construção: incremental (insertData ponto a ponto), str, hilbert, external ou parallel
+  string buildMode = getOption(argc, argv, "build", "incremental");
+
+  // Página, capacidades, fill factor e variante (padrões em tree_params.h)
+  TreeParams params;
+  try {
+    params.pageSize = static_cast<uint32_t>(stoul(getOption(argc, argv, "page-size", to_string(params.pageSize))));
+    params.indexCapacity = static_cast<uint32_t>(stoul(getOption(argc, argv, "index-capacity", to_string(params.indexCapacity))));
+    params.leafCapacity = static_cast<uint32_t>(stoul(getOption(argc, argv, "leaf-capacity", to_string(params.leafCapacity))));
+    if (hasOption(argc, argv, "fill-factor")) params.setFillFactor(buildMode, stod(getOption(argc, argv, "fill-factor", "")));
+    params.variant = parseTreeVariant(getOption(argc, argv, "variant", "rstar"));
+    params.validate(buildMode);
+  } catch (std::exception& e) {
+    cerr << "Parâmetro da árvore inválido: " << e.what() << endl;
+    return 1;
+  }
+  if (!hasOption(argc, argv, "sweep") && params.limitFillFactorToVariant(buildMode)) {
+    cout << "Variante " << treeVariantName(params.variant) << ": fill factor passado à biblioteca limitado a 0.5"
+         << " (máximo aceito por ela)" << endl;
+  }
+  // Modo concorrente: --concurrency=N threads (0 desativa), cada query repetida --concurrency-repeat vezes
+  unsigned concurrency = hasOption(argc, argv, "concurrency") ? resolveThreadCount(getOption(argc, argv, "concurrency", "auto")) : 0;
+  unsigned concurrencyRepeat = max(1, stoi(getOption(argc, argv, "concurrency-repeat", "1")));
+  // Medição: --warmup=W passadas de aquecimento, --repeat=N repetições por consulta,
+  // --cold-cache (índice fora do page cache do SO a cada repetição) e --pin-cpu=C
+  unsigned warmupPasses = static_cast<unsigned>(max(0, stoi(getOption(argc, argv, "warmup", "0"))));
+  unsigned repetitions = static_cast<unsigned>(max(1, stoi(getOption(argc, argv, "repeat", "1"))));
+  bool coldCache = hasOption(argc, argv, "cold-cache");
+  int pinCpu = hasOption(argc, argv, "pin-cpu") ? stoi(getOption(argc, argv, "pin-cpu", "0")) : -1;
+
+  // Buffer de páginas: --buffer=<tamanho> (ex: 64MB, 2000p) e --buffer-policy=lru|2q
+  PageCacheConfig cacheConfig;
+  try {
+    cacheConfig = parsePageCacheConfig(getOption(argc, argv, "buffer", "0"), getOption(argc, argv, "buffer-policy", "lru"));
+  } catch (std::exception& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  // Formato do dataset: auto (usa o .bin gerado pelo converter se existir) ou csv
+  bool useBinary = getOption(argc, argv, "format", "auto") != "csv";
+  // Forma da Range Query: "ball" (bola L2 exata, padrão) ou "box" (hipercubo + pós-filtro)
+  string rangeShape = getOption(argc, argv, "range-shape", "ball");
+  if (rangeShape != "ball" && rangeShape != "box") {
+    cerr << "Forma de Range Query inválida: " << rangeShape << " (use ball ou box)" << endl;
+    return 1;
+  }
+  bool ballShape = (rangeShape == "ball");
+  bool rangeCompare = hasOption(argc, argv, "range-compare");
+  // Comparação com o motor em memória de nós planos
+  bool flatCompare = hasOption(argc, argv, "flat");
+  // Custo de materialização dos resultados: getShape x visitor x ResultBuffer
+  bool resultBufferCompare = hasOption(argc, argv, "result-buffer");
+  // Prefetch assíncrono com o índice frio: --prefetch[=auto|uring|threads], --prefetch-depth, --prefetch-knn
+  bool prefetchCompare = hasOption(argc, argv, "prefetch");
+  string prefetchBackend = getOption(argc, argv, "prefetch", "auto");
+  if (prefetchBackend != "auto" && prefetchBackend != "uring" && prefetchBackend != "threads") {
+    cerr << "Backend de prefetch inválido: " << prefetchBackend << " (use auto, uring ou threads)" << endl;
+    return 1;
+  }
+  uint32_t prefetchDepth = static_cast<uint32_t>(stoul(getOption(argc, argv, "prefetch-depth", "32")));
+  uint32_t prefetchLookahead = static_cast<uint32_t>(stoul(getOption(argc, argv, "prefetch-knn", "4")));
+  // Carga mista sobre uma cópia do índice: --workload=I/D/C[/R], --workload-ops, --workload-window
+  bool mixedWorkload = hasOption(argc, argv, "workload");
+  WorkloadMix workloadMix;
+  uint64_t workloadOps = 0, workloadWindow = 0;
+  if (mixedWorkload) {
+    try {
+      workloadMix = WorkloadMix::parse(getOption(argc, argv, "workload", "90/5/5"));
+    } catch (std::exception& e) {
+      cerr << e.what() << endl;
+      return 1;
+    }
+    workloadOps = max<uint64_t>(1, stoull(getOption(argc, argv, "workload-ops", "20000")));
+    workloadWindow = max<uint64_t>(1, stoull(getOption(argc, argv, "workload-window", to_string(max<uint64_t>(1, workloadOps / 20)))));
+  }
+  // Rastreamento detalhado: geometria dos nós visitados e JSON por consulta
+  bool traceEnabled = hasOption(argc, argv, "trace");
+  // Precisão das coordenadas gravadas no índice: float64 (padrão), float32 ou int8
+  CoordPrecision precision;
+  try {
+    precision = parseCoordPrecision(getOption(argc, argv, "precision", "float64"));
+  } catch (std::exception& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  bool quantized = (precision != CoordPrecision::Float64);
+  // k-NN aproximado: poda relaxada por (1+ε) e/ou limite de folhas lidas por query
+  KnnSearchBudget approxBudget;
+  approxBudget.epsilon = stod(getOption(argc, argv, "approx-eps", "0"));
+  approxBudget.maxLeaves = stoull(getOption(argc, argv, "approx-leaves", "0"));
+  if (!approxBudget.isExact() && quantized) {
+    cerr << "--approx-eps/--approx-leaves não se combinam com --precision; use o índice float64." << endl;
+    return 1;
+  }
+  // Redução por PCA: índice sobre as M primeiras componentes principais, com refinamento L2
+  // exato nas coordenadas completas (--pca-sample limita as linhas usadas no ajuste)
+  uint32_t pcaDim = static_cast<uint32_t>(stoul(getOption(argc, argv, "pca", "0")));
+  uint64_t pcaSamples = stoull(getOption(argc, argv, "pca-sample", "100000"));
+  bool usePca = pcaDim > 0;
+  if (pcaDim > dimension) {
+    cerr << "Dimensão PCA inválida: " << pcaDim << " (use 1.." << dimension << ")" << endl;
+    return 1;
+  }
+  if (usePca && (quantized || !approxBudget.isExact())) {
+    cerr << "--pca não se combina com --precision nem com --approx-eps/--approx-leaves." << endl;
+    return 1;
+  }
+  uint32_t treeDim = usePca ? pcaDim : dimension;
+  // k-NN em lote: --knn-batch (lotes 1, 8, 64 e 256) ou --knn-batch=4,32,...
+  vector<size_t> knnBatchSizes;
+  if (hasOption(argc, argv, "knn-batch")) {
+    for (const string& b : splitOptionList(getOption(argc, argv, "knn-batch", "1,8,64,256"))) {
+      knnBatchSizes.push_back(max<size_t>(1, stoul(b)));
+    }
+  }
+  if (buildMode != "incremental" && buildMode != "str" && buildMode != "hilbert" && buildMode != "external" &&
+      buildMode != "parallel") {
+    cerr << "Modo de construção inválido: " << buildMode << " (use incremental, str, hilbert, external ou parallel)" << endl;
+    return 1;
+  }
+  // Threads do parsing do CSV e da construção paralela (auto = todos os núcleos)
+  unsigned buildThreads = resolveThreadCount(getOption(argc, argv, "build-threads", "auto"));
+  // Orçamento de memória da construção external (ordenação externa em blocos)
+  uint64_t memoryBudget;
+  try {
+    memoryBudget = parseByteSize(getOption(argc, argv, "memory-budget", "256MB"));
+  } catch (std::exception& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  if ((buildMode == "external" || buildMode == "parallel") && usePca) {
+    cerr << "--pca não se combina com --build=external nem com --build=parallel." << endl;
+    return 1;
+  }
   
   // Nomes de arquivos dinâmicos baseados no dataset
   string baseName = "rtree_index_" + datasetName;      
+  // Índices em precisão reduzida ficam ao lado do original, que continua sendo a referência
+  if (quantized) baseName += "_" + coordPrecisionName(precision);
+  if (usePca) baseName += "_pca" + to_string(pcaDim);
   
   // Cria diretório de resultados se não existir
   if (!fs::exists("results")) {
@@ -166,128 +1436,579 @@ int main(int argc, char** argv) {
   string resultsFile = "results/benchmark_" + datasetName + ".csv";
   // --------------------------------
 
-  IStorageManager* storage = nullptr;
+  // Modo varredura: constrói e mede um índice por combinação de parâmetros e encerra
+  if (hasOption(argc, argv, "sweep")) {
+    vector<TreeParams> configs;
+    try {
+      configs = expandParameterSweep(argc, argv, params, buildMode);
+    } catch (std::exception& e) {
+      cerr << "Lista de parâmetros inválida: " << e.what() << endl;
+      return 1;
+    }
+    vector<vector<double>> knnQueries, rangeQueries;
+    prepareQueries(argc, argv, datasetPath, datasetName, dimension, useBinary, ballShape, knnQueries, rangeQueries,
+                   rangeRadius);
+    runParameterSweep(configs, buildMode, datasetPath, datasetName, dimension, useBinary, knnQueries, rangeQueries,
+                      kNeighbors, rangeRadius, ballShape, hasOption(argc, argv, "sweep-keep"));
+    return 0;
+  }
+
+  // Modo orçamentos: construção external com cada --memory-budgets e encerra
+  if (hasOption(argc, argv, "memory-budgets")) {
+    vector<uint64_t> budgets;
+    try {
+      for (const string& b : splitOptionList(getOption(argc, argv, "memory-budgets", ""))) budgets.push_back(parseByteSize(b));
+    } catch (std::exception& e) {
+      cerr << e.what() << endl;
+      return 1;
+    }
+    runMemoryBudgetSweep(budgets, params, datasetPath, datasetName, dimension, useBinary, hasOption(argc, argv, "sweep-keep"));
+    return 0;
+  }
+
+  // Modo threads: construção parallel com cada contagem de --build-threads-sweep e encerra
+  if (hasOption(argc, argv, "build-threads-sweep")) {
+    vector<unsigned> threadCounts;
+    for (const string& t : splitOptionList(getOption(argc, argv, "build-threads-sweep", ""))) {
+      threadCounts.push_back(resolveThreadCount(t));
+    }
+    runThreadSweep(threadCounts, params, datasetPath, datasetName, dimension, useBinary, hasOption(argc, argv, "sweep-keep"));
+    return 0;
+  }
+
+  IStorageManager* diskStorage = nullptr; // DiskStorageManager
+  QuantizingStorageManager* quantStorage = nullptr; // Recodifica os nós em float32/int8 (--precision)
+  PageCache* pageCache = nullptr;          // Buffer de páginas opcional sobre o disco
+  CountingStorageManager* readCounter = nullptr; // Conta as páginas lidas pela árvore
+  IStorageManager* storage = nullptr;      // Topo da pilha de storage usado pela árvore
   ISpatialIndex* tree = nullptr;
+  PcaProjection pca;                       // Projeção do índice reduzido (--pca)
   id_type indexIdentifier = 1;
   double buildTime = 0;
 
+  // Alocações por fase (construção/carga, preparação, k-NN, Range), para o resumo final
+  vector<pair<string, AllocSnapshot>> allocPhases;
+  AllocSnapshot phaseStart = allocSnapshot();
+  auto closePhase = [&](const string& phase) {
+    AllocSnapshot now = allocSnapshot();
+    allocPhases.push_back({phase, allocDelta(phaseStart, now)});
+    phaseStart = now;
+  };
+
+  // Passar --build explicitamente força a reconstrução do índice com o modo escolhido
+  if (hasOption(argc, argv, "build") && fs::exists(baseName + ".idx")) {
+    cout << "Removendo índice existente para reconstrução (modo " << buildMode << ")..." << endl;
+    fs::remove(baseName + ".idx");
+    fs::remove(baseName + ".dat");
+  }
+
   // --- CARREGAMENTO / CONSTRUÇÃO DO ÍNDICE ---
   if (!fs::exists(baseName + ".idx")) {
-    cout << "Índice não encontrado. Construindo nova R*-Tree..." << endl;
+    cout << "Índice não encontrado. Construindo nova R*-Tree (modo " << buildMode << ")..." << endl;
+    resetPeakResidentMemory();
     auto startBuild = chrono::high_resolution_clock::now();
     
     // Cria gerenciador de armazenamento em disco
-    storage = StorageManager::createNewDiskStorageManager(baseName, 4096);
-    // Cria a R-Tree (RSTAR variant)
-    tree = RTree::createNewRTree(*storage, 0.7, 100, 10, dimension, RTree::RV_RSTAR, indexIdentifier);
-    
-    ifstream infile(datasetPath);
-    string line; id_type id = 0;
-    
-    // Lê o dataset e insere ponto a ponto
-    while (getline(infile, line)) {
-      stringstream ss(line); string val; vector<double> coords;
-      while (getline(ss, val, ',')) coords.push_back(stod(val));
-      
-      if (coords.size() == dimension) {
-        Point p(coords.data(), dimension);
-        // Insere dados: (payload size, payload ptr, shape, object ID)
-        tree->insertData(0, nullptr, p, id++);
+    diskStorage = StorageManager::createNewDiskStorageManager(baseName, params.pageSize);
+    if (quantized) {
+      // Mínimo/escala por dimensão do int8, gravados em <índice>.quant para as próximas cargas
+      ScalarQuantizer quantizer;
+      if (precision == CoordPrecision::Int8) {
+        Dataset data;
+        openDatasetOrExit(data, datasetPath, dimension, useBinary);
+        quantizer = ScalarQuantizer::fromDataset(data);
+        quantizer.save(baseName + ".quant");
+      }
+      quantStorage = new QuantizingStorageManager(*diskStorage, dimension, precision, quantizer);
+    }
+    if (usePca) {
+      // O ajuste entra no tempo de construção; a projeção fica em <índice>.pca para as próximas cargas
+      Dataset data;
+      openDatasetOrExit(data, datasetPath, dimension, useBinary);
+      try {
+        pca = PcaProjection::fit(data, pcaDim, pcaSamples);
+      } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
       }
+      pca.save(baseName + ".pca");
+      cout << "PCA ajustado: " << pcaDim << " de " << dimension << " dimensões, "
+           << 100.0 * pca.explainedVariance() << "% da variância" << endl;
+    }
+    storage = buildStorageStack(quantStorage ? quantStorage : diskStorage, cacheConfig, pageCache, readCounter);
+
+    try {
+      tree = buildTree(buildMode, *storage, params, datasetPath, dimension, useBinary, indexIdentifier,
+                       usePca ? &pca : nullptr, memoryBudget, buildThreads);
+    } catch (Tools::Exception& e) {
+      cerr << "Construção recusada pela biblioteca (" << treeParamsTag(params, buildMode) << "): " << e.what() << endl;
+      return 1;
     }
+
+    // Garante que cabeçalho e páginas estejam no disco antes de medir o tamanho
+    tree->flush();
+    storage->flush();
     
     auto endBuild = chrono::high_resolution_clock::now();
     buildTime = chrono::duration<double>(endBuild - startBuild).count();
-    cout << "Construção finalizada." << endl;
+    cout << "Construção finalizada (pico de RSS " << getPeakResidentMemoryMB() << " MB)." << endl;
+
+    recordBuild(tree, baseName, datasetName, buildMode, buildTime, params.indexCapacity, params.leafCapacity);
   } else {
     cout << "Carregando R*-Tree existente do disco..." << endl;
-    storage = StorageManager::loadDiskStorageManager(baseName);
+    diskStorage = StorageManager::loadDiskStorageManager(baseName);
+    if (quantized) {
+      ScalarQuantizer quantizer;
+      if (precision == CoordPrecision::Int8) {
+        try {
+          quantizer = ScalarQuantizer::load(baseName + ".quant", dimension);
+        } catch (std::exception& e) {
+          cerr << e.what() << " (reconstrua com --build)" << endl;
+          return 1;
+        }
+      }
+      quantStorage = new QuantizingStorageManager(*diskStorage, dimension, precision, quantizer);
+    }
+    if (usePca) {
+      try {
+        pca = PcaProjection::load(baseName + ".pca", dimension, pcaDim);
+      } catch (std::exception& e) {
+        cerr << e.what() << " (reconstrua com --build)" << endl;
+        return 1;
+      }
+    }
+    storage = buildStorageStack(quantStorage ? quantStorage : diskStorage, cacheConfig, pageCache, readCounter);
     tree = RTree::loadRTree(*storage, indexIdentifier);
   }
+  closePhase(buildTime > 0 ? "Construcao" : "Carga");
 
   // --- PREPARAÇÃO DAS CONSULTAS ---
-  generateQueryFiles(datasetPath, datasetName, dimension);
-  
-  string knnPath = "queries/" + datasetName + "_knn.csv";
-  string rangePath = "queries/" + datasetName + "_range.csv";
-
-  // Carrega queries k-NN
-  vector<vector<double>> knnQueries;
-  ifstream knnFile(knnPath);
-  string qline;
-  while(getline(knnFile, qline)){
-    stringstream ss(qline); string val; vector<double> coords;
-    while(getline(ss, val, ',')) coords.push_back(stod(val));
-    if (coords.size() == dimension) knnQueries.push_back(coords);
-  }
+  // Carrega queries k-NN e Range (binário se houver .bin irmão, senão CSV), do conjunto
+  // padrão ou de um conjunto calibrado
+  vector<vector<double>> knnQueries, rangeQueries;
+  string querySet = prepareQueries(argc, argv, datasetPath, datasetName, dimension, useBinary, ballShape, knnQueries,
+                                   rangeQueries, rangeRadius);
 
-  // Carrega queries Range
-  vector<vector<double>> rangeQueries;
-  ifstream rangeFile(rangePath);
-  while(getline(rangeFile, qline)){
-    stringstream ss(qline); string val; vector<double> coords;
-    while(getline(ss, val, ',')) coords.push_back(stod(val));
-    if (coords.size() == dimension) rangeQueries.push_back(coords);
+  // Coordenadas completas para o refinamento exato dos candidatos do índice quantizado/PCA
+  Dataset exactData;
+  const Dataset* exactRows = nullptr;
+  if (quantized || usePca) {
+    openDatasetOrExit(exactData, datasetPath, dimension, useBinary);
+    exactRows = &exactData;
   }
+  double approxRecallSum = 0;  // Recall do top-k da árvore antes da reordenação
+  // Query projetada (--pca), reaproveitada entre consultas. A bola reduzida ganha uma folga
+  // relativa mínima para que o arredondamento da projeção não descarte pontos na borda.
+  vector<double> reducedQuery(treeDim);
+  double treeRadius = usePca ? rangeRadius * (1 + 1e-9) : rangeRadius;
 
   // --- EXECUÇÃO DAS CONSULTAS ---
   ofstream log(resultsFile);
-  log << "Query_ID,Tipo,K_ou_Raio,Tempo_ms,Paginas_Lidas,RAM_MB,Resultados_Encontrados\n";
+  log << "Query_ID,Tipo,K_ou_Raio,Tempo_ms,Paginas_Lidas,RAM_MB,Resultados_Encontrados,Buffer_Hits,Buffer_Misses,Buffer_Evictions,Alocacoes,Bytes_Alocados,Candidatos,Recall_Sem_Rerank"
+      << ",Nos_Internos,Nos_Folha,Nos_por_Nivel,Eficiencia_Poda,Sobreposicao_Media,Espaco_Morto_Medio"
+      << ",Repeticoes,Tempo_ms_Mediana,Tempo_ms_Desvio,IC95_Inf_ms,IC95_Sup_ms,Cache"
+      << ",Ciclos,Instrucoes,IPC,LLC_Misses,Branch_Misses,DTLB_Misses\n";
+
+  // Travessia por consulta: reaproveitado entre as consultas (sem alocação no modo padrão).
+  // Os caminhos que não usam o visitor (k-NN reordenado/aproximado) ficam com contagens zeradas.
+  TraversalTrace trace;
+  trace.geometry = traceEnabled;
+  string traceFile = "results/trace_" + datasetName + ".jsonl";
+  ofstream traceLog;
+  if (traceEnabled) traceLog.open(traceFile);
+
+  // Contadores acumulados do buffer de páginas (zeros se desativado)
+  auto cacheCounters = [&]() { return pageCache ? pageCache->getCounters() : PageCacheCounters(); };
+
+  // Execução de uma consulta sem medição, compartilhada pelo aquecimento e pelas repetições
+  auto executeKnn = [&](size_t i, BenchmarkVisitor& visitor, double& approxRecall) {
+    const vector<double>& qCoords = knnQueries[i];
+    approxRecall = 1.0;
+    if (quantized || usePca) {
+      // Candidatos pelo limite inferior (caixas quantizadas ou distância no espaço PCA),
+      // reordenados com as coordenadas completas
+      if (usePca) pca.project(qCoords.data(), reducedQuery.data());
+      const double* treeQuery = usePca ? reducedQuery.data() : qCoords.data();
+      RerankedKnn knn = rerankedNearestNeighbors(*tree, treeQuery, treeDim, qCoords.data(), kNeighbors, exactData);
+      visitor.resultCount = static_cast<uint32_t>(knn.neighbors.size());
+      visitor.candidates = static_cast<uint32_t>(knn.candidates);
+      size_t hits = 0;
+      for (id_type id : knn.approximateIds) {
+        for (const auto& n : knn.neighbors) hits += (n.second == id);
+      }
+      approxRecall = knn.neighbors.empty() ? 1.0 : (double)hits / knn.neighbors.size();
+    } else if (!approxBudget.isExact()) {
+      BatchKnnStrategy knn = batchNearestNeighbors(*tree, knnQueries, i, i + 1, dimension, kNeighbors, approxBudget);
+      visitor.resultCount = static_cast<uint32_t>(knn.results(0).size());
+    } else {
+      Point queryPoint(qCoords.data(), dimension);
+      tree->nearestNeighborQuery(kNeighbors, queryPoint, visitor);
+    }
+  };
+  auto executeRange = [&](const vector<double>& qCoords, BenchmarkVisitor& visitor) {
+    if (usePca) pca.project(qCoords.data(), reducedQuery.data());
+    runRangeQuery(*tree, usePca ? reducedQuery : qCoords, treeRadius, treeDim, ballShape, visitor);
+  };
+
+  // Cache frio: antes de cada repetição os arquivos do índice saem do page cache do SO
+  // (e o buffer de páginas é esvaziado). As páginas sujas precisam estar gravadas.
+  bool coldDropOk = true;
+  auto dropIndexCache = [&]() {
+    coldDropOk &= dropFileFromPageCache(baseName + ".idx");
+    coldDropOk &= dropFileFromPageCache(baseName + ".dat");
+    if (pageCache) pageCache->clear();
+  };
+  if (coldCache) {
+    tree->flush();
+    storage->flush();
+  }
+
+  // Aquecimento, k-NN e Range rodam com a thread fixada no núcleo escolhido
+  unique_ptr<ScopedCpuPin> cpuPin;
+  if (pinCpu >= 0) {
+    cpuPin.reset(new ScopedCpuPin(pinCpu));
+    if (!cpuPin->active()) cerr << "Aviso: não foi possível fixar a thread na CPU " << pinCpu << endl;
+  }
+
+  // Aquecimento: passadas completas sobre as consultas, sem registro
+  for (unsigned w = 0; w < warmupPasses; w++) {
+    for (size_t i = 0; i < knnQueries.size(); i++) {
+      BenchmarkVisitor visitor(knnQueries[i].data(), rangeRadius, dimension, false);
+      double ignored;
+      executeKnn(i, visitor, ignored);
+    }
+    for (const auto& qCoords : rangeQueries) {
+      BenchmarkVisitor visitor(qCoords.data(), rangeRadius, dimension, true, exactRows);
+      executeRange(qCoords, visitor);
+    }
+  }
+  if (warmupPasses > 0) cout << "Aquecimento: " << warmupPasses << " passada(s) sobre todas as consultas" << endl;
+
+  // Contadores de hardware da thread de medição (colunas vazias se o perf não for permitido)
+  PerfCounters perf;
+  PerfSample knnPerf, rangePerf;
+  cout << "Contadores de hardware: " << perf.describe() << endl;
 
-  cout << "Executando " << knnQueries.size() << " k-NN queries..." << endl;
+  // Tempos das repetições da consulta atual e médias por consulta (base do resumo por tipo)
+  vector<double> repetitionMs(repetitions);
+  vector<double> knnMeans, rangeMeans;
+  uint64_t knnPages = 0, knnResults = 0;
+  const string cacheMode = coldCache ? "frio" : "quente";
+  closePhase("Preparacao");
+
+  cout << "Executando " << knnQueries.size() << " k-NN queries";
+  if (repetitions > 1) cout << " (" << repetitions << " repetições cada)";
+  cout << "..." << endl;
 
   int queryId = 0;
 
-  // 1. Executa k-NN
-  for (const auto& qCoords : knnQueries) {
-    BenchmarkVisitor visitor(qCoords.data(), rangeRadius, dimension, false); // isRange = false
-    
-    IStatistics* statsPre; tree->getStatistics(&statsPre);
-    uint64_t readsPre = statsPre->getReads();
+  // 1. Executa k-NN. Contadores e rastreamento vêm da última repetição.
+  for (size_t i = 0; i < knnQueries.size(); i++) {
+    uint64_t pages = 0;
+    PageCacheCounters cacheDelta;
+    AllocSnapshot allocs;
+    PerfSample counters;
+    uint32_t resultCount = 0, candidates = 0;
+    double approxRecall = 1.0;
+    for (unsigned r = 0; r < repetitions; r++) {
+      if (coldCache) dropIndexCache();
+      BenchmarkVisitor visitor(knnQueries[i].data(), rangeRadius, dimension, false); // isRange = false
+      trace.reset();
+      visitor.trace = &trace;
 
-    auto startQuery = chrono::high_resolution_clock::now();
-    Point queryPoint(qCoords.data(), dimension);
-    tree->nearestNeighborQuery(kNeighbors, queryPoint, visitor);
-    auto endQuery = chrono::high_resolution_clock::now();
-    
-    IStatistics* statsPost; tree->getStatistics(&statsPost);
+      // Instantâneos sem alocação: contador de leituras do storage e contadores de alocação
+      uint64_t readsPre = readCounter->reads();
+      PageCacheCounters cachePre = cacheCounters();
+      AllocSnapshot allocPre = allocSnapshot();
+      PerfSample perfPre = perf.read();
+
+      auto startQuery = chrono::high_resolution_clock::now();
+      executeKnn(i, visitor, approxRecall);
+      auto endQuery = chrono::high_resolution_clock::now();
+
+      counters = PerfCounters::delta(perfPre, perf.read());
+      allocs = allocDelta(allocPre, allocSnapshot());
+      repetitionMs[r] = chrono::duration<double, milli>(endQuery - startQuery).count();
+      pages = readCounter->reads() - readsPre;
+      PageCacheCounters cacheNow = cacheCounters();
+      cacheDelta.hits = cacheNow.hits - cachePre.hits;
+      cacheDelta.misses = cacheNow.misses - cachePre.misses;
+      cacheDelta.evictions = cacheNow.evictions - cachePre.evictions;
+      resultCount = visitor.resultCount;
+      candidates = visitor.candidates;
+    }
+    approxRecallSum += approxRecall;
+    TimingSummary timing = summarizeTimings(repetitionMs);
+    knnMeans.push_back(timing.mean);
+    knnPages += pages;
+    knnResults += resultCount;
+    knnPerf.add(counters);
 
     log << queryId++ << ",kNN," << kNeighbors << ","
-      << chrono::duration<double, milli>(endQuery - startQuery).count() << ","
-      << (statsPost->getReads() - readsPre) << ","
-      << getRAMUsageMB() << ","
-      << visitor.resultCount << "\n";
+      << timing.mean << ","
+      << pages << ","
+      << getResidentMemoryMB() << ","
+      << resultCount << ","
+      << cacheDelta.hits << ","
+      << cacheDelta.misses << ","
+      << cacheDelta.evictions << ","
+      << allocs.count << "," << allocs.bytes << "," << candidates << "," << approxRecall << ",";
+    writeTraceColumns(log, trace);
+    log << ",";
+    writeTimingColumns(log, timing, cacheMode);
+    log << ",";
+    writePerfColumns(log, counters);
+    log << "\n";
+    if (traceEnabled) trace.writeJson(traceLog, queryId - 1, "kNN", kNeighbors, candidates, resultCount);
   }
 
-  cout << "Executando " << rangeQueries.size() << " Range queries..." << endl;
+  closePhase("kNN");
+
+  cout << "Executando " << rangeQueries.size() << " Range queries";
+  if (repetitions > 1) cout << " (" << repetitions << " repetições cada)";
+  cout << "..." << endl;
 
-  // 2. Executa Range
+  // 2. Executa Range. Contadores e rastreamento vêm da última repetição.
+  RangeShapeTotals rangeTotals;
+  uint64_t rangeInternalNodes = 0, rangeLeafNodes = 0;
   for (const auto& qCoords : rangeQueries) {
-    BenchmarkVisitor visitor(qCoords.data(), rangeRadius, dimension, true); // isRange = true
-    
-    IStatistics* statsPre; tree->getStatistics(&statsPre);
-    uint64_t readsPre = statsPre->getReads();
+    uint64_t pages = 0;
+    PageCacheCounters cacheDelta;
+    AllocSnapshot allocs;
+    PerfSample counters;
+    uint32_t resultCount = 0, candidates = 0;
+    for (unsigned r = 0; r < repetitions; r++) {
+      if (coldCache) dropIndexCache();
+      BenchmarkVisitor visitor(qCoords.data(), rangeRadius, dimension, true, exactRows); // isRange = true
+      trace.reset();
+      visitor.trace = &trace;
 
-    auto startQuery = chrono::high_resolution_clock::now();
-    
-    double low[32], high[32]; // Assumindo max dim 32, mas ideal seria vetor dinâmico se dim for maior
-    vector<double> lowV(dimension), highV(dimension);
-    for(uint32_t d=0; d<dimension; d++) { 
-      lowV[d] = qCoords[d] - rangeRadius; 
-      highV[d] = qCoords[d] + rangeRadius; 
-    }
-    Region queryRegion(lowV.data(), highV.data(), dimension);
-    tree->intersectsWithQuery(queryRegion, visitor);
-    
-    auto endQuery = chrono::high_resolution_clock::now();
-    
-    IStatistics* statsPost; tree->getStatistics(&statsPost);
+      // Instantâneos sem alocação: contador de leituras do storage e contadores de alocação
+      uint64_t readsPre = readCounter->reads();
+      PageCacheCounters cachePre = cacheCounters();
+      AllocSnapshot allocPre = allocSnapshot();
+      PerfSample perfPre = perf.read();
+
+      auto startQuery = chrono::high_resolution_clock::now();
+      executeRange(qCoords, visitor);
+      auto endQuery = chrono::high_resolution_clock::now();
+
+      counters = PerfCounters::delta(perfPre, perf.read());
+      allocs = allocDelta(allocPre, allocSnapshot());
+      repetitionMs[r] = chrono::duration<double, milli>(endQuery - startQuery).count();
+      pages = readCounter->reads() - readsPre;
+      PageCacheCounters cacheNow = cacheCounters();
+      cacheDelta.hits = cacheNow.hits - cachePre.hits;
+      cacheDelta.misses = cacheNow.misses - cachePre.misses;
+      cacheDelta.evictions = cacheNow.evictions - cachePre.evictions;
+      resultCount = visitor.resultCount;
+      candidates = visitor.candidates;
+    }
+    TimingSummary timing = summarizeTimings(repetitionMs);
+    rangeMeans.push_back(timing.mean);
+    rangeTotals.add(pages, candidates, resultCount, timing.mean);
+    rangePerf.add(counters);
 
     log << queryId++ << ",Range," << rangeRadius << ","
-      << chrono::duration<double, milli>(endQuery - startQuery).count() << ","
-      << (statsPost->getReads() - readsPre) << ","
-      << getRAMUsageMB() << ","
-      << visitor.resultCount << "\n";
+      << timing.mean << ","
+      << pages << ","
+      << getResidentMemoryMB() << ","
+      << resultCount << ","
+      << cacheDelta.hits << ","
+      << cacheDelta.misses << ","
+      << cacheDelta.evictions << ","
+      << allocs.count << "," << allocs.bytes << "," << candidates << ",1,";
+    writeTraceColumns(log, trace);
+    log << ",";
+    writeTimingColumns(log, timing, cacheMode);
+    log << ",";
+    writePerfColumns(log, counters);
+    log << "\n";
+    if (traceEnabled) trace.writeJson(traceLog, queryId - 1, "Range", rangeRadius, candidates, resultCount);
+    rangeInternalNodes += trace.internalNodes();
+    rangeLeafNodes += trace.leafNodes();
+  }
+
+  closePhase("Range");
+  cpuPin.reset();
+  if (coldCache && !coldDropOk) {
+    cerr << "Aviso: posix_fadvise(DONTNEED) falhou em algum arquivo do índice; as execuções podem não ter sido frias" << endl;
+  }
+
+  // Resumo por tipo: linhas "resumo" no fim do CSV de resultados e histórico em
+  // results/resumo_<dataset>.csv (uma linha por execução e tipo, para comparar variantes)
+  string summaryFile = "results/resumo_" + datasetName + ".csv";
+  bool newSummary = !fs::exists(summaryFile);
+  ofstream summaryLog(summaryFile, ios::app);
+  if (newSummary) {
+    summaryLog << "Indice,Modo,Cache,Tipo,K_ou_Raio,Consultas,Repeticoes,Aquecimento,CPU,Tempo_ms_Media,Tempo_ms_Mediana,"
+                  "Tempo_ms_Desvio,IC95_Inf_ms,IC95_Sup_ms,Tempo_ms_Min,Tempo_ms_Max,Paginas_Media,Resultados_Media\n";
+  }
+  string runMode = buildTime > 0 ? buildMode : "carregado";
+  // Conjunto calibrado: results/seletividade.csv junta todos os datasets, para comparar
+  // latências com o mesmo número de resultados por consulta
+  string selectivityFile = "results/seletividade.csv";
+  ofstream selectivityLog;
+  QueryWorkloadInfo queryInfo;
+  if (!querySet.empty()) {
+    queryInfo = QueryWorkloadInfo::load(queryWorkloadPaths(datasetName, querySet).params);
+    bool newSelectivity = !fs::exists(selectivityFile);
+    selectivityLog.open(selectivityFile, ios::app);
+    if (newSelectivity) {
+      selectivityLog << "Dataset,Indice,Conjunto,Distribuicao,Seletividade_Alvo,Tipo,K_ou_Raio,Consultas,Resultados_Media,"
+                        "Tempo_ms_Media,Tempo_ms_Mediana,Tempo_ms_p99,Paginas_Media,us_por_Resultado\n";
+    }
+  }
+  cout << "\n--- RESUMO DAS CONSULTAS (" << repetitions << " repetição(ões), " << warmupPasses
+       << " passada(s) de aquecimento, cache " << cacheMode << ") ---" << endl;
+  for (int t = 0; t < 2; t++) {
+    const vector<double>& means = (t == 0) ? knnMeans : rangeMeans;
+    if (means.empty()) continue;
+    const string type = (t == 0) ? "kNN" : "Range";
+    double param = (t == 0) ? kNeighbors : rangeRadius;
+    double n = means.size();
+    double pages = (t == 0 ? knnPages : rangeTotals.pages) / n;
+    double results = (t == 0 ? knnResults : rangeTotals.results) / n;
+    TimingSummary timing = summarizeTimings(means);
+    // Contadores médios por consulta
+    PerfSample counters = (t == 0) ? knnPerf : rangePerf;
+    for (double& v : counters.values) v /= n;
+
+    // Mesmas colunas do CSV: apenas tempo, páginas, RAM, resultados, estatísticas e contadores preenchidos
+    log << "resumo," << type << "," << param << "," << timing.mean << "," << pages << "," << getResidentMemoryMB() << ","
+        << results << string(14, ',');
+    writeTimingColumns(log, timing, cacheMode);
+    log << ",";
+    writePerfColumns(log, counters);
+    log << "\n";
+    summaryLog << baseName << "," << runMode << "," << cacheMode << "," << type << "," << param << "," << means.size()
+               << "," << repetitions << "," << warmupPasses << "," << pinCpu << "," << timing.mean << "," << timing.median
+               << "," << timing.stddev << "," << timing.ciLow << "," << timing.ciHigh << "," << timing.min << ","
+               << timing.max << "," << pages << "," << results << "\n";
+    if (selectivityLog.is_open()) {
+      vector<double> sorted = means;
+      sort(sorted.begin(), sorted.end());
+      selectivityLog << datasetName << "," << baseName << "," << querySet << "," << queryInfo.distribution << ","
+                     << queryInfo.selectivity << "," << type << "," << param << "," << means.size() << "," << results
+                     << "," << timing.mean << "," << timing.median << "," << percentile(sorted, 99) << "," << pages
+                     << "," << (results > 0 ? timing.mean * 1000.0 / results : 0.0) << "\n";
+    }
+    cout << left << setw(6) << type << right << ": média " << timing.mean << " ms, mediana " << timing.median
+         << " ms, desvio " << timing.stddev << " ms, IC95 [" << timing.ciLow << ", " << timing.ciHigh << "] ms ("
+         << means.size() << " consultas)" << endl;
+    if (perf.available()) {
+      // Falhas por mil instruções (MPKI): IPC baixo com LLC/dTLB MPKI alto indica consulta limitada
+      // pela memória (decodificação dos nós); IPC alto com MPKI baixo, pelo laço de distância
+      double kiloInstructions = counters.values[PERF_INSTRUCTIONS] / 1000.0;
+      auto mpki = [&](int e) { return (counters.valid[e] && kiloInstructions > 0) ? counters.values[e] / kiloInstructions : 0.0; };
+      cout << "        " << counters.values[PERF_CYCLES] << " ciclos/consulta, IPC " << counters.ipc() << ", MPKI: LLC "
+           << mpki(PERF_LLC_MISSES) << ", branch " << mpki(PERF_BRANCH_MISSES) << ", dTLB " << mpki(PERF_DTLB_MISSES) << endl;
+    }
+  }
+  cout << "Resumo acumulado em " << summaryFile << endl;
+  if (selectivityLog.is_open()) cout << "Conjunto " << querySet << " acumulado em " << selectivityFile << endl;
+
+  // Onde vai o custo da Range: nós lidos por nível contra candidatos e resultados
+  if (!rangeQueries.empty()) {
+    double n = rangeQueries.size();
+    cout << "Travessia Range (média por consulta): " << rangeInternalNodes / n << " nós internos, "
+         << rangeLeafNodes / n << " folhas, " << (double)rangeTotals.candidates / n << " candidatos, "
+         << (double)rangeTotals.results / n << " resultados" << endl;
+  }
+  if (traceEnabled) cout << "Rastreamento por consulta salvo em " << traceFile << endl;
+
+  // Comparação bola x caixa: repete as Range Queries com a outra forma e compara páginas
+  // lidas e candidatos examinados (os resultados devem ser idênticos)
+  if (rangeCompare && !rangeQueries.empty()) {
+    RangeShapeTotals otherTotals;
+    for (const auto& qCoords : rangeQueries) {
+      BenchmarkVisitor visitor(qCoords.data(), rangeRadius, dimension, true, exactRows);
+      uint64_t readsPre = readCounter->reads();
+      auto startQuery = chrono::high_resolution_clock::now();
+      if (usePca) pca.project(qCoords.data(), reducedQuery.data());
+      runRangeQuery(*tree, usePca ? reducedQuery : qCoords, treeRadius, treeDim, !ballShape, visitor);
+      auto endQuery = chrono::high_resolution_clock::now();
+      otherTotals.add(readCounter->reads() - readsPre, visitor.candidates, visitor.resultCount,
+                      chrono::duration<double, milli>(endQuery - startQuery).count());
+    }
+
+    const RangeShapeTotals& box = ballShape ? otherTotals : rangeTotals;
+    const RangeShapeTotals& ball = ballShape ? rangeTotals : otherTotals;
+    string shapeFile = "results/range_forma_" + datasetName + ".csv";
+    ofstream shapeLog(shapeFile);
+    shapeLog << "Forma,Consultas,Paginas_Media,Candidatos_Media,Resultados_Media,Tempo_ms_Medio\n";
+    cout << "\n--- RANGE: CAIXA x BOLA (r=" << rangeRadius << ") ---" << endl;
+    cout << left << setw(8) << "Forma" << right << setw(12) << "Paginas" << setw(14) << "Candidatos"
+         << setw(12) << "Resultados" << setw(12) << "Tempo_ms" << endl;
+    for (int i = 0; i < 2; i++) {
+      const RangeShapeTotals& t = (i == 0) ? box : ball;
+      const char* name = (i == 0) ? "box" : "ball";
+      double n = max<size_t>(1, t.queries);
+      shapeLog << name << "," << t.queries << "," << t.pages / n << "," << t.candidates / n << ","
+               << t.results / n << "," << t.timeMs / n << "\n";
+      cout << left << setw(8) << name << right << setw(12) << t.pages / n << setw(14) << t.candidates / n
+           << setw(12) << t.results / n << setw(12) << t.timeMs / n << endl;
+    }
+    if (box.results != ball.results) {
+      cerr << "Aviso: caixa e bola retornaram totais diferentes (" << box.results << " x " << ball.results << ")" << endl;
+    }
+    cout << "Comparação salva em " << shapeFile << endl;
+  }
+
+  if (!knnBatchSizes.empty() && usePca) {
+    cout << "k-NN em lote ignorado: o índice PCA só responde consultas com refinamento exato." << endl;
+  } else if (!knnBatchSizes.empty() && !knnQueries.empty()) {
+    runBatchKnnBenchmark(*tree, *readCounter, datasetName, knnQueries, kNeighbors, rangeRadius, dimension, knnBatchSizes);
+  }
+
+  if (flatCompare && (quantized || usePca)) {
+    cout << "Motor em memória ignorado: ele lê as coordenadas em double das páginas, sem a camada de quantização/PCA." << endl;
+  } else if (flatCompare) {
+    // O motor lê as páginas direto do disco, que precisa estar atualizado
+    tree->flush();
+    storage->flush();
+    runFlatComparison(*tree, *diskStorage, indexIdentifier, datasetName, knnQueries, rangeQueries, kNeighbors,
+                      rangeRadius, dimension, ballShape, repetitions);
+  }
+
+  if (resultBufferCompare && (quantized || usePca)) {
+    cout << "Comparação de materialização ignorada: o buffer guarda distâncias das coordenadas gravadas no índice." << endl;
+  } else if (resultBufferCompare) {
+    tree->flush();
+    storage->flush();
+    runResultMaterialization(*tree, *diskStorage, indexIdentifier, datasetName, knnQueries, rangeQueries, kNeighbors,
+                             rangeRadius, dimension, ballShape, repetitions);
+  }
+
+  if (prefetchCompare && (quantized || usePca)) {
+    cout << "Prefetch ignorado: ele decodifica os nós direto das páginas em double, sem a camada de quantização/PCA." << endl;
+  } else if (prefetchCompare) {
+    // O storage de prefetch lê o mapa de páginas do .idx, gravado no flush
+    tree->flush();
+    storage->flush();
+    runPrefetchComparison(baseName, indexIdentifier, datasetName, knnQueries, rangeQueries, kNeighbors, rangeRadius,
+                          dimension, ballShape, prefetchBackend, prefetchDepth, prefetchLookahead);
+  }
+
+  if (mixedWorkload && (quantized || usePca)) {
+    cout << "Carga mista ignorada: as remoções precisam das coordenadas exatas gravadas no índice." << endl;
+  } else if (mixedWorkload) {
+    // A cópia do índice é feita a partir dos arquivos, que precisam estar atualizados
+    tree->flush();
+    storage->flush();
+    runMixedWorkload(baseName, indexIdentifier, params, datasetPath, datasetName, dimension, useBinary, workloadMix,
+                     workloadOps, workloadWindow, knnQueries, rangeQueries, kNeighbors, rangeRadius, ballShape);
+  }
+
+  // 3. Modo concorrente: replays das queries com 1, 2, 4, ... N threads
+  if (concurrency > 0 && (quantized || usePca)) {
+    cout << "Modo concorrente ignorado: os handles por thread abrem o índice sem a camada de quantização/PCA." << endl;
+  } else if (concurrency > 0) {
+    // Os handles por thread reabrem os arquivos do índice, que precisam estar atualizados
+    tree->flush();
+    storage->flush();
+    runConcurrencyBenchmark(baseName, indexIdentifier, datasetName, knnQueries, rangeQueries,
+                            kNeighbors, rangeRadius, dimension, ballShape, concurrency, concurrencyRepeat);
   }
 
   // --- RELATÓRIO FINAL ---
@@ -296,9 +2017,48 @@ int main(int argc, char** argv) {
   
   uintmax_t diskSize = fs::file_size(baseName + ".idx") + fs::file_size(baseName + ".dat");
   cout << "Tamanho da Árvore em Disco: " << diskSize / (1024.0 * 1024.0) << " MB" << endl;
+  if (quantized) {
+    cout << "Precisão do índice: " << coordPrecisionName(precision);
+    if (quantStorage->getLogicalBytes() > 0) {
+      cout << " (nós gravados com " << 100.0 * quantStorage->getStoredBytes() / quantStorage->getLogicalBytes()
+           << "% do tamanho em double)";
+    }
+    cout << endl;
+  }
+  if (usePca) {
+    cout << "Índice PCA: " << pcaDim << " de " << dimension << " dimensões ("
+         << 100.0 * pca.explainedVariance() << "% da variância)" << endl;
+  }
+  if ((quantized || usePca) && !knnQueries.empty()) {
+    cout << "Recall k-NN sem reordenação: " << approxRecallSum / knnQueries.size() << endl;
+  }
   cout << "Resultados salvos em " << resultsFile << endl;
 
-  delete tree; delete storage;
+  if (pageCache) {
+    const PageCacheCounters& c = pageCache->getCounters();
+    double hitRate = (c.hits + c.misses) > 0 ? (double)c.hits / (c.hits + c.misses) : 0.0;
+    cout << "Buffer de Páginas: " << c.hits << " hits, " << c.misses << " misses, " << c.evictions
+         << " evictions (hit rate " << hitRate * 100 << "%, " << pageCache->residentPages() << " páginas residentes)" << endl;
+  }
+
+  // Alocações por fase: com o caminho de consulta estável, kNN/Range devem ficar
+  // constantes por consulta entre execuções; crescimento aqui indica regressão.
+  string allocFile = "results/alocacoes_" + datasetName + ".csv";
+  ofstream allocLog(allocFile);
+  allocLog << "Fase,Alocacoes,Bytes_Alocados,Alocacoes_por_Consulta\n";
+  cout << "Alocações por fase:" << endl;
+  for (const auto& phase : allocPhases) {
+    size_t queries = phase.first == "kNN" ? knnQueries.size() : phase.first == "Range" ? rangeQueries.size() : 0;
+    double perQuery = queries > 0 ? (double)phase.second.count / queries : 0.0;
+    allocLog << phase.first << "," << phase.second.count << "," << phase.second.bytes << "," << perQuery << "\n";
+    cout << "  " << left << setw(12) << phase.first << right << setw(12) << phase.second.count << " alocações, "
+         << setw(10) << phase.second.bytes / (1024.0 * 1024.0) << " MB";
+    if (queries > 0) cout << " (" << perQuery << " por consulta)";
+    cout << endl;
+  }
+  cout << "Alocações salvas em " << allocFile << endl;
+
+  delete tree; delete readCounter; delete pageCache; delete quantStorage; delete diskStorage;
   log.close();
   return 0;
 }
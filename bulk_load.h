@@ -0,0 +1,239 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+
+#include "dataset_io.h"
+
+// --- Construção em Lote (Bulk Loading) ---
+// Inserir ponto a ponto com insertData dispara splits e reinserções da R* para
+// cada ponto. Aqui ficam os caminhos alternativos de construção:
+//  * STR (Sort-Tile-Recursive): usa o bulk loader da própria libspatialindex,
+//    alimentado por um stream que lê o dataset linha a linha.
+//  * Hilbert: ordena os pontos pela chave da curva de Hilbert; os nós são empacotados
+//    nessa ordem por PackedTreeWriter (packed_tree.h).
+
+// Stream de dados que lê o dataset CSV sob demanda (sem carregar tudo em memória).
+// Usado quando não existe a versão binária do dataset.
+// O bulk loader STR consome os objetos retornados por getNext() e os deleta.
+class CsvDataStream : public SpatialIndex::IDataStream {
+  public:
+    CsvDataStream(const std::string& path, uint32_t dim) : datasetPath(path), dimension(dim), file(path) {
+      readNext();
+    }
+
+    ~CsvDataStream() override { delete next; }
+
+    SpatialIndex::IData* getNext() override {
+      if (next == nullptr) return nullptr;
+      SpatialIndex::RTree::Data* ret = next;
+      next = nullptr;
+      readNext();
+      return ret;
+    }
+
+    bool hasNext() override { return next != nullptr; }
+
+    // Conta as linhas válidas em uma passada separada (usado apenas se o loader pedir).
+    uint32_t size() override {
+      std::ifstream counter(datasetPath);
+      std::string line; uint32_t count = 0;
+      while (getline(counter, line)) if (!line.empty()) count++;
+      return count;
+    }
+
+    void rewind() override {
+      delete next; next = nullptr;
+      file.clear();
+      file.seekg(0);
+      nextId = 0;
+      readNext();
+    }
+
+    uint64_t pointsRead() const { return nextId; }
+
+  private:
+    std::string datasetPath;
+    uint32_t dimension;
+    std::ifstream file;
+    SpatialIndex::RTree::Data* next = nullptr;
+    SpatialIndex::id_type nextId = 0;
+    std::vector<double> coords;
+
+    // Avança até a próxima linha com a dimensão correta, mantendo a numeração de IDs
+    // idêntica à da construção incremental (apenas linhas válidas recebem ID).
+    void readNext() {
+      std::string line;
+      while (getline(file, line)) {
+        if (parseCsvLine(line, coords) == dimension) {
+          SpatialIndex::Region r(coords.data(), coords.data(), dimension);
+          next = new SpatialIndex::RTree::Data(0, nullptr, r, nextId++);
+          return;
+        }
+      }
+    }
+};
+
+// Stream de dados sobre um Dataset já aberto (ex: binário via mmap), sem parsing.
+class DatasetDataStream : public SpatialIndex::IDataStream {
+  public:
+    explicit DatasetDataStream(const Dataset& d) : data(d), scratch(d.dimension()) {}
+
+    SpatialIndex::IData* getNext() override {
+      if (!hasNext()) return nullptr;
+      const double* coords = data.row(current, scratch.data());
+      SpatialIndex::Region r(coords, coords, data.dimension());
+      SpatialIndex::RTree::Data* ret = new SpatialIndex::RTree::Data(0, nullptr, r, static_cast<SpatialIndex::id_type>(current));
+      current++;
+      return ret;
+    }
+
+    bool hasNext() override { return current < data.size(); }
+    uint32_t size() override { return static_cast<uint32_t>(data.size()); }
+    void rewind() override { current = 0; }
+
+  private:
+    const Dataset& data;
+    std::vector<double> scratch;
+    uint64_t current = 0;
+};
+
+// Converte coordenadas já quantizadas (bitsPerDim bits cada) na chave de Hilbert,
+// usando o algoritmo de transposição de Skilling ("Programming the Hilbert curve", 2004).
+// A chave é devolvida como sequência de bytes big-endian, comparável com operator<.
+inline std::string hilbertKey(std::vector<uint32_t>& X, uint32_t bitsPerDim) {
+  const size_t n = X.size();
+  uint32_t M = 1u << (bitsPerDim - 1);
+
+  // Desfaz a rotação/reflexão de cada sub-cubo
+  for (uint32_t Q = M; Q > 1; Q >>= 1) {
+    uint32_t P = Q - 1;
+    for (size_t i = 0; i < n; i++) {
+      if (X[i] & Q) {
+        X[0] ^= P;
+      } else {
+        uint32_t t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+
+  // Codificação Gray
+  for (size_t i = 1; i < n; i++) X[i] ^= X[i - 1];
+  uint32_t t = 0;
+  for (uint32_t Q = M; Q > 1; Q >>= 1) {
+    if (X[n - 1] & Q) t ^= Q - 1;
+  }
+  for (size_t i = 0; i < n; i++) X[i] ^= t;
+
+  // Intercala os bits (do mais significativo para o menos) na chave final
+  std::string key((n * bitsPerDim + 7) / 8, '\0');
+  size_t bitPos = 0;
+  for (int b = bitsPerDim - 1; b >= 0; b--) {
+    for (size_t i = 0; i < n; i++, bitPos++) {
+      if ((X[i] >> b) & 1u) key[bitPos / 8] |= static_cast<char>(0x80u >> (bitPos % 8));
+    }
+  }
+  return key;
+}
+
+// Calcula a ordem de Hilbert de n pontos de dim dimensões; row(p) devolve as coordenadas do
+// ponto p (válidas até a próxima chamada). Cada dimensão é normalizada pelo seu min/max e
+// quantizada em bitsPerDim bits.
+template <class RowFn>
+std::vector<uint64_t> hilbertOrder(size_t n, uint32_t dim, uint32_t bitsPerDim, RowFn&& row) {
+  std::vector<double> mins(dim, 0.0), maxs(dim, 0.0);
+  for (size_t p = 0; p < n; p++) {
+    const double* point = row(p);
+    for (uint32_t d = 0; d < dim; d++) {
+      double v = point[d];
+      if (p == 0 || v < mins[d]) mins[d] = v;
+      if (p == 0 || v > maxs[d]) maxs[d] = v;
+    }
+  }
+
+  const double cells = static_cast<double>((1u << bitsPerDim) - 1);
+  std::vector<std::string> keys(n);
+  std::vector<uint32_t> X(dim);
+  for (size_t p = 0; p < n; p++) {
+    const double* point = row(p);
+    for (uint32_t d = 0; d < dim; d++) {
+      double span = maxs[d] - mins[d];
+      double norm = (span > 0) ? (point[d] - mins[d]) / span : 0.0;
+      X[d] = static_cast<uint32_t>(norm * cells);
+    }
+    keys[p] = hilbertKey(X, bitsPerDim);
+  }
+
+  std::vector<uint64_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) { return keys[a] < keys[b]; });
+  return order;
+}
+
+// Ordem de Hilbert das linhas de um dataset, nas coordenadas originais
+inline std::vector<uint64_t> hilbertOrder(const Dataset& data, uint32_t bitsPerDim) {
+  std::vector<double> scratch(data.dimension());
+  return hilbertOrder(data.size(), data.dimension(), bitsPerDim,
+                      [&](size_t p) { return data.row(p, scratch.data()); });
+}
+
+// --- Estatísticas de Forma da Árvore ---
+// Percorre todos os nós (BFS) via queryStrategy e conta nós e entradas por nível,
+// para medir a ocupação real dos nós após a construção.
+class TreeShapeStrategy : public SpatialIndex::IQueryStrategy {
+  public:
+    std::vector<uint64_t> nodesPerLevel;
+    std::vector<uint64_t> entriesPerLevel;
+
+    void getNextEntry(const SpatialIndex::IEntry& entry, SpatialIndex::id_type& nextEntry, bool& hasNext) override {
+      const SpatialIndex::INode* n = dynamic_cast<const SpatialIndex::INode*>(&entry);
+      if (n != nullptr) {
+        uint32_t level = n->getLevel();
+        if (level >= nodesPerLevel.size()) {
+          nodesPerLevel.resize(level + 1, 0);
+          entriesPerLevel.resize(level + 1, 0);
+        }
+        nodesPerLevel[level]++;
+        entriesPerLevel[level] += n->getChildrenCount();
+        if (!n->isLeaf()) {
+          for (uint32_t c = 0; c < n->getChildrenCount(); c++) pending.push(n->getChildIdentifier(c));
+        }
+      }
+
+      if (pending.empty()) {
+        hasNext = false;
+      } else {
+        nextEntry = pending.front();
+        pending.pop();
+        hasNext = true;
+      }
+    }
+
+    uint64_t totalNodes() const { return std::accumulate(nodesPerLevel.begin(), nodesPerLevel.end(), uint64_t(0)); }
+    uint32_t height() const { return static_cast<uint32_t>(nodesPerLevel.size()); }
+
+    // Ocupação média das folhas (entradas / capacidade)
+    double leafFill(uint32_t leafCapacity) const {
+      if (nodesPerLevel.empty() || nodesPerLevel[0] == 0) return 0.0;
+      return static_cast<double>(entriesPerLevel[0]) / (nodesPerLevel[0] * leafCapacity);
+    }
+
+    // Ocupação média dos nós internos (entradas / capacidade)
+    double indexFill(uint32_t indexCapacity) const {
+      uint64_t nodes = 0, entries = 0;
+      for (size_t l = 1; l < nodesPerLevel.size(); l++) { nodes += nodesPerLevel[l]; entries += entriesPerLevel[l]; }
+      if (nodes == 0) return 0.0;
+      return static_cast<double>(entries) / (nodes * indexCapacity);
+    }
+
+  private:
+    std::queue<SpatialIndex::id_type> pending;
+};
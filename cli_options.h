@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+// --- Opções de Linha de Comando ---
+// Os argumentos posicionais (<caminho_dataset> <dimensao>) continuam obrigatórios;
+// as opções extras são passadas no formato --nome=valor ou apenas --nome.
+
+// Retorna o valor de --nome=valor, ou o valor padrão se a opção não foi passada.
+inline std::string getOption(int argc, char** argv, const std::string& name, const std::string& defaultValue) {
+  std::string prefix = "--" + name + "=";
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], prefix.c_str(), prefix.size()) == 0) return std::string(argv[i] + prefix.size());
+  }
+  return defaultValue;
+}
+
+// Verifica se a opção --nome (ou --nome=...) foi passada.
+inline bool hasOption(int argc, char** argv, const std::string& name) {
+  std::string flag = "--" + name;
+  for (int i = 1; i < argc; ++i) {
+    if (flag == argv[i] || strncmp(argv[i], (flag + "=").c_str(), flag.size() + 1) == 0) return true;
+  }
+  return false;
+}
+
+// Separa uma opção em lista ("4096,8192" -> {"4096", "8192"}), ignorando itens vazios.
+inline std::vector<std::string> splitOptionList(const std::string& value) {
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= value.size()) {
+    size_t end = value.find(',', start);
+    if (end == std::string::npos) end = value.size();
+    if (end > start) items.push_back(value.substr(start, end - start));
+    start = end + 1;
+  }
+  return items;
+}
+
+// Interpreta um tamanho em bytes: "<n>KB", "<n>MB" (padrão sem unidade) ou "<n>GB".
+inline uint64_t parseByteSize(const std::string& size) {
+  size_t pos = 0;
+  double value = std::stod(size, &pos);
+  std::string unit = size.substr(pos);
+  if (unit == "KB") return static_cast<uint64_t>(value * 1024);
+  if (unit == "MB" || unit.empty()) return static_cast<uint64_t>(value * 1024 * 1024);
+  if (unit == "GB") return static_cast<uint64_t>(value * 1024 * 1024 * 1024);
+  throw std::invalid_argument("Tamanho inválido: " + size + " (ex: 256MB, 2GB)");
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+// --- Execução Concorrente de Consultas ---
+// Nem a RTree nem o DiskStorageManager da libspatialindex são seguros para uso
+// concorrente (buffers de página e estatísticas compartilhados). Por isso cada worker
+// recebe o seu próprio handle somente-leitura (storage + árvore abertos sobre os mesmos
+// arquivos). Os handles são abertos e destruídos pela thread principal, fora da região
+// medida, porque o destrutor regrava o cabeçalho/índice de páginas em disco.
+
+struct TreeHandle {
+  SpatialIndex::IStorageManager* storage = nullptr;
+  SpatialIndex::ISpatialIndex* tree = nullptr;
+};
+
+inline TreeHandle openTreeHandle(std::string baseName, SpatialIndex::id_type indexIdentifier) {
+  TreeHandle h;
+  h.storage = SpatialIndex::StorageManager::loadDiskStorageManager(baseName);
+  h.tree = SpatialIndex::RTree::loadRTree(*h.storage, indexIdentifier);
+  return h;
+}
+
+inline void closeTreeHandle(TreeHandle& h) {
+  delete h.tree; delete h.storage;
+  h.tree = nullptr; h.storage = nullptr;
+}
+
+// Percentil p (0-100) de um vetor já ordenado (interpolação linear)
+inline double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  double rank = (p / 100.0) * (sorted.size() - 1);
+  size_t lo = static_cast<size_t>(std::floor(rank));
+  size_t hi = std::min(sorted.size() - 1, lo + 1);
+  return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+struct ConcurrencyResult {
+  unsigned threads = 0;
+  size_t queries = 0;
+  double wallSeconds = 0;
+  double qps = 0;
+  double p50 = 0, p95 = 0, p99 = 0, maxMs = 0;
+};
+
+// Executa "repeat" vezes a lista de queries com "threads" workers, distribuindo as queries
+// por um contador atômico. runQuery(tree, queryCoords) executa uma consulta no handle da thread.
+template <class RunQuery>
+ConcurrencyResult runConcurrentQueries(const std::string& baseName, SpatialIndex::id_type indexIdentifier,
+                                       const std::vector<std::vector<double>>& queries, unsigned threads,
+                                       unsigned repeat, RunQuery runQuery) {
+  std::vector<TreeHandle> handles;
+  for (unsigned t = 0; t < threads; t++) handles.push_back(openTreeHandle(baseName, indexIdentifier));
+
+  size_t total = queries.size() * repeat;
+  std::vector<std::vector<double>> latencies(threads);
+  std::atomic<size_t> next(0);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++) {
+    pool.emplace_back([&, t]() {
+      latencies[t].reserve(total / threads + 1);
+      for (size_t i = next.fetch_add(1); i < total; i = next.fetch_add(1)) {
+        auto qStart = std::chrono::high_resolution_clock::now();
+        runQuery(*handles[t].tree, queries[i % queries.size()]);
+        auto qEnd = std::chrono::high_resolution_clock::now();
+        latencies[t].push_back(std::chrono::duration<double, std::milli>(qEnd - qStart).count());
+      }
+    });
+  }
+  for (auto& th : pool) th.join();
+  auto end = std::chrono::high_resolution_clock::now();
+
+  for (auto& h : handles) closeTreeHandle(h);
+
+  std::vector<double> all;
+  for (auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+  std::sort(all.begin(), all.end());
+
+  ConcurrencyResult r;
+  r.threads = threads;
+  r.queries = total;
+  r.wallSeconds = std::chrono::duration<double>(end - start).count();
+  r.qps = r.wallSeconds > 0 ? total / r.wallSeconds : 0.0;
+  r.p50 = percentile(all, 50);
+  r.p95 = percentile(all, 95);
+  r.p99 = percentile(all, 99);
+  r.maxMs = all.empty() ? 0.0 : all.back();
+  return r;
+}
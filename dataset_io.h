@@ -0,0 +1,424 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+#include <exception>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "O formato binário de dataset assume uma arquitetura little-endian"
+#endif
+
+// --- Formato Binário de Dataset ---
+// Layout do arquivo (little-endian):
+//   [0, 64)            cabeçalho DatasetHeader
+//   [dataOffset, fim)  matriz densa row-major (linhas x dimensão) em float32 ou float64
+// O início dos dados é alinhado em 64 bytes, então o mmap do arquivo já é um buffer
+// contíguo pronto para uso, sem parsing nem cópia.
+
+enum class DType : uint32_t { Float32 = 1, Float64 = 2 };
+
+struct DatasetHeader {
+  char magic[8];        // "RTDSBIN1"
+  uint32_t version;     // versão do formato (1)
+  uint32_t dtype;       // DType
+  uint32_t dimension;   // valores por linha
+  uint32_t reserved;
+  uint64_t rows;        // número de pontos
+  uint64_t dataOffset;  // início da matriz (múltiplo de 64)
+  uint8_t padding[24];
+};
+static_assert(sizeof(DatasetHeader) == 64, "DatasetHeader deve ocupar exatamente 64 bytes");
+
+static const char DATASET_MAGIC[8] = {'R', 'T', 'D', 'S', 'B', 'I', 'N', '1'};
+
+inline size_t dtypeSize(DType t) { return t == DType::Float32 ? sizeof(float) : sizeof(double); }
+
+// Uso de memória residente (RSS) em MB, lido de /proc/self/statm
+inline double getResidentMemoryMB() {
+  long size = 0L, rss = 0L;
+  std::ifstream stat_stream("/proc/self/statm", std::ios_base::in);
+  if (stat_stream >> size >> rss) return (rss * sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+  return 0.0;
+}
+
+// Pico de memória residente (VmHWM de /proc/self/status) em MB
+inline double getPeakResidentMemoryMB() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) return std::stod(line.substr(6)) / 1024.0;  // valor em kB
+  }
+  return 0.0;
+}
+
+// Zera o pico de RSS (escrevendo "5" em /proc/self/clear_refs), para medir fases separadas
+// no mesmo processo. Retorna false se o kernel não permitir.
+inline bool resetPeakResidentMemory() {
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5";
+  clearRefs.flush();
+  return static_cast<bool>(clearRefs);
+}
+
+// Lê uma linha CSV (valores separados por vírgula) em [begin, end) para out. Retorna o número
+// de valores. Usa std::from_chars (sem locale nem alocação por campo) com a mesma semântica do
+// stod anterior: espaços e '+' iniciais são aceitos, o que sobra do campo após o número é
+// ignorado (ex: '\r') e um campo sem número lança std::invalid_argument.
+inline size_t parseCsvLine(const char* begin, const char* end, std::vector<double>& out) {
+  out.clear();
+  const char* p = begin;
+  while (p < end) {
+    const char* fieldEnd = static_cast<const char*>(memchr(p, ',', end - p));
+    if (fieldEnd == nullptr) fieldEnd = end;
+    while (p < fieldEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    if (p < fieldEnd && *p == '+') p++;
+    double value;
+    std::from_chars_result r = std::from_chars(p, fieldEnd, value);
+    if (r.ec == std::errc::invalid_argument) throw std::invalid_argument("Valor CSV inválido: " + std::string(begin, end));
+    if (r.ec == std::errc::result_out_of_range) throw std::out_of_range("Valor CSV fora da faixa: " + std::string(begin, end));
+    out.push_back(value);
+    p = fieldEnd + 1;
+  }
+  return out.size();
+}
+
+inline size_t parseCsvLine(const std::string& line, std::vector<double>& out) {
+  return parseCsvLine(line.data(), line.data() + line.size(), out);
+}
+
+// Procura a versão binária de um dataset: o próprio caminho se já for .bin,
+// ou o arquivo irmão com extensão .bin (ex: color_32.txt -> color_32.bin).
+inline std::string findBinaryDataset(const std::string& path) {
+  std::filesystem::path p(path);
+  if (p.extension() == ".bin") return std::filesystem::exists(p) ? path : "";
+  p.replace_extension(".bin");
+  return std::filesystem::exists(p) ? p.string() : "";
+}
+
+// --- Dataset em Memória ---
+// Abre um dataset binário via mmap (zero-copy) ou, como fallback, faz o parsing do CSV
+// para um buffer contíguo próprio. As linhas são sempre contíguas e row-major.
+class Dataset {
+  public:
+    Dataset() = default;
+    ~Dataset() { close(); }
+    Dataset(const Dataset&) = delete;
+    Dataset& operator=(const Dataset&) = delete;
+
+    // Abre o dataset. Se allowBinary, usa a versão .bin quando existir. O CSV é dividido em
+    // faixas de bytes processadas por parseThreads threads (0 = todos os núcleos).
+    // Lança std::runtime_error em caso de arquivo inválido.
+    void open(const std::string& path, uint32_t expectedDim, bool allowBinary = true, unsigned parseThreads = 0) {
+      close();
+      auto start = std::chrono::high_resolution_clock::now();
+      std::string binPath = allowBinary ? findBinaryDataset(path) : "";
+      if (!binPath.empty()) openBinary(binPath, expectedDim);
+      else openCsv(path, expectedDim, parseThreads == 0 ? resolveThreadCount("auto") : parseThreads);
+      loadSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Usa linhas já em memória (float64, row-major) no lugar de um arquivo; "label" vira o
+    // sourcePath. Ex: o conjunto vivo do índice após a carga mista.
+    void assign(std::vector<double> values, uint32_t expectedDim, const std::string& label) {
+      close();
+      owned = std::move(values);
+      type = DType::Float64;
+      dim = expectedDim;
+      rows = (expectedDim == 0) ? 0 : owned.size() / expectedDim;
+      base = reinterpret_cast<const uint8_t*>(owned.data());
+      source = label;
+    }
+
+    void close() {
+      if (mapped != nullptr) munmap(mapped, mappedBytes);
+      mapped = nullptr; mappedBytes = 0; base = nullptr;
+      owned.clear(); owned.shrink_to_fit();
+      rows = 0;
+    }
+
+    uint64_t size() const { return rows; }
+    uint32_t dimension() const { return dim; }
+    DType dtype() const { return type; }
+    bool isBinary() const { return mapped != nullptr; }
+    const std::string& sourcePath() const { return source; }
+    std::string formatName() const {
+      if (!isBinary()) return "csv";
+      return type == DType::Float32 ? "bin-float32" : "bin-float64";
+    }
+
+    // Ponteiro para o início da matriz (float* ou double*, conforme dtype())
+    const void* rawData() const { return base; }
+    const double* rowF64(uint64_t i) const { return reinterpret_cast<const double*>(base) + i * dim; }
+    const float* rowF32(uint64_t i) const { return reinterpret_cast<const float*>(base) + i * dim; }
+
+    // Retorna a linha i como double: ponteiro direto se float64, senão converte em scratch.
+    const double* row(uint64_t i, double* scratch) const {
+      if (type == DType::Float64) return rowF64(i);
+      const float* src = rowF32(i);
+      for (uint32_t d = 0; d < dim; d++) scratch[d] = src[d];
+      return scratch;
+    }
+
+    double loadSeconds = 0.0;
+
+  private:
+    void* mapped = nullptr;
+    size_t mappedBytes = 0;
+    const uint8_t* base = nullptr;
+    std::vector<double> owned;
+    uint64_t rows = 0;
+    uint32_t dim = 0;
+    DType type = DType::Float64;
+    std::string source;
+
+    void openBinary(const std::string& path, uint32_t expectedDim) {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) throw std::runtime_error("Não foi possível abrir " + path);
+      struct stat st;
+      if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(DatasetHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Arquivo binário inválido: " + path);
+      }
+      mappedBytes = static_cast<size_t>(st.st_size);
+      mapped = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (mapped == MAP_FAILED) { mapped = nullptr; throw std::runtime_error("Falha no mmap de " + path); }
+
+      DatasetHeader h;
+      memcpy(&h, mapped, sizeof(h));
+      size_t payload = (h.dtype == static_cast<uint32_t>(DType::Float32) || h.dtype == static_cast<uint32_t>(DType::Float64))
+                         ? dtypeSize(static_cast<DType>(h.dtype)) * h.dimension * h.rows : 0;
+      if (memcmp(h.magic, DATASET_MAGIC, sizeof(h.magic)) != 0 || h.version != 1 || payload == 0 ||
+          h.dataOffset % 64 != 0 || h.dataOffset + payload > mappedBytes) {
+        close();
+        throw std::runtime_error("Cabeçalho binário inválido: " + path);
+      }
+      if (h.dimension != expectedDim) {
+        close();
+        throw std::runtime_error("Dimensão do arquivo binário (" + std::to_string(h.dimension) +
+                                 ") difere da informada (" + std::to_string(expectedDim) + "): " + path);
+      }
+
+      type = static_cast<DType>(h.dtype);
+      dim = h.dimension;
+      rows = h.rows;
+      base = static_cast<const uint8_t*>(mapped) + h.dataOffset;
+      source = path;
+    }
+
+    // Parsing paralelo do CSV: o arquivo é mapeado e dividido em faixas de bytes (ajustadas para
+    // começar após um '\n'); cada faixa é convertida num buffer próprio e os buffers são
+    // concatenados na ordem do arquivo, então os IDs são os mesmos do parsing sequencial.
+    void openCsv(const std::string& path, uint32_t expectedDim, unsigned threads) {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) throw std::runtime_error("Não foi possível abrir " + path);
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Não foi possível abrir " + path);
+      }
+      size_t bytes = static_cast<size_t>(st.st_size);
+      void* text = bytes > 0 ? mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+      ::close(fd);
+      if (text == MAP_FAILED) throw std::runtime_error("Falha no mmap de " + path);
+      const char* begin = static_cast<const char*>(text);
+      const char* end = begin + bytes;
+
+      // Algumas faixas por thread equilibram linhas de tamanhos diferentes
+      size_t ranges = (threads <= 1 || bytes < (1u << 20)) ? 1 : static_cast<size_t>(threads) * 4;
+      std::vector<const char*> cuts(ranges + 1, end);
+      cuts[0] = begin;
+      for (size_t r = 1; r < ranges; r++) {
+        const char* c = std::max(begin + bytes * r / ranges, cuts[r - 1]);
+        const char* nl = static_cast<const char*>(memchr(c, '\n', end - c));
+        cuts[r] = nl ? nl + 1 : end;
+      }
+
+      std::vector<std::vector<double>> parts(ranges);
+      std::exception_ptr error;
+      std::mutex errorMutex;
+      parallelFor(ranges, threads, [&](size_t r, unsigned) {
+        try {
+          std::vector<double> coords;
+          for (const char* p = cuts[r]; p < cuts[r + 1];) {
+            const char* nl = static_cast<const char*>(memchr(p, '\n', cuts[r + 1] - p));
+            const char* lineEnd = nl ? nl : cuts[r + 1];
+            if (parseCsvLine(p, lineEnd, coords) == expectedDim) parts[r].insert(parts[r].end(), coords.begin(), coords.end());
+            p = lineEnd + 1;
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          if (!error) error = std::current_exception();
+        }
+      });
+      if (text != nullptr) munmap(text, bytes);
+      if (error) std::rethrow_exception(error);
+
+      size_t total = 0;
+      for (const std::vector<double>& part : parts) total += part.size();
+      owned.resize(total);
+      size_t offset = 0;
+      for (std::vector<double>& part : parts) {
+        std::copy(part.begin(), part.end(), owned.begin() + offset);
+        offset += part.size();
+        std::vector<double>().swap(part);
+      }
+      type = DType::Float64;
+      dim = expectedDim;
+      rows = (expectedDim == 0) ? 0 : owned.size() / expectedDim;
+      base = reinterpret_cast<const uint8_t*>(owned.data());
+      source = path;
+    }
+};
+
+// --- Leitura em Blocos ---
+// Para datasets maiores que a RAM: lê o dataset (binário com read(), sem mmap, ou CSV linha
+// a linha) em blocos de no máximo maxRows linhas convertidas para double. A memória usada
+// fica limitada ao bloco do chamador, e os IDs seguem a mesma numeração de Dataset.
+class DatasetChunkReader {
+  public:
+    void open(const std::string& path, uint32_t expectedDim, bool allowBinary = true) {
+      std::string binPath = allowBinary ? findBinaryDataset(path) : "";
+      dim = expectedDim;
+      binary = !binPath.empty();
+      source = binary ? binPath : path;
+      file.close();
+      file.clear();
+      file.open(source, binary ? std::ios::binary : std::ios::in);
+      if (!file.is_open()) throw std::runtime_error("Não foi possível abrir " + source);
+      if (binary) {
+        DatasetHeader h;
+        file.read(reinterpret_cast<char*>(&h), sizeof(h));
+        if (!file || memcmp(h.magic, DATASET_MAGIC, sizeof(h.magic)) != 0 || h.version != 1 ||
+            (h.dtype != static_cast<uint32_t>(DType::Float32) && h.dtype != static_cast<uint32_t>(DType::Float64))) {
+          throw std::runtime_error("Cabeçalho binário inválido: " + source);
+        }
+        if (h.dimension != expectedDim) {
+          throw std::runtime_error("Dimensão do arquivo binário (" + std::to_string(h.dimension) +
+                                   ") difere da informada (" + std::to_string(expectedDim) + "): " + source);
+        }
+        type = static_cast<DType>(h.dtype);
+        totalRows = h.rows;
+        dataOffset = h.dataOffset;
+      }
+      rewind();
+    }
+
+    void rewind() {
+      file.clear();
+      file.seekg(binary ? static_cast<std::streamoff>(dataOffset) : 0);
+      nextRow = 0;
+    }
+
+    // Lê até maxRows linhas em rows (row-major). Retorna o número de linhas lidas (0 = fim).
+    size_t read(std::vector<double>& rows, size_t maxRows) {
+      rows.resize(maxRows * dim);
+      size_t n = 0;
+      if (binary) {
+        uint64_t left = totalRows - nextRow;
+        n = static_cast<size_t>(std::min<uint64_t>(maxRows, left));
+        if (type == DType::Float64) {
+          file.read(reinterpret_cast<char*>(rows.data()), n * dim * sizeof(double));
+        } else {
+          raw.resize(n * dim);
+          file.read(reinterpret_cast<char*>(raw.data()), n * dim * sizeof(float));
+          for (size_t i = 0; i < n * dim; i++) rows[i] = raw[i];
+        }
+        if (!file) throw std::runtime_error("Arquivo binário truncado: " + source);
+      } else {
+        std::string line;
+        while (n < maxRows && getline(file, line)) {
+          if (parseCsvLine(line, coords) != dim) continue;
+          std::copy(coords.begin(), coords.end(), rows.begin() + n * dim);
+          n++;
+        }
+      }
+      rows.resize(n * dim);
+      nextRow += n;
+      return n;
+    }
+
+    uint32_t dimension() const { return dim; }
+    uint64_t position() const { return nextRow; }   // ID da próxima linha a ser lida
+    bool isBinary() const { return binary; }
+    const std::string& sourcePath() const { return source; }
+
+  private:
+    std::ifstream file;
+    std::string source;
+    bool binary = false;
+    DType type = DType::Float64;
+    uint32_t dim = 0;
+    uint64_t totalRows = 0;
+    uint64_t dataOffset = 0;
+    uint64_t nextRow = 0;
+    std::vector<float> raw;
+    std::vector<double> coords;
+};
+
+// Carrega um arquivo de queries (binário se houver .bin irmão, senão CSV) como vetores double.
+inline std::vector<std::vector<double>> loadQueries(const std::string& path, uint32_t dim) {
+  std::vector<std::vector<double>> queries;
+  if (!std::filesystem::exists(path) && findBinaryDataset(path).empty()) return queries;
+  Dataset data;
+  data.open(path, dim);
+  std::vector<double> scratch(dim);
+  for (uint64_t i = 0; i < data.size(); i++) {
+    const double* r = data.row(i, scratch.data());
+    queries.emplace_back(r, r + dim);
+  }
+  return queries;
+}
+
+// Converte um CSV em arquivo binário (linhas com dimensão diferente são descartadas,
+// como nos loaders CSV). Retorna o número de linhas escritas.
+inline uint64_t writeBinaryDataset(const std::string& csvPath, const std::string& outPath, uint32_t dim, DType dtype) {
+  std::ifstream in(csvPath);
+  if (!in.is_open()) throw std::runtime_error("Não foi possível abrir " + csvPath);
+  std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) throw std::runtime_error("Não foi possível criar " + outPath);
+
+  DatasetHeader h{};
+  memcpy(h.magic, DATASET_MAGIC, sizeof(h.magic));
+  h.version = 1;
+  h.dtype = static_cast<uint32_t>(dtype);
+  h.dimension = dim;
+  h.dataOffset = sizeof(DatasetHeader);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+  std::string line; std::vector<double> coords; std::vector<float> coordsF(dim);
+  uint64_t rows = 0;
+  while (getline(in, line)) {
+    if (parseCsvLine(line, coords) != dim) continue;
+    if (dtype == DType::Float32) {
+      for (uint32_t d = 0; d < dim; d++) coordsF[d] = static_cast<float>(coords[d]);
+      out.write(reinterpret_cast<const char*>(coordsF.data()), dim * sizeof(float));
+    } else {
+      out.write(reinterpret_cast<const char*>(coords.data()), dim * sizeof(double));
+    }
+    rows++;
+  }
+
+  // Reescreve o cabeçalho com o total de linhas
+  h.rows = rows;
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  if (!out) throw std::runtime_error("Erro de escrita em " + outPath);
+  return rows;
+}
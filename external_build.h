@@ -0,0 +1,254 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <random>
+#include <queue>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <iomanip>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#include "dataset_io.h"
+#include "bulk_load.h"
+
+// --- Construção com Memória Limitada ---
+// Para datasets maiores que a RAM. O dataset é lido em blocos (DatasetChunkReader) e
+// ordenado externamente pela chave da curva de Hilbert:
+//  1. scan: mínimo/máximo por dimensão (normalização da chave). A mesma passada alimenta
+//     o Reservoir Sampling das queries;
+//  2. runs: blocos de até rowsPerRun linhas são ordenados em memória pela chave e gravados
+//     em arquivos temporários (registro = chave | id | coordenadas);
+//  3. merge: intercalação k-way dos runs, com um buffer de leitura por run.
+// Em todas as fases a memória é limitada pelo orçamento (--memory-budget). Os pontos saem
+// em ordem de Hilbert e vão direto para PackedTreeWriter (packed_tree.h), como no modo hilbert.
+
+// Amostragem das queries por Reservoir Sampling (mesma semente de generateQueryFiles),
+// feita sobre as linhas vistas numa passada do dataset.
+class QueryReservoir {
+  public:
+    explicit QueryReservoir(size_t total) : capacity(total), gen(12345) {}
+
+    void offer(const double* row, uint32_t dim) {
+      if (seen < capacity) {
+        samples.emplace_back(row, row + dim);
+      } else {
+        std::uniform_int_distribution<> dis(0, static_cast<int>(seen));
+        int j = dis(gen);
+        if (j < static_cast<int>(capacity)) samples[j].assign(row, row + dim);
+      }
+      seen++;
+    }
+
+    // As primeiras perType amostras vão para knnPath e as seguintes para rangePath
+    void write(const std::string& knnPath, const std::string& rangePath, size_t perType) const {
+      std::ofstream knnFile(knnPath), rangeFile(rangePath);
+      knnFile << std::setprecision(17);
+      rangeFile << std::setprecision(17);
+      for (size_t i = 0; i < samples.size(); i++) {
+        std::ofstream& out = (i < perType) ? knnFile : rangeFile;
+        for (size_t d = 0; d < samples[i].size(); d++) out << (d ? "," : "") << samples[i][d];
+        out << "\n";
+      }
+    }
+
+  private:
+    size_t capacity;
+    uint64_t seen = 0;
+    std::mt19937 gen;
+    std::vector<std::vector<double>> samples;
+};
+
+struct ExternalSortStats {
+  uint64_t rows = 0;
+  uint64_t runs = 0;
+  uint64_t rowsPerRun = 0;
+  double scanSeconds = 0;
+  double runSeconds = 0;
+  double mergeSeconds = 0;
+};
+
+class HilbertExternalSorter {
+  public:
+    // Os runs ficam em tempDir (criado aqui e removido no destrutor)
+    HilbertExternalSorter(const std::string& dir, uint32_t dim, uint64_t memoryBudget)
+        : tempDir(dir), dimension(dim), bitsPerDim(dim > 16 ? 8 : 16),
+          keyBytes((dim * bitsPerDim + 7) / 8), recordBytes(keyBytes + sizeof(uint64_t) + dim * sizeof(double)) {
+      // Por linha de um run: bloco lido (double) + registro ordenado + índice de ordenação
+      uint64_t perRow = dim * sizeof(double) + recordBytes + sizeof(uint32_t);
+      stats.rowsPerRun = std::max<uint64_t>(1, std::min<uint64_t>(memoryBudget / perRow, std::numeric_limits<uint32_t>::max()));
+      std::filesystem::create_directories(tempDir);
+    }
+
+    ~HilbertExternalSorter() {
+      std::error_code ec;
+      for (const std::string& run : runPaths) std::filesystem::remove(run, ec);
+      std::filesystem::remove(tempDir, ec);
+    }
+
+    HilbertExternalSorter(const HilbertExternalSorter&) = delete;
+    HilbertExternalSorter& operator=(const HilbertExternalSorter&) = delete;
+
+    // Passo 1: mínimo/máximo por dimensão; onRow(linha) recebe cada linha lida
+    template <class OnRow>
+    void scan(DatasetChunkReader& reader, OnRow&& onRow) {
+      auto start = std::chrono::high_resolution_clock::now();
+      mins.assign(dimension, std::numeric_limits<double>::infinity());
+      maxs.assign(dimension, -std::numeric_limits<double>::infinity());
+      reader.rewind();
+      std::vector<double> chunk;
+      for (size_t n; (n = reader.read(chunk, stats.rowsPerRun)) > 0;) {
+        for (size_t i = 0; i < n; i++) {
+          const double* row = &chunk[i * dimension];
+          for (uint32_t d = 0; d < dimension; d++) {
+            mins[d] = std::min(mins[d], row[d]);
+            maxs[d] = std::max(maxs[d], row[d]);
+          }
+          onRow(row);
+        }
+      }
+      stats.rows = reader.position();
+      stats.scanSeconds = secondsSince(start);
+    }
+
+    // Passo 2: runs de até rowsPerRun linhas, ordenados pela chave de Hilbert
+    void writeRuns(DatasetChunkReader& reader) {
+      auto start = std::chrono::high_resolution_clock::now();
+      const double cells = static_cast<double>((1u << bitsPerDim) - 1);
+      std::vector<double> chunk;
+      std::vector<char> records;
+      std::vector<uint32_t> order;
+      std::vector<uint32_t> X(dimension);
+      reader.rewind();
+      for (size_t n; (n = reader.read(chunk, stats.rowsPerRun)) > 0;) {
+        uint64_t firstId = reader.position() - n;
+        records.resize(n * recordBytes);
+        for (size_t i = 0; i < n; i++) {
+          const double* row = &chunk[i * dimension];
+          for (uint32_t d = 0; d < dimension; d++) {
+            double span = maxs[d] - mins[d];
+            double norm = (span > 0) ? (row[d] - mins[d]) / span : 0.0;
+            X[d] = static_cast<uint32_t>(norm * cells);
+          }
+          std::string key = hilbertKey(X, bitsPerDim);
+          char* rec = &records[i * recordBytes];
+          uint64_t id = firstId + i;
+          memcpy(rec, key.data(), keyBytes);
+          memcpy(rec + keyBytes, &id, sizeof(id));
+          memcpy(rec + keyBytes + sizeof(id), row, dimension * sizeof(double));
+        }
+
+        // Linhas do bloco já estão em ordem de ID, então a ordenação estável desempata por ID
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+          return memcmp(&records[a * recordBytes], &records[b * recordBytes], keyBytes) < 0;
+        });
+
+        std::string path = tempDir + "/run_" + std::to_string(runPaths.size()) + ".bin";
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for (uint32_t i : order) out.write(&records[i * recordBytes], recordBytes);
+        if (!out) throw std::runtime_error("Falha ao gravar run temporário " + path);
+        runPaths.push_back(path);
+        runRows.push_back(n);
+      }
+      stats.runs = runPaths.size();
+      stats.runSeconds = secondsSince(start);
+    }
+
+    // Passo 3: intercala os runs e chama onPoint(id, coordenadas) em ordem de Hilbert
+    template <class OnPoint>
+    void merge(OnPoint&& onPoint) {
+      auto start = std::chrono::high_resolution_clock::now();
+      // O orçamento dos runs é dividido entre os buffers de leitura
+      uint64_t bufferRows = std::max<uint64_t>(1, stats.rowsPerRun / std::max<size_t>(1, runPaths.size()));
+      std::vector<RunReader> readers(runPaths.size());
+      for (size_t r = 0; r < runPaths.size(); r++) readers[r].open(runPaths[r], runRows[r], recordBytes, bufferRows);
+
+      auto greater = [&](size_t a, size_t b) {
+        int c = memcmp(readers[a].current(), readers[b].current(), keyBytes);
+        if (c != 0) return c > 0;
+        return recordId(readers[a].current()) > recordId(readers[b].current());
+      };
+      std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+      for (size_t r = 0; r < readers.size(); r++) {
+        if (readers[r].valid()) heap.push(r);
+      }
+      std::vector<double> coords(dimension);
+      while (!heap.empty()) {
+        size_t r = heap.top();
+        heap.pop();
+        const char* rec = readers[r].current();
+        memcpy(coords.data(), rec + keyBytes + sizeof(uint64_t), dimension * sizeof(double));
+        onPoint(static_cast<SpatialIndex::id_type>(recordId(rec)), coords.data());
+        if (readers[r].advance()) heap.push(r);
+      }
+      stats.mergeSeconds = secondsSince(start);
+    }
+
+    const ExternalSortStats& getStats() const { return stats; }
+
+  private:
+    // Leitura bufferizada de um run (bufferRows registros por vez)
+    struct RunReader {
+      std::ifstream in;
+      std::vector<char> buffer;
+      size_t recordBytes = 0, count = 0, pos = 0;
+      uint64_t remaining = 0, bufferRows = 0;
+
+      void open(const std::string& path, uint64_t rows, size_t recBytes, uint64_t bufRows) {
+        in.open(path, std::ios::binary);
+        if (!in.is_open()) throw std::runtime_error("Não foi possível abrir o run " + path);
+        recordBytes = recBytes;
+        remaining = rows;
+        bufferRows = bufRows;
+        refill();
+      }
+
+      void refill() {
+        count = static_cast<size_t>(std::min<uint64_t>(bufferRows, remaining));
+        pos = 0;
+        buffer.resize(count * recordBytes);
+        in.read(buffer.data(), buffer.size());
+        if (!in) throw std::runtime_error("Run temporário truncado");
+        remaining -= count;
+      }
+
+      bool valid() const { return pos < count; }
+      const char* current() const { return &buffer[pos * recordBytes]; }
+
+      bool advance() {
+        if (++pos < count) return true;
+        if (remaining == 0) return false;
+        refill();
+        return count > 0;
+      }
+    };
+
+    std::string tempDir;
+    uint32_t dimension;
+    uint32_t bitsPerDim;
+    size_t keyBytes;
+    size_t recordBytes;
+    std::vector<double> mins, maxs;
+    std::vector<std::string> runPaths;
+    std::vector<uint64_t> runRows;
+    ExternalSortStats stats;
+
+    uint64_t recordId(const char* rec) const {
+      uint64_t id;
+      memcpy(&id, rec + keyBytes, sizeof(id));
+      return id;
+    }
+
+    static double secondsSince(std::chrono::high_resolution_clock::time_point start) {
+      return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+};
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <immintrin.h>
+
+#include "result_buffer.h"
+
+// --- Motor em Memória com Nós Planos ---
+// Mesmo com o índice cabendo na RAM, cada nó lido pela RTree passa pelo storage (páginas de
+// 4096 bytes) e é desserializado num Node da libspatialindex, com um Region alocado por filho.
+// FlatRTree carrega as páginas de um rtree_index_<dataset> já gravado para três vetores
+// contíguos e responde às mesmas consultas k-NN e Range, chamando o mesmo IVisitor:
+//
+//  * nodes:    um registro por nó, em ordem de largura (a raiz é o nó 0);
+//  * boxes:    MBRs dos filhos de cada nó em estrutura de arrays: low[d][j] e high[d][j], com
+//              "stride" (número de filhos arredondado para múltiplo de 4) entre dimensões;
+//  * childIds: por filho, o índice do nó filho (nós internos) ou o id do dado (folhas).
+//
+// Com esse layout, uma passada pelas dimensões calcula a MINDIST² da consulta para todos os
+// filhos de um nó, 4 filhos por instrução AVX2 (seleção em tempo de execução, como em
+// l2_kernels.h). A consulta é uma caixa [qLow, qHigh]: um ponto no k-NN e na bola, a caixa
+// da Range original. Filhos com MINDIST² 0 intersectam a caixa.
+//
+// O visitor recebe visitNode com uma visão do nó plano (nível, filhos e MBRs, como no
+// rastreamento da travessia) e visitData com um RTree::Data reaproveitado, cujas coordenadas
+// são copiadas do nó. As sobrecargas com ResultBuffer (result_buffer.h) dispensam o visitor:
+// gravam (id, MINDIST²) direto no buffer. Os buffers das consultas são reaproveitados, então
+// um FlatRTree não deve ser consultado por várias threads ao mesmo tempo.
+
+// Layout de página de Node::storeToByteArray (libspatialindex 1.9), como em parallel_build.h:
+//   uint32 tipo | uint32 nível | uint32 filhos |
+//   por filho: low[dim] high[dim] | id_type id | uint32 tamanho | dados | MBR do nó
+
+// MINDIST² da caixa [qLow, qHigh] para os "stride" filhos de um nó
+inline void flatGap2Scalar(const double* qLow, const double* qHigh, const double* low, const double* high,
+                           uint32_t dim, uint32_t stride, double* out) {
+  for (uint32_t j = 0; j < stride; j++) out[j] = 0;
+  for (uint32_t d = 0; d < dim; d++) {
+    const double* lo = low + static_cast<size_t>(d) * stride;
+    const double* hi = high + static_cast<size_t>(d) * stride;
+    for (uint32_t j = 0; j < stride; j++) {
+      double gap = std::max(std::max(lo[j] - qHigh[d], qLow[d] - hi[j]), 0.0);
+      out[j] += gap * gap;
+    }
+  }
+}
+
+__attribute__((target("avx2,fma")))
+inline void flatGap2Avx2(const double* qLow, const double* qHigh, const double* low, const double* high,
+                         uint32_t dim, uint32_t stride, double* out) {
+  const __m256d zero = _mm256_setzero_pd();
+  for (uint32_t j = 0; j < stride; j += 4) {
+    __m256d acc = zero;
+    for (uint32_t d = 0; d < dim; d++) {
+      __m256d lo = _mm256_loadu_pd(low + static_cast<size_t>(d) * stride + j);
+      __m256d hi = _mm256_loadu_pd(high + static_cast<size_t>(d) * stride + j);
+      __m256d below = _mm256_sub_pd(lo, _mm256_broadcast_sd(qHigh + d));
+      __m256d above = _mm256_sub_pd(_mm256_broadcast_sd(qLow + d), hi);
+      __m256d gap = _mm256_max_pd(_mm256_max_pd(below, above), zero);
+      acc = _mm256_fmadd_pd(gap, gap, acc);
+    }
+    _mm256_storeu_pd(out + j, acc);
+  }
+}
+
+class FlatRTree {
+  public:
+    // Carrega a árvore cujo cabeçalho está na página indexIdentifier de "pages"
+    FlatRTree(SpatialIndex::IStorageManager& pages, SpatialIndex::id_type indexIdentifier, uint32_t dim)
+        : dimension(dim), queryLow(dim), queryHigh(dim) {
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        gap2 = flatGap2Avx2;
+        kernel = "avx2";
+      }
+
+      std::vector<uint8_t> header = loadPage(pages, indexIdentifier);
+      if (header.size() < sizeof(SpatialIndex::id_type)) throw std::runtime_error("Cabeçalho da R-Tree inválido");
+      SpatialIndex::id_type root;
+      memcpy(&root, header.data(), sizeof(root));
+
+      // Largura: o nó n vem da página pending[n]; os filhos recebem índices na ordem da fila
+      std::vector<SpatialIndex::id_type> pending{root};
+      for (size_t n = 0; n < pending.size(); n++) loadNode(pages, pending[n], pending);
+      nodes.shrink_to_fit();
+      boxes.shrink_to_fit();
+      childIds.shrink_to_fit();
+
+      std::vector<double> zeros(dimension, 0.0);
+      SpatialIndex::Region r(zeros.data(), zeros.data(), dimension);
+      data.reset(new SpatialIndex::RTree::Data(0, nullptr, r, 0));
+    }
+
+    FlatRTree(const FlatRTree&) = delete;
+    FlatRTree& operator=(const FlatRTree&) = delete;
+
+    // k-NN best-first, como RTree::nearestNeighborQuery: devolve os k mais próximos em ordem
+    // de distância, mais os empatados com o k-ésimo
+    void nearestNeighborQuery(uint32_t k, const double* query, SpatialIndex::IVisitor& v) {
+      setPointQuery(query);
+      knnSearch(k, [&](uint32_t n) { visitNode(n, v); }, [&](uint32_t n, uint32_t j, double) { emitData(n, j, v); });
+    }
+
+    // Range com a caixa [low, high] (a Range original de lado 2·raio)
+    void intersectsWithQuery(const double* low, const double* high, SpatialIndex::IVisitor& v) {
+      std::copy(low, low + dimension, queryLow.begin());
+      std::copy(high, high + dimension, queryHigh.begin());
+      rangeSearch(0.0, [&](uint32_t n) { visitNode(n, v); }, [&](uint32_t n, uint32_t j, double) { emitData(n, j, v); });
+    }
+
+    // Range com a bola L2 (mesma poda por MINDIST de BallRegion)
+    void intersectsWithBall(const double* center, double radius, SpatialIndex::IVisitor& v) {
+      setPointQuery(center);
+      rangeSearch(radius * radius, [&](uint32_t n) { visitNode(n, v); },
+                  [&](uint32_t n, uint32_t j, double) { emitData(n, j, v); });
+    }
+
+    // k-NN com os resultados em "out" (já em ordem de distância)
+    void nearestNeighborQuery(uint32_t k, const double* query, ResultBuffer& out) {
+      out.clear();
+      setPointQuery(query);
+      knnSearch(k, [](uint32_t) {}, [&](uint32_t n, uint32_t j, double dist2) { out.add(childId(n, j), dist2); });
+    }
+
+    // Range com os pontos a até "radius" do centro em "out", em ordem de distância. Na bola a
+    // MINDIST² da busca é a distância; na caixa a distância é calculada para os aceitos.
+    void rangeQuery(const double* center, double radius, bool ballShape, ResultBuffer& out) {
+      out.clear();
+      double radius2 = radius * radius;
+      if (ballShape) {
+        setPointQuery(center);
+        rangeSearch(radius2, [](uint32_t) {}, [&](uint32_t n, uint32_t j, double dist2) { out.add(childId(n, j), dist2); });
+      } else {
+        for (uint32_t d = 0; d < dimension; d++) {
+          queryLow[d] = center[d] - radius;
+          queryHigh[d] = center[d] + radius;
+        }
+        rangeSearch(0.0, [](uint32_t) {}, [&](uint32_t n, uint32_t j, double) {
+          double dist2 = pointDistance2(n, j, center);
+          if (dist2 <= radius2) out.add(childId(n, j), dist2);
+        });
+      }
+      out.sortByDistance();
+    }
+
+    size_t nodeCount() const { return nodes.size(); }
+    uint32_t height() const { return nodes.empty() ? 0 : nodes[0].level + 1; }
+    const std::string& kernelName() const { return kernel; }
+
+    size_t memoryBytes() const {
+      return nodes.size() * sizeof(Node) + boxes.size() * sizeof(double) + childIds.size() * sizeof(SpatialIndex::id_type);
+    }
+
+    // Nó plano visto como INode (para visitor.visitNode). Formas são alocadas sob demanda.
+    class NodeView : public SpatialIndex::INode {
+      public:
+        NodeView(const FlatRTree& t, uint32_t n) : tree(&t), node(n) {}
+
+        Tools::IObject* clone() override { return new NodeView(*this); }
+
+        SpatialIndex::id_type getIdentifier() const override { return tree->nodes[node].page; }
+
+        // MBR do nó: união dos MBRs dos filhos
+        void getShape(SpatialIndex::IShape** out) const override {
+          const Node& n = tree->nodes[node];
+          std::vector<double> low(tree->dimension), high(tree->dimension);
+          for (uint32_t d = 0; d < tree->dimension; d++) {
+            const double* lo = tree->lowColumn(n, d);
+            const double* hi = tree->highColumn(n, d);
+            low[d] = *std::min_element(lo, lo + n.count);
+            high[d] = *std::max_element(hi, hi + n.count);
+          }
+          *out = new SpatialIndex::Region(low.data(), high.data(), tree->dimension);
+        }
+
+        uint32_t getChildrenCount() const override { return tree->nodes[node].count; }
+
+        SpatialIndex::id_type getChildIdentifier(uint32_t index) const override {
+          const Node& n = tree->nodes[node];
+          SpatialIndex::id_type id = tree->childIds[n.children + index];
+          return n.level == 0 ? id : tree->nodes[static_cast<size_t>(id)].page;
+        }
+
+        void getChildData(uint32_t, uint32_t& len, uint8_t** bytes) const override {
+          len = 0;
+          *bytes = nullptr;
+        }
+
+        void getChildShape(uint32_t index, SpatialIndex::IShape** out) const override {
+          const Node& n = tree->nodes[node];
+          std::vector<double> low(tree->dimension), high(tree->dimension);
+          for (uint32_t d = 0; d < tree->dimension; d++) {
+            low[d] = tree->lowColumn(n, d)[index];
+            high[d] = tree->highColumn(n, d)[index];
+          }
+          *out = new SpatialIndex::Region(low.data(), high.data(), tree->dimension);
+        }
+
+        uint32_t getLevel() const override { return tree->nodes[node].level; }
+        bool isIndex() const override { return tree->nodes[node].level != 0; }
+        bool isLeaf() const override { return tree->nodes[node].level == 0; }
+
+        // ISerializable (base de INode na libspatialindex): o nó plano nunca é gravado
+        uint32_t getByteArraySize() override { return 0; }
+        void loadFromByteArray(const uint8_t*) override {}
+        void storeToByteArray(uint8_t** bytes, uint32_t& len) override {
+          *bytes = nullptr;
+          len = 0;
+        }
+
+      private:
+        const FlatRTree* tree;
+        uint32_t node;
+    };
+
+  private:
+    static constexpr uint32_t NODE_ENTRY = std::numeric_limits<uint32_t>::max();
+    static constexpr size_t NODE_HEADER = 3 * sizeof(uint32_t);
+
+    struct Node {
+      uint32_t level;
+      uint32_t count;
+      uint32_t stride;
+      uint64_t boxes;     // Início do bloco low/high em boxes
+      uint64_t children;  // Início dos filhos em childIds
+      SpatialIndex::id_type page;
+    };
+
+    // Entrada da fila do k-NN: um nó (child == NODE_ENTRY) ou o filho "child" da folha "node"
+    struct QueueEntry {
+      double dist2;
+      uint32_t node;
+      uint32_t child;
+    };
+
+    uint32_t dimension;
+    std::vector<Node> nodes;
+    std::vector<double> boxes;
+    std::vector<SpatialIndex::id_type> childIds;
+    void (*gap2)(const double*, const double*, const double*, const double*, uint32_t, uint32_t, double*) = flatGap2Scalar;
+    std::string kernel = "scalar";
+
+    // Buffers reaproveitados entre consultas
+    std::vector<double> queryLow, queryHigh;
+    std::vector<double> dist;
+    std::vector<QueueEntry> queue;
+    std::vector<uint32_t> stack;
+    std::unique_ptr<SpatialIndex::RTree::Data> data;
+
+    const double* lowColumn(const Node& n, uint32_t d) const { return &boxes[n.boxes + static_cast<size_t>(d) * n.stride]; }
+    const double* highColumn(const Node& n, uint32_t d) const {
+      return &boxes[n.boxes + static_cast<size_t>(dimension + d) * n.stride];
+    }
+
+    static std::vector<uint8_t> loadPage(SpatialIndex::IStorageManager& sm, SpatialIndex::id_type page) {
+      uint32_t len;
+      uint8_t* bytes;
+      sm.loadByteArray(page, len, &bytes);
+      std::vector<uint8_t> out(bytes, bytes + len);
+      delete[] bytes;
+      return out;
+    }
+
+    void loadNode(SpatialIndex::IStorageManager& pages, SpatialIndex::id_type page, std::vector<SpatialIndex::id_type>& pending) {
+      std::vector<uint8_t> bytes = loadPage(pages, page);
+      const size_t box = 2 * dimension * sizeof(double);
+      if (bytes.size() < NODE_HEADER + box) throw std::runtime_error("Página de nó inválida");
+      Node n;
+      memcpy(&n.level, bytes.data() + sizeof(uint32_t), sizeof(n.level));
+      memcpy(&n.count, bytes.data() + 2 * sizeof(uint32_t), sizeof(n.count));
+      n.stride = (n.count + 3) & ~3u;
+      n.boxes = boxes.size();
+      n.children = childIds.size();
+      n.page = page;
+      boxes.resize(boxes.size() + 2 * static_cast<size_t>(dimension) * n.stride, 0.0);
+
+      size_t at = NODE_HEADER;
+      for (uint32_t j = 0; j < n.count; j++) {
+        if (at + box + sizeof(SpatialIndex::id_type) + sizeof(uint32_t) > bytes.size()) {
+          throw std::runtime_error("Página de nó truncada");
+        }
+        for (uint32_t d = 0; d < dimension; d++) {
+          memcpy(&boxes[n.boxes + static_cast<size_t>(d) * n.stride + j], bytes.data() + at + d * sizeof(double), sizeof(double));
+          memcpy(&boxes[n.boxes + static_cast<size_t>(dimension + d) * n.stride + j],
+                 bytes.data() + at + (dimension + d) * sizeof(double), sizeof(double));
+        }
+        at += box;
+        SpatialIndex::id_type id;
+        memcpy(&id, bytes.data() + at, sizeof(id));
+        if (n.level > 0) {
+          childIds.push_back(static_cast<SpatialIndex::id_type>(pending.size()));
+          pending.push_back(id);
+        } else {
+          childIds.push_back(id);
+        }
+        uint32_t dataLength;
+        memcpy(&dataLength, bytes.data() + at + sizeof(id), sizeof(dataLength));
+        at += sizeof(id) + sizeof(uint32_t) + dataLength;
+      }
+      if (at + box != bytes.size()) throw std::runtime_error("Página de nó com layout inesperado");
+      nodes.push_back(n);
+    }
+
+    void computeGaps(const Node& n) {
+      if (dist.size() < n.stride) dist.resize(n.stride);
+      gap2(queryLow.data(), queryHigh.data(), &boxes[n.boxes], &boxes[n.boxes + static_cast<size_t>(dimension) * n.stride],
+           dimension, n.stride, dist.data());
+    }
+
+    void visitNode(uint32_t n, SpatialIndex::IVisitor& v) const {
+      NodeView view(*this, n);
+      v.visitNode(view);
+    }
+
+    void emitData(uint32_t n, uint32_t j, SpatialIndex::IVisitor& v) {
+      const Node& node = nodes[n];
+      for (uint32_t d = 0; d < dimension; d++) {
+        data->m_region.m_pLow[d] = lowColumn(node, d)[j];
+        data->m_region.m_pHigh[d] = highColumn(node, d)[j];
+      }
+      data->m_id = childIds[node.children + j];
+      v.visitData(*data);
+    }
+
+    void setPointQuery(const double* query) {
+      std::copy(query, query + dimension, queryLow.begin());
+      std::copy(query, query + dimension, queryHigh.begin());
+    }
+
+    SpatialIndex::id_type childId(uint32_t n, uint32_t j) const { return childIds[nodes[n].children + j]; }
+
+    // Distância² entre "point" e o canto low do filho j da folha n (o próprio ponto)
+    double pointDistance2(uint32_t n, uint32_t j, const double* point) const {
+      const Node& node = nodes[n];
+      double sum = 0;
+      for (uint32_t d = 0; d < dimension; d++) {
+        double diff = lowColumn(node, d)[j] - point[d];
+        sum += diff * diff;
+      }
+      return sum;
+    }
+
+    // Best-first sobre [queryLow, queryHigh]: onNode(nó) a cada nó lido e onData(folha, filho,
+    // MINDIST²) para cada resultado, em ordem de distância
+    template <class OnNode, class OnData>
+    void knnSearch(uint32_t k, OnNode&& onNode, OnData&& onData) {
+      auto farther = [](const QueueEntry& a, const QueueEntry& b) { return a.dist2 > b.dist2; };
+      queue.clear();
+      queue.push_back({0.0, 0, NODE_ENTRY});
+      uint32_t count = 0;
+      double kth = 0;
+      while (!queue.empty()) {
+        if (count >= k && queue.front().dist2 > kth) break;
+        std::pop_heap(queue.begin(), queue.end(), farther);
+        QueueEntry e = queue.back();
+        queue.pop_back();
+        if (e.child != NODE_ENTRY) {
+          onData(e.node, e.child, e.dist2);
+          count++;
+          kth = e.dist2;
+          continue;
+        }
+        const Node& node = nodes[e.node];
+        onNode(e.node);
+        computeGaps(node);
+        for (uint32_t j = 0; j < node.count; j++) {
+          QueueEntry child = (node.level == 0) ? QueueEntry{dist[j], e.node, j}
+                                               : QueueEntry{dist[j], static_cast<uint32_t>(childIds[node.children + j]), NODE_ENTRY};
+          queue.push_back(child);
+          std::push_heap(queue.begin(), queue.end(), farther);
+        }
+      }
+    }
+
+    // Busca em profundidade: desce nos filhos com MINDIST² <= limit (0 na caixa, raio² na bola)
+    template <class OnNode, class OnData>
+    void rangeSearch(double limit, OnNode&& onNode, OnData&& onData) {
+      stack.clear();
+      stack.push_back(0);
+      while (!stack.empty()) {
+        uint32_t n = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[n];
+        onNode(n);
+        computeGaps(node);
+        for (uint32_t j = 0; j < node.count; j++) {
+          if (dist[j] > limit) continue;
+          if (node.level == 0) {
+            onData(n, j, dist[j]);
+          } else {
+            stack.push_back(static_cast<uint32_t>(childIds[node.children + j]));
+          }
+        }
+      }
+    }
+};
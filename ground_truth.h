@@ -0,0 +1,368 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+
+#include "dataset_io.h"
+#include "l2_kernels.h"
+#include "parallel.h"
+#include "scalar_quantizer.h"
+
+// --- Ground Truth Store ---
+// All points in one contiguous, 64-byte aligned buffer (no per-point heap vectors).
+//  * RowMajor: point i at base[i * dim]. Zero-copy over an mmap'ed float64 binary dataset.
+//  * Blocked:  groups of L2_BLOCK points stored column-blocked, so one SIMD pass
+//              computes the distance from a query to 8 points at once.
+//
+// With a reduced precision (float32, or int8 scalar-quantized per dimension) the store
+// holds row-major compressed coordinates and distances() returns lower bounds of the
+// true squared distances. The scans then re-rank the surviving candidates exactly with
+// exactDistance(), which reads the full-precision row from the Dataset.
+class GroundTruthStore {
+  public:
+    enum class Layout { RowMajor, Blocked };
+
+    GroundTruthStore() = default;
+    ~GroundTruthStore() { std::free(owned); }
+    GroundTruthStore(const GroundTruthStore&) = delete;
+    GroundTruthStore& operator=(const GroundTruthStore&) = delete;
+
+    // The store keeps a pointer to the Dataset (zero-copy rows, exact re-ranking), which must outlive it.
+    void build(const Dataset& data, Layout layout, const L2Kernels& k,
+               CoordPrecision coordPrecision = CoordPrecision::Float64) {
+      std::free(owned); owned = nullptr;
+      base = nullptr;
+      kernels = k;
+      storeLayout = layout;
+      rows = data.size();
+      dim = data.dimension();
+      precision = coordPrecision;
+      exactData = &data;
+      f32.clear();
+      codes.clear();
+
+      if (precision != CoordPrecision::Float64) {
+        storeLayout = Layout::RowMajor;
+        std::vector<double> scratch(dim);
+        if (precision == CoordPrecision::Int8) {
+          quantizer = ScalarQuantizer::fromDataset(data);
+          codes.resize(rows * dim);
+        } else {
+          f32.resize(rows * dim);
+        }
+        for (uint64_t i = 0; i < rows; i++) {
+          const double* r = data.row(i, scratch.data());
+          for (uint32_t d = 0; d < dim; d++) {
+            if (precision == CoordPrecision::Int8) codes[i * dim + d] = quantizer.encodeDown(d, r[d]);
+            else f32[i * dim + d] = static_cast<float>(r[d]);
+          }
+        }
+        return;
+      }
+
+      // Zero-copy: the binary format keeps float64 rows 64-byte aligned in the mapping
+      bool aligned = reinterpret_cast<uintptr_t>(data.rawData()) % 64 == 0;
+      if (layout == Layout::RowMajor && data.isBinary() && data.dtype() == DType::Float64 && aligned) {
+        base = data.rowF64(0);
+        return;
+      }
+
+      uint64_t padded = (layout == Layout::Blocked) ? (rows + L2_BLOCK - 1) / L2_BLOCK * L2_BLOCK : rows;
+      size_t bytes = (padded * dim * sizeof(double) + 63) / 64 * 64;
+      owned = static_cast<double*>(std::aligned_alloc(64, bytes > 0 ? bytes : 64));
+      if (owned == nullptr) throw std::bad_alloc();
+      memset(owned, 0, bytes);
+
+      std::vector<double> scratch(dim);
+      for (uint64_t i = 0; i < rows; i++) {
+        const double* r = data.row(i, scratch.data());
+        if (layout == Layout::RowMajor) {
+          memcpy(owned + i * dim, r, dim * sizeof(double));
+        } else {
+          double* block = owned + (i / L2_BLOCK) * L2_BLOCK * dim;
+          for (uint32_t d = 0; d < dim; d++) block[d * L2_BLOCK + i % L2_BLOCK] = r[d];
+        }
+      }
+      base = owned;
+    }
+
+    uint64_t size() const { return rows; }
+    uint32_t dimension() const { return dim; }
+    Layout layout() const { return storeLayout; }
+    const L2Kernels& kernel() const { return kernels; }
+    bool isZeroCopy() const { return owned == nullptr && base != nullptr; }
+    CoordPrecision coordPrecision() const { return precision; }
+    // True when distances() is exact; otherwise it returns lower bounds to be re-ranked
+    bool isExact() const { return precision == CoordPrecision::Float64; }
+    double memoryMB() const {
+      size_t bytes = owned ? rows * dim * sizeof(double) : 0;
+      bytes += f32.size() * sizeof(float) + codes.size();
+      return bytes / (1024.0 * 1024.0);
+    }
+
+    // Exact squared distance from q to point i, from the full-precision dataset rows.
+    double exactDistance(const double* q, uint64_t i) const {
+      thread_local std::vector<double> scratch;
+      scratch.resize(dim);
+      return kernels.row(q, exactData->row(i, scratch.data()), dim);
+    }
+
+    // Squared distances from q to points [begin, end) written to out[0 .. end-begin).
+    // Lower bounds of them when the store is not exact.
+    void distances(const double* q, uint64_t begin, uint64_t end, double* out) const {
+      if (precision == CoordPrecision::Float32) {
+        // |x - float(x)| <= |float(x)| * 2^-24; FLT_EPSILON (2^-23) keeps a safety margin
+        for (uint64_t i = begin; i < end; i++) {
+          const float* p = f32.data() + i * dim;
+          double sum = 0;
+          for (uint32_t d = 0; d < dim; d++) {
+            double diff = std::fabs(q[d] - p[d]) - (std::fabs(p[d]) * FLT_EPSILON + FLT_MIN);
+            if (diff > 0) sum += diff * diff;
+          }
+          out[i - begin] = sum;
+        }
+        return;
+      }
+      if (precision == CoordPrecision::Int8) {
+        // Code c means x in [decode(c), decode(c) + scale]: distance from q to that interval
+        for (uint64_t i = begin; i < end; i++) {
+          const uint8_t* c = codes.data() + i * dim;
+          double sum = 0;
+          for (uint32_t d = 0; d < dim; d++) {
+            double lo = quantizer.minV[d] + c[d] * quantizer.scale[d];
+            double diff = q[d] < lo ? lo - q[d] : std::max(0.0, q[d] - lo - quantizer.scale[d]);
+            sum += diff * diff;
+          }
+          out[i - begin] = sum;
+        }
+        return;
+      }
+      if (storeLayout == Layout::RowMajor) {
+        for (uint64_t i = begin; i < end; i++) out[i - begin] = kernels.row(q, base + i * dim, dim);
+        return;
+      }
+      double tmp[L2_BLOCK];
+      uint64_t i = begin;
+      while (i < end) {
+        uint64_t blockStart = i / L2_BLOCK * L2_BLOCK;
+        kernels.block8(q, base + blockStart * dim, dim, tmp);
+        uint64_t stop = std::min(end, blockStart + L2_BLOCK);
+        for (; i < stop; i++) out[i - begin] = tmp[i - blockStart];
+      }
+    }
+
+  private:
+    double* owned = nullptr;
+    const double* base = nullptr;
+    uint64_t rows = 0;
+    uint32_t dim = 0;
+    Layout storeLayout = Layout::RowMajor;
+    L2Kernels kernels = selectL2Kernels("scalar");
+    CoordPrecision precision = CoordPrecision::Float64;
+    const Dataset* exactData = nullptr;
+    std::vector<float> f32;         // float32 rows
+    std::vector<uint8_t> codes;     // int8 rows
+    ScalarQuantizer quantizer;
+};
+
+// Floating point operations of one full pass (sub + mul + add per coordinate)
+inline double groundTruthFlops(const GroundTruthStore& store) {
+  return 3.0 * store.size() * store.dimension();
+}
+
+// --- Parallel Ground Truth Engine ---
+// Queries are grouped in small blocks and the blocks are sharded across a thread pool.
+// Each worker walks the dataset tile by tile (~256 KB of points) and runs every query of
+// its block against a tile while it is still in cache (query x data tiling). Every query
+// has a private top-k heap / hit list owned by exactly one worker, so nothing is shared.
+
+struct GroundTruthSet {
+  std::vector<std::vector<uint64_t>> ids;  // per query: k-NN ordered by distance, range ascending by id
+  std::vector<std::vector<double>> dists;  // squared distances, same order as ids
+};
+
+static const uint32_t GT_MAX_QUERY_BLOCK = 8;
+static const uint64_t GT_TILE_BYTES = 256 * 1024;
+
+// Calls onTile(query, begin, end, dist) for every (query, data tile) pair.
+template <class OnTile>
+void scanQueryTiles(const GroundTruthStore& store, const std::vector<std::vector<double>>& queries,
+                    unsigned threads, OnTile&& onTile) {
+  uint64_t tile = GT_TILE_BYTES / (store.dimension() * sizeof(double) + 1);
+  tile = std::max<uint64_t>(L2_BLOCK, tile / L2_BLOCK * L2_BLOCK);
+
+  // Small blocks when there are few queries per thread, so every core gets work
+  size_t perThread = (queries.size() + threads - 1) / std::max(1u, threads);
+  size_t queryBlock = std::max<size_t>(1, std::min<size_t>(GT_MAX_QUERY_BLOCK, perThread));
+  size_t blocks = (queries.size() + queryBlock - 1) / queryBlock;
+
+  parallelFor(blocks, threads, [&](size_t b, unsigned) {
+    std::vector<double> dist(tile);
+    size_t qBegin = b * queryBlock, qEnd = std::min(queries.size(), qBegin + queryBlock);
+    for (uint64_t begin = 0; begin < store.size(); begin += tile) {
+      uint64_t end = std::min(store.size(), begin + tile);
+      for (size_t q = qBegin; q < qEnd; q++) {
+        store.distances(queries[q].data(), begin, end, dist.data());
+        onTile(q, begin, end, dist.data());
+      }
+    }
+  });
+}
+
+// Exact k nearest neighbours of every query (ties broken by id).
+inline GroundTruthSet knnGroundTruthAll(const GroundTruthStore& store, const std::vector<std::vector<double>>& queries,
+                                        uint32_t K, unsigned threads) {
+  typedef std::pair<double, uint64_t> Candidate;
+  std::vector<std::vector<Candidate>> heaps(queries.size()); // max-heaps of the best K so far
+  for (auto& h : heaps) h.reserve(K + 1);
+
+  scanQueryTiles(store, queries, threads, [&](size_t q, uint64_t begin, uint64_t end, const double* dist) {
+    std::vector<Candidate>& heap = heaps[q];
+    bool exact = store.isExact();
+    for (uint64_t i = begin; i < end; i++) {
+      // Lower bound first: only points that could enter the top-K are re-ranked exactly
+      if (!exact && heap.size() == K && Candidate(dist[i - begin], i) > heap.front()) continue;
+      Candidate cand(exact ? dist[i - begin] : store.exactDistance(queries[q].data(), i), i);
+      if (heap.size() < K) {
+        heap.push_back(cand);
+        std::push_heap(heap.begin(), heap.end());
+      } else if (cand < heap.front()) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = cand;
+        std::push_heap(heap.begin(), heap.end());
+      }
+    }
+  });
+
+  GroundTruthSet out;
+  out.ids.resize(queries.size());
+  out.dists.resize(queries.size());
+  for (size_t q = 0; q < queries.size(); q++) {
+    std::sort_heap(heaps[q].begin(), heaps[q].end());
+    for (const Candidate& c : heaps[q]) {
+      out.ids[q].push_back(c.second);
+      out.dists[q].push_back(c.first);
+    }
+  }
+  return out;
+}
+
+// Exact range answer of every query: all points with ||p - q||^2 <= radius^2, ascending by id.
+inline GroundTruthSet rangeGroundTruthAll(const GroundTruthStore& store, const std::vector<std::vector<double>>& queries,
+                                          double radius, unsigned threads) {
+  const double r2 = radius * radius;
+  GroundTruthSet out;
+  out.ids.resize(queries.size());
+  out.dists.resize(queries.size());
+
+  // Tiles are visited in increasing order, so each hit list comes out already sorted
+  scanQueryTiles(store, queries, threads, [&](size_t q, uint64_t begin, uint64_t end, const double* dist) {
+    bool exact = store.isExact();
+    for (uint64_t i = begin; i < end; i++) {
+      if (dist[i - begin] > r2) continue;
+      double d2 = exact ? dist[i - begin] : store.exactDistance(queries[q].data(), i);
+      if (d2 <= r2) {
+        out.ids[q].push_back(i);
+        out.dists[q].push_back(d2);
+      }
+    }
+  });
+  return out;
+}
+
+// --- Block-wise Ground Truth ---
+// For datasets that do not fit in memory (--memory-budget): the dataset is read in chunks
+// of at most chunkRows rows and each chunk is scanned with the same query x tile sharding
+// as scanQueryTiles, merging into the per-query top-k heaps / hit lists. Peak memory is
+// one chunk plus the answers; nothing of the dataset stays resident between chunks.
+
+// Calls onTile(query, firstId, count, dist) for every (query, tile of a chunk) pair.
+template <class OnTile>
+void scanChunkedTiles(DatasetChunkReader& reader, size_t chunkRows, const std::vector<std::vector<double>>& queries,
+                      const L2Kernels& kernels, unsigned threads, OnTile&& onTile) {
+  const uint32_t dim = reader.dimension();
+  uint64_t tile = std::max<uint64_t>(1, GT_TILE_BYTES / (dim * sizeof(double) + 1));
+  size_t perThread = (queries.size() + threads - 1) / std::max(1u, threads);
+  size_t queryBlock = std::max<size_t>(1, std::min<size_t>(GT_MAX_QUERY_BLOCK, perThread));
+  size_t blocks = (queries.size() + queryBlock - 1) / queryBlock;
+
+  std::vector<double> chunk;
+  reader.rewind();
+  for (size_t n; (n = reader.read(chunk, std::max<size_t>(1, chunkRows))) > 0;) {
+    uint64_t firstId = reader.position() - n;
+    parallelFor(blocks, threads, [&](size_t b, unsigned) {
+      std::vector<double> dist(tile);
+      size_t qBegin = b * queryBlock, qEnd = std::min(queries.size(), qBegin + queryBlock);
+      for (uint64_t begin = 0; begin < n; begin += tile) {
+        uint64_t end = std::min<uint64_t>(n, begin + tile);
+        for (size_t q = qBegin; q < qEnd; q++) {
+          for (uint64_t i = begin; i < end; i++) dist[i - begin] = kernels.row(queries[q].data(), &chunk[i * dim], dim);
+          onTile(q, firstId + begin, end - begin, dist.data());
+        }
+      }
+    });
+  }
+}
+
+inline GroundTruthSet knnGroundTruthStreamed(DatasetChunkReader& reader, size_t chunkRows,
+                                             const std::vector<std::vector<double>>& queries, uint32_t K,
+                                             const L2Kernels& kernels, unsigned threads) {
+  typedef std::pair<double, uint64_t> Candidate;
+  std::vector<std::vector<Candidate>> heaps(queries.size());
+  for (auto& h : heaps) h.reserve(K + 1);
+
+  scanChunkedTiles(reader, chunkRows, queries, kernels, threads,
+                   [&](size_t q, uint64_t firstId, uint64_t count, const double* dist) {
+    std::vector<Candidate>& heap = heaps[q];
+    for (uint64_t i = 0; i < count; i++) {
+      Candidate cand(dist[i], firstId + i);
+      if (heap.size() < K) {
+        heap.push_back(cand);
+        std::push_heap(heap.begin(), heap.end());
+      } else if (cand < heap.front()) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = cand;
+        std::push_heap(heap.begin(), heap.end());
+      }
+    }
+  });
+
+  GroundTruthSet out;
+  out.ids.resize(queries.size());
+  out.dists.resize(queries.size());
+  for (size_t q = 0; q < queries.size(); q++) {
+    std::sort_heap(heaps[q].begin(), heaps[q].end());
+    for (const Candidate& c : heaps[q]) {
+      out.ids[q].push_back(c.second);
+      out.dists[q].push_back(c.first);
+    }
+  }
+  return out;
+}
+
+inline GroundTruthSet rangeGroundTruthStreamed(DatasetChunkReader& reader, size_t chunkRows,
+                                               const std::vector<std::vector<double>>& queries, double radius,
+                                               const L2Kernels& kernels, unsigned threads) {
+  const double r2 = radius * radius;
+  GroundTruthSet out;
+  out.ids.resize(queries.size());
+  out.dists.resize(queries.size());
+
+  // Chunks and tiles arrive in increasing id order, so hit lists come out sorted
+  scanChunkedTiles(reader, chunkRows, queries, kernels, threads,
+                   [&](size_t q, uint64_t firstId, uint64_t count, const double* dist) {
+    for (uint64_t i = 0; i < count; i++) {
+      if (dist[i] <= r2) {
+        out.ids[q].push_back(firstId + i);
+        out.dists[q].push_back(dist[i]);
+      }
+    }
+  });
+  return out;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "dataset_io.h"
+#include "ground_truth.h"
+
+// --- Persisted Ground Truth Cache ---
+// Exact answers are computed once and stored in <dir>/<dataset>_<kind>_<key>.gt.
+// The key hashes the dataset values, the query vectors and the query parameter (K or
+// radius), so any change to them produces a different file. It hashes the loaded matrix
+// rather than the file bytes, so the CSV and the float64 .bin of a dataset share a cache.
+//
+// File layout (little-endian):
+//   magic "RTGTCAC1" | uint32 version | uint32 kind (0 = kNN, 1 = Range) | uint64 key | uint64 queries
+//   per query: uint64 count | count x uint64 ids | count x double squared distances
+
+enum class GroundTruthKind : uint32_t { Knn = 0, Range = 1 };
+
+static const char GT_CACHE_MAGIC[8] = {'R', 'T', 'G', 'T', 'C', 'A', 'C', '1'};
+
+// 64-bit hash of a byte range, processed 8 bytes at a time (seedable, so calls chain).
+inline uint64_t hashBytes(const void* data, size_t len, uint64_t seed) {
+  const uint64_t C1 = 0x9E3779B97F4A7C15ULL, C2 = 0xBF58476D1CE4E5B9ULL;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint64_t h = seed ^ (len * C1);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    h ^= w * C1;
+    h = ((h << 31) | (h >> 33)) * C2;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, p + i, len - i);
+  h ^= tail * C1;
+  h ^= h >> 29; h *= C2; h ^= h >> 32;
+  return h;
+}
+
+// Hash of the dataset matrix (dimension, dtype and values). Reads every row once.
+inline uint64_t hashDataset(const Dataset& data) {
+  uint64_t header[3] = {data.size(), data.dimension(), static_cast<uint64_t>(data.dtype())};
+  uint64_t h = hashBytes(header, sizeof(header), 0);
+  return hashBytes(data.rawData(), data.size() * data.dimension() * dtypeSize(data.dtype()), h);
+}
+
+// Streamed variant for --memory-budget runs: chains the hash row by row over the rows read
+// as double, so it does not depend on the chunk size. It differs from hashDataset, so
+// budgeted runs keep their own cache entries.
+inline uint64_t hashDatasetStreamed(DatasetChunkReader& reader, size_t chunkRows) {
+  uint64_t dim = reader.dimension();
+  uint64_t h = hashBytes(&dim, sizeof(dim), 0);
+  std::vector<double> chunk;
+  reader.rewind();
+  for (size_t n; (n = reader.read(chunk, std::max<size_t>(1, chunkRows))) > 0;) {
+    for (size_t i = 0; i < n; i++) h = hashBytes(&chunk[i * reader.dimension()], reader.dimension() * sizeof(double), h);
+  }
+  return hashBytes(&h, sizeof(h), reader.position());
+}
+
+inline uint64_t groundTruthCacheKey(uint64_t datasetHash, const std::vector<std::vector<double>>& queries,
+                                    GroundTruthKind kind, double param) {
+  uint64_t h = hashBytes(&datasetHash, sizeof(datasetHash), static_cast<uint64_t>(kind));
+  for (const auto& q : queries) h = hashBytes(q.data(), q.size() * sizeof(double), h);
+  return hashBytes(&param, sizeof(param), h);
+}
+
+inline std::string groundTruthCachePath(const std::string& dir, const std::string& datasetName,
+                                        GroundTruthKind kind, uint64_t key) {
+  std::ostringstream name;
+  name << datasetName << (kind == GroundTruthKind::Knn ? "_knn_" : "_range_")
+       << std::hex << std::setw(16) << std::setfill('0') << key << ".gt";
+  return (std::filesystem::path(dir) / name.str()).string();
+}
+
+inline void saveGroundTruth(const std::string& path, GroundTruthKind kind, uint64_t key, const GroundTruthSet& gt) {
+  std::filesystem::path p(path);
+  if (p.has_parent_path()) std::filesystem::create_directories(p.parent_path());
+
+  // Written to a temporary name first so an interrupted run never leaves a truncated cache
+  std::string tmpPath = path + ".tmp";
+  std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+  uint32_t version = 1, k = static_cast<uint32_t>(kind);
+  uint64_t queries = gt.ids.size();
+  out.write(GT_CACHE_MAGIC, sizeof(GT_CACHE_MAGIC));
+  out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  out.write(reinterpret_cast<const char*>(&k), sizeof(k));
+  out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+  out.write(reinterpret_cast<const char*>(&queries), sizeof(queries));
+  for (size_t q = 0; q < gt.ids.size(); q++) {
+    uint64_t count = gt.ids[q].size();
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(gt.ids[q].data()), count * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(gt.dists[q].data()), count * sizeof(double));
+  }
+  out.close();
+  if (!out) throw std::runtime_error("Failed to write ground truth cache " + tmpPath);
+  std::filesystem::rename(tmpPath, path);
+}
+
+// Returns false (leaving gt untouched) if the file is missing, corrupt or has another key.
+inline bool loadGroundTruth(const std::string& path, GroundTruthKind kind, uint64_t key, size_t expectedQueries,
+                            GroundTruthSet& gt) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) return false;
+  uint64_t fileSize = std::filesystem::file_size(path);
+
+  char magic[8];
+  uint32_t version = 0, k = 0;
+  uint64_t fileKey = 0, queries = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  in.read(reinterpret_cast<char*>(&k), sizeof(k));
+  in.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+  in.read(reinterpret_cast<char*>(&queries), sizeof(queries));
+  if (!in || memcmp(magic, GT_CACHE_MAGIC, sizeof(magic)) != 0 || version != 1 ||
+      k != static_cast<uint32_t>(kind) || fileKey != key || queries != expectedQueries) {
+    return false;
+  }
+
+  GroundTruthSet loaded;
+  loaded.ids.resize(queries);
+  loaded.dists.resize(queries);
+  for (uint64_t q = 0; q < queries; q++) {
+    uint64_t count = 0;
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || count > fileSize / (sizeof(uint64_t) + sizeof(double))) return false;
+    loaded.ids[q].resize(count);
+    loaded.dists[q].resize(count);
+    in.read(reinterpret_cast<char*>(loaded.ids[q].data()), count * sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(loaded.dists[q].data()), count * sizeof(double));
+    if (!in) return false;
+  }
+  gt = std::move(loaded);
+  return true;
+}
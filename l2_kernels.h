@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <immintrin.h>
+
+// --- Squared L2 Kernels ---
+// Two shapes of kernel, each with scalar / AVX2 / AVX-512 versions:
+//  * row:    one query vs one point (both contiguous, row-major).
+//  * block8: one query vs a block of 8 points stored column-blocked
+//            (block[d * 8 + j] = coordinate d of point j), 64-byte aligned.
+// The SIMD versions are compiled with target attributes, so no -mavx flags are
+// needed; selectL2Kernels() picks the best one the running CPU supports.
+// All kernels return squared distances: comparisons against r^2 avoid the sqrt.
+
+static const uint32_t L2_BLOCK = 8;
+
+inline double l2SquaredScalar(const double* a, const double* b, uint32_t dim) {
+  double sum = 0;
+  for (uint32_t i = 0; i < dim; ++i) {
+    double diff = a[i] - b[i];
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+inline void l2SquaredBlock8Scalar(const double* q, const double* block, uint32_t dim, double* out) {
+  for (uint32_t j = 0; j < L2_BLOCK; j++) out[j] = 0;
+  for (uint32_t d = 0; d < dim; d++) {
+    for (uint32_t j = 0; j < L2_BLOCK; j++) {
+      double diff = block[d * L2_BLOCK + j] - q[d];
+      out[j] += diff * diff;
+    }
+  }
+}
+
+__attribute__((target("avx2,fma")))
+inline double l2SquaredAvx2(const double* a, const double* b, uint32_t dim) {
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+  uint32_t i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+    __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+    acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+    acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+  }
+  for (; i + 4 <= dim; i += 4) {
+    __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+    acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+  }
+  acc0 = _mm256_add_pd(acc0, acc1);
+  __m128d lo = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+  lo = _mm_add_sd(lo, _mm_unpackhi_pd(lo, lo));
+  double sum = _mm_cvtsd_f64(lo);
+  for (; i < dim; ++i) {
+    double diff = a[i] - b[i];
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+__attribute__((target("avx2,fma")))
+inline void l2SquaredBlock8Avx2(const double* q, const double* block, uint32_t dim, double* out) {
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+  for (uint32_t d = 0; d < dim; d++) {
+    __m256d qd = _mm256_broadcast_sd(q + d);
+    __m256d d0 = _mm256_sub_pd(_mm256_load_pd(block + d * L2_BLOCK), qd);
+    __m256d d1 = _mm256_sub_pd(_mm256_load_pd(block + d * L2_BLOCK + 4), qd);
+    acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+    acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+  }
+  _mm256_storeu_pd(out, acc0);
+  _mm256_storeu_pd(out + 4, acc1);
+}
+
+__attribute__((target("avx512f")))
+inline double l2SquaredAvx512(const double* a, const double* b, uint32_t dim) {
+  __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+  uint32_t i = 0;
+  for (; i + 16 <= dim; i += 16) {
+    __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+    __m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8));
+    acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+    acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+  }
+  for (; i < dim; i += 8) {
+    // Masked load handles the tail without a scalar loop
+    __mmask8 m = (dim - i >= 8) ? 0xFF : static_cast<__mmask8>((1u << (dim - i)) - 1);
+    __m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i));
+    acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+  }
+  return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+inline void l2SquaredBlock8Avx512(const double* q, const double* block, uint32_t dim, double* out) {
+  __m512d acc = _mm512_setzero_pd();
+  for (uint32_t d = 0; d < dim; d++) {
+    __m512d diff = _mm512_sub_pd(_mm512_load_pd(block + d * L2_BLOCK), _mm512_set1_pd(q[d]));
+    acc = _mm512_fmadd_pd(diff, diff, acc);
+  }
+  _mm512_storeu_pd(out, acc);
+}
+
+struct L2Kernels {
+  std::string name;
+  double (*row)(const double* a, const double* b, uint32_t dim);
+  void (*block8)(const double* q, const double* block, uint32_t dim, double* out);
+};
+
+// Picks the widest kernel supported by the CPU. "requested" may force
+// scalar/avx2/avx512 (falls back to the best available if unsupported).
+inline L2Kernels selectL2Kernels(const std::string& requested = "auto") {
+  __builtin_cpu_init();
+  bool hasAvx512 = __builtin_cpu_supports("avx512f");
+  bool hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+  if (requested == "scalar") return {"scalar", l2SquaredScalar, l2SquaredBlock8Scalar};
+  if (hasAvx512 && (requested == "auto" || requested == "avx512")) return {"avx512", l2SquaredAvx512, l2SquaredBlock8Avx512};
+  if (hasAvx2) return {"avx2", l2SquaredAvx2, l2SquaredBlock8Avx2};
+  return {"scalar", l2SquaredScalar, l2SquaredBlock8Scalar};
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <random>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#include "dataset_io.h"
+
+// --- Carga Mista ---
+// O índice de produção recebe atualizações contínuas, mas o benchmark só mede construção +
+// consultas. O modo --workload reproduz uma sequência de inserções, remoções e consultas
+// k-NN/Range numa proporção fixa (ex: 90/5/5) sobre uma cópia do índice. Aqui ficam:
+//
+//  * WorkloadMix / WorkloadGenerator: proporção das operações e sorteio reprodutível;
+//  * LivePointSet: pontos vivos do índice (linhas do dataset + pontos inseridos), de onde
+//    saem as remoções e as coordenadas dos novos pontos;
+//  * ChurnLog: o que mudou no índice (ids removidos, pontos inseridos ainda vivos), gravado
+//    em <índice>.churn para o validador calcular o Ground Truth sobre o conjunto vivo.
+
+enum class WorkloadOp { Insert = 0, Delete = 1, Knn = 2, Range = 3 };
+
+static const int WORKLOAD_OP_COUNT = 4;
+
+inline const char* workloadOpName(WorkloadOp op) {
+  static const char* names[WORKLOAD_OP_COUNT] = {"Insercao", "Remocao", "kNN", "Range"};
+  return names[static_cast<int>(op)];
+}
+
+struct WorkloadMix {
+  double weights[WORKLOAD_OP_COUNT] = {0, 0, 0, 0};  // Inserção, remoção, k-NN, Range
+
+  // "I/D/C" (consultas divididas igualmente entre k-NN e Range) ou "I/D/K/R", em pesos relativos
+  static WorkloadMix parse(const std::string& spec) {
+    std::vector<double> parts;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, '/')) {
+      double w = std::stod(item);
+      if (w < 0) throw std::invalid_argument("Proporção negativa em --workload: " + spec);
+      parts.push_back(w);
+    }
+    WorkloadMix mix;
+    if (parts.size() == 3) {
+      mix.weights[0] = parts[0];
+      mix.weights[1] = parts[1];
+      mix.weights[2] = mix.weights[3] = parts[2] / 2;
+    } else if (parts.size() == 4) {
+      std::copy(parts.begin(), parts.end(), mix.weights);
+    } else {
+      throw std::invalid_argument("Use --workload=I/D/C ou I/D/K/R (ex: 90/5/5): " + spec);
+    }
+    if (std::accumulate(mix.weights, mix.weights + WORKLOAD_OP_COUNT, 0.0) <= 0) {
+      throw std::invalid_argument("Proporções de --workload somam zero: " + spec);
+    }
+    return mix;
+  }
+
+  // Ex: "90/5/2.5/2.5" em percentuais
+  std::string describe() const {
+    double total = std::accumulate(weights, weights + WORKLOAD_OP_COUNT, 0.0);
+    std::ostringstream out;
+    for (int i = 0; i < WORKLOAD_OP_COUNT; i++) out << (i ? "/" : "") << 100.0 * weights[i] / total;
+    return out.str();
+  }
+};
+
+class WorkloadGenerator {
+  public:
+    WorkloadGenerator(const WorkloadMix& mix, uint64_t seed)
+        : gen(seed), dist(mix.weights, mix.weights + WORKLOAD_OP_COUNT) {}
+
+    WorkloadOp next() { return static_cast<WorkloadOp>(dist(gen)); }
+
+  private:
+    std::mt19937_64 gen;
+    std::discrete_distribution<int> dist;
+};
+
+// O que a carga mudou no índice em relação ao dataset. Formato de <índice>.churn:
+//   "RTCHURN1" | uint32 dim | uint64 removidos | uint64 id[removidos] |
+//   uint64 inseridos | por inserido: int64 id | double coords[dim]
+struct ChurnLog {
+  uint32_t dimension = 0;
+  std::vector<uint64_t> deleted;                    // Linhas do dataset removidas do índice
+  std::vector<SpatialIndex::id_type> insertedIds;   // Pontos inseridos ainda presentes
+  std::vector<double> insertedCoords;               // insertedIds.size() x dimension
+
+  void save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint64_t deletedCount = deleted.size(), insertedCount = insertedIds.size();
+    out.write("RTCHURN1", 8);
+    out.write(reinterpret_cast<const char*>(&dimension), sizeof(dimension));
+    out.write(reinterpret_cast<const char*>(&deletedCount), sizeof(deletedCount));
+    out.write(reinterpret_cast<const char*>(deleted.data()), deletedCount * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(&insertedCount), sizeof(insertedCount));
+    for (size_t i = 0; i < insertedIds.size(); i++) {
+      out.write(reinterpret_cast<const char*>(&insertedIds[i]), sizeof(SpatialIndex::id_type));
+      out.write(reinterpret_cast<const char*>(&insertedCoords[i * dimension]), dimension * sizeof(double));
+    }
+    if (!out) throw std::runtime_error("Falha ao gravar " + path);
+  }
+
+  static ChurnLog load(const std::string& path, uint32_t expectedDim) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) throw std::runtime_error("Arquivo de carga mista não encontrado: " + path);
+    char magic[8];
+    ChurnLog log;
+    uint64_t deletedCount = 0, insertedCount = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&log.dimension), sizeof(log.dimension));
+    if (!in || memcmp(magic, "RTCHURN1", 8) != 0) throw std::runtime_error("Arquivo de carga mista inválido: " + path);
+    if (log.dimension != expectedDim) throw std::runtime_error("Dimensão do arquivo de carga mista difere: " + path);
+    in.read(reinterpret_cast<char*>(&deletedCount), sizeof(deletedCount));
+    log.deleted.resize(deletedCount);
+    in.read(reinterpret_cast<char*>(log.deleted.data()), deletedCount * sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(&insertedCount), sizeof(insertedCount));
+    log.insertedIds.resize(insertedCount);
+    log.insertedCoords.resize(insertedCount * log.dimension);
+    for (uint64_t i = 0; i < insertedCount; i++) {
+      in.read(reinterpret_cast<char*>(&log.insertedIds[i]), sizeof(SpatialIndex::id_type));
+      in.read(reinterpret_cast<char*>(&log.insertedCoords[i * log.dimension]), log.dimension * sizeof(double));
+    }
+    if (!in) throw std::runtime_error("Arquivo de carga mista truncado: " + path);
+    return log;
+  }
+
+  // Conjunto vivo em linhas float64 (dataset sem os removidos, depois os inseridos) e o id
+  // de cada linha no índice
+  void liveRows(const Dataset& data, std::vector<double>& values, std::vector<uint64_t>& ids) const {
+    std::vector<bool> removed(data.size(), false);
+    for (uint64_t id : deleted) {
+      if (id < removed.size()) removed[id] = true;
+    }
+    values.clear();
+    ids.clear();
+    std::vector<double> scratch(dimension);
+    for (uint64_t i = 0; i < data.size(); i++) {
+      if (removed[i]) continue;
+      const double* row = data.row(i, scratch.data());
+      values.insert(values.end(), row, row + dimension);
+      ids.push_back(i);
+    }
+    values.insert(values.end(), insertedCoords.begin(), insertedCoords.end());
+    for (SpatialIndex::id_type id : insertedIds) ids.push_back(static_cast<uint64_t>(id));
+  }
+};
+
+// Pontos vivos do índice. As remoções sorteiam um ponto vivo; os novos pontos ficam entre
+// duas linhas vivas sorteadas (a + u·(b - a), u uniforme), dentro da distribuição do dataset,
+// e recebem ids a partir de data.size().
+class LivePointSet {
+  public:
+    LivePointSet(const Dataset& data, uint64_t seed)
+        : dataset(data), dimension(data.dimension()), nextId(static_cast<SpatialIndex::id_type>(data.size())),
+          gen(seed), scratchA(dimension), scratchB(dimension) {
+      live.resize(data.size());
+      std::iota(live.begin(), live.end(), SpatialIndex::id_type(0));
+    }
+
+    size_t size() const { return live.size(); }
+
+    // Gera um novo ponto (coordenadas em coords) e devolve o seu id
+    SpatialIndex::id_type prepareInsert(std::vector<double>& coords) {
+      std::uniform_real_distribution<double> mix(0.0, 1.0);
+      coords.resize(dimension);
+      if (live.empty()) {
+        std::fill(coords.begin(), coords.end(), 0.0);
+      } else {
+        const double* a = coordinates(live[pick()], scratchA.data());
+        const double* b = coordinates(live[pick()], scratchB.data());
+        double u = mix(gen);
+        for (uint32_t d = 0; d < dimension; d++) coords[d] = a[d] + u * (b[d] - a[d]);
+      }
+      SpatialIndex::id_type id = nextId++;
+      inserted[id] = coords;
+      live.push_back(id);
+      return id;
+    }
+
+    // Sorteia e retira um ponto vivo (coordenadas em coords); o conjunto não pode estar vazio
+    SpatialIndex::id_type prepareDelete(std::vector<double>& coords) {
+      size_t pos = pick();
+      SpatialIndex::id_type id = live[pos];
+      const double* p = coordinates(id, scratchA.data());
+      coords.assign(p, p + dimension);
+      live[pos] = live.back();
+      live.pop_back();
+      if (!inserted.erase(id)) deleted.push_back(static_cast<uint64_t>(id));
+      return id;
+    }
+
+    ChurnLog log() const {
+      ChurnLog out;
+      out.dimension = dimension;
+      out.deleted = deleted;
+      std::sort(out.deleted.begin(), out.deleted.end());
+      for (SpatialIndex::id_type id : live) {
+        auto it = inserted.find(id);
+        if (it == inserted.end()) continue;
+        out.insertedIds.push_back(id);
+        out.insertedCoords.insert(out.insertedCoords.end(), it->second.begin(), it->second.end());
+      }
+      return out;
+    }
+
+  private:
+    const Dataset& dataset;
+    uint32_t dimension;
+    SpatialIndex::id_type nextId;
+    std::mt19937_64 gen;
+    std::vector<SpatialIndex::id_type> live;
+    std::unordered_map<SpatialIndex::id_type, std::vector<double>> inserted;
+    std::vector<uint64_t> deleted;
+    std::vector<double> scratchA, scratchB;
+
+    size_t pick() { return std::uniform_int_distribution<size_t>(0, live.size() - 1)(gen); }
+
+    const double* coordinates(SpatialIndex::id_type id, double* scratch) const {
+      if (static_cast<uint64_t>(id) < dataset.size()) return dataset.row(static_cast<uint64_t>(id), scratch);
+      return inserted.at(id).data();
+    }
+};
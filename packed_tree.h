@@ -0,0 +1,205 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "tree_params.h"
+
+// --- Empacotamento de Nós (Hilbert Packing) ---
+// O bulk loader público da libspatialindex só faz STR. PackedTreeWriter recebe os pontos já
+// ordenados (curva de Hilbert) e grava a árvore de baixo para cima, direto no storage:
+// cada folha recebe os próximos perLeaf pontos e cada nó interno as próximas perIndex
+// entradas do nível de baixo, com perLeaf/perIndex = capacidade × fill factor do bulk
+// loading (mesma regra do STR da biblioteca). Só o último nó de cada nível pode ficar
+// incompleto. Em memória fica apenas o nó aberto de cada nível, então o modo external
+// alimenta o writer direto do merge da ordenação externa.
+//
+// As páginas usam o layout de Node::storeToByteArray (o mesmo da cópia em parallel_build.h):
+//   uint32 tipo | uint32 nível | uint32 filhos |
+//   por filho: low[dim] high[dim] | id_type id | uint32 tamanho (0) | MBR do nó: low[dim] high[dim]
+// A árvore é criada vazia pela biblioteca e writePackedTreeHeader troca a raiz e as
+// estatísticas do cabeçalho (RTree::storeHeader):
+//   id_type raiz | parâmetros da árvore (tamanho fixo) |
+//   uint32 nós | uint64 dados | uint32 altura | uint32 nósPorNível[altura]
+
+// Reescreve o cabeçalho da árvore vazia em headerPage (altura 1) com a raiz e as estatísticas
+// da árvore gravada por fora da biblioteca e apaga a raiz vazia. nodesPerLevel[l] é o número
+// de nós no nível l; a altura é nodesPerLevel.size().
+inline void writePackedTreeHeader(SpatialIndex::IStorageManager& storage, SpatialIndex::id_type headerPage,
+                                  SpatialIndex::id_type root, const std::vector<uint64_t>& nodesPerLevel,
+                                  uint64_t dataCount) {
+  uint32_t len;
+  uint8_t* bytes;
+  storage.loadByteArray(headerPage, len, &bytes);
+  std::vector<uint8_t> header(bytes, bytes + len);
+  delete[] bytes;
+
+  const size_t statsBytes = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t);
+  if (header.size() <= sizeof(SpatialIndex::id_type) + statsBytes) {
+    throw std::runtime_error("Cabeçalho da R-Tree com layout inesperado");
+  }
+  SpatialIndex::id_type emptyRoot;
+  memcpy(&emptyRoot, header.data(), sizeof(emptyRoot));
+  header.resize(header.size() - statsBytes);
+  memcpy(header.data(), &root, sizeof(root));
+
+  auto append = [&](const void* value, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(value);
+    header.insert(header.end(), p, p + size);
+  };
+  uint32_t height = static_cast<uint32_t>(nodesPerLevel.size());
+  uint32_t nodes = 0;
+  for (uint64_t c : nodesPerLevel) nodes += static_cast<uint32_t>(c);
+  append(&nodes, sizeof(nodes));
+  append(&dataCount, sizeof(dataCount));
+  append(&height, sizeof(height));
+  for (uint64_t c : nodesPerLevel) {
+    uint32_t count = static_cast<uint32_t>(c);
+    append(&count, sizeof(count));
+  }
+
+  SpatialIndex::id_type page = headerPage;
+  storage.storeByteArray(page, static_cast<uint32_t>(header.size()), header.data());
+  storage.deleteByteArray(emptyRoot);
+}
+
+class PackedTreeWriter {
+  public:
+    PackedTreeWriter(SpatialIndex::IStorageManager& target, uint32_t dim, const TreeParams& params)
+        : storage(target), dimension(dim) {
+      // Um nó com mais filhos que a capacidade faria Node::loadFromByteArray escrever além
+      // dos vetores do nó (alocados com capacidade + 1 entradas)
+      if (!(params.bulkFillFactor > 0.0 && params.bulkFillFactor <= 1.0)) {
+        throw std::invalid_argument("Fill factor do empacotamento fora de (0, 1]: " + std::to_string(params.bulkFillFactor));
+      }
+      if (params.leafCapacity < 1 || params.indexCapacity < 2) {
+        throw std::invalid_argument("Empacotamento exige capacidade de folha >= 1 e de nó interno >= 2");
+      }
+      perLeaf = std::min(params.leafCapacity,
+                         std::max<uint32_t>(1, static_cast<uint32_t>(std::floor(params.leafCapacity * params.bulkFillFactor))));
+      perIndex = std::min(params.indexCapacity,
+                          std::max<uint32_t>(2, static_cast<uint32_t>(std::floor(params.indexCapacity * params.bulkFillFactor))));
+    }
+
+    // Próximo ponto na ordem de empacotamento
+    void add(SpatialIndex::id_type id, const double* point) {
+      addEntry(0, point, point, id);
+      dataCount++;
+    }
+
+    // Fecha os nós abertos de baixo para cima e devolve a página da raiz
+    SpatialIndex::id_type finish() {
+      if (dataCount == 0) throw std::runtime_error("Dataset vazio: nada a construir");
+      for (size_t l = 0; l < open.size(); l++) {
+        // Uma única entrada no nível mais alto: o nó para o qual ela aponta é a raiz
+        if (l > 0 && l + 1 == open.size() && open[l].count == 1) {
+          SpatialIndex::id_type root;
+          memcpy(&root, open[l].bytes.data() + NODE_HEADER + 2 * dimension * sizeof(double), sizeof(root));
+          return root;
+        }
+        if (open[l].count > 0) closeNode(l);
+      }
+      throw std::runtime_error("Empacotamento sem raiz");
+    }
+
+    const std::vector<uint64_t>& levelCounts() const { return nodesPerLevel; }
+    uint64_t points() const { return dataCount; }
+    uint32_t leafEntries() const { return perLeaf; }
+    uint32_t indexEntries() const { return perIndex; }
+
+    uint64_t totalNodes() const {
+      uint64_t n = 0;
+      for (uint64_t c : nodesPerLevel) n += c;
+      return n;
+    }
+
+  private:
+    // Tipos gravados por Node::storeToByteArray
+    static constexpr uint32_t PERSISTENT_INDEX = 1;
+    static constexpr uint32_t PERSISTENT_LEAF = 2;
+    static constexpr size_t NODE_HEADER = 3 * sizeof(uint32_t);
+
+    struct OpenNode {
+      std::vector<uint8_t> bytes;
+      std::vector<double> low, high;
+      uint32_t count = 0;
+    };
+
+    SpatialIndex::IStorageManager& storage;
+    uint32_t dimension;
+    uint32_t perLeaf;
+    uint32_t perIndex;
+    uint64_t dataCount = 0;
+    std::vector<OpenNode> open;  // open[l]: nó em preenchimento no nível l
+    std::vector<uint64_t> nodesPerLevel;
+
+    void addEntry(uint32_t level, const double* low, const double* high, SpatialIndex::id_type id) {
+      if (level >= open.size()) open.resize(level + 1);
+      OpenNode& node = open[level];
+      if (node.count == 0) {
+        node.bytes.assign(NODE_HEADER, 0);
+        node.low.assign(low, low + dimension);
+        node.high.assign(high, high + dimension);
+      } else {
+        for (uint32_t d = 0; d < dimension; d++) {
+          node.low[d] = std::min(node.low[d], low[d]);
+          node.high[d] = std::max(node.high[d], high[d]);
+        }
+      }
+      const uint8_t* l = reinterpret_cast<const uint8_t*>(low);
+      const uint8_t* h = reinterpret_cast<const uint8_t*>(high);
+      const uint8_t* i = reinterpret_cast<const uint8_t*>(&id);
+      const uint32_t dataLength = 0;
+      const uint8_t* z = reinterpret_cast<const uint8_t*>(&dataLength);
+      node.bytes.insert(node.bytes.end(), l, l + dimension * sizeof(double));
+      node.bytes.insert(node.bytes.end(), h, h + dimension * sizeof(double));
+      node.bytes.insert(node.bytes.end(), i, i + sizeof(id));
+      node.bytes.insert(node.bytes.end(), z, z + sizeof(dataLength));
+      node.count++;
+      if (node.count == (level == 0 ? perLeaf : perIndex)) closeNode(level);
+    }
+
+    // Grava o nó aberto do nível e passa a sua entrada (MBR, página) para o nível de cima
+    void closeNode(uint32_t level) {
+      OpenNode& node = open[level];
+      uint32_t type = (level == 0) ? PERSISTENT_LEAF : PERSISTENT_INDEX;
+      memcpy(node.bytes.data(), &type, sizeof(type));
+      memcpy(node.bytes.data() + sizeof(uint32_t), &level, sizeof(level));
+      memcpy(node.bytes.data() + 2 * sizeof(uint32_t), &node.count, sizeof(node.count));
+      const uint8_t* l = reinterpret_cast<const uint8_t*>(node.low.data());
+      const uint8_t* h = reinterpret_cast<const uint8_t*>(node.high.data());
+      node.bytes.insert(node.bytes.end(), l, l + dimension * sizeof(double));
+      node.bytes.insert(node.bytes.end(), h, h + dimension * sizeof(double));
+
+      SpatialIndex::id_type page = SpatialIndex::StorageManager::NewPage;
+      storage.storeByteArray(page, static_cast<uint32_t>(node.bytes.size()), node.bytes.data());
+      if (level >= nodesPerLevel.size()) nodesPerLevel.resize(level + 1, 0);
+      nodesPerLevel[level]++;
+
+      // addEntry pode realocar "open": o MBR sai do nó antes da chamada
+      std::vector<double> low = std::move(node.low), high = std::move(node.high);
+      node.count = 0;
+      node.bytes.clear();
+      addEntry(level + 1, low.data(), high.data(), page);
+    }
+};
+
+// Cria a árvore vazia em "storage", empacota nela os pontos que feed(writer) entrega em ordem
+// e devolve a árvore carregada do cabeçalho reescrito
+template <class Feed>
+SpatialIndex::ISpatialIndex* packedBulkLoad(SpatialIndex::IStorageManager& storage, const TreeParams& params,
+                                            uint32_t dim, SpatialIndex::id_type& indexIdentifier, Feed&& feed) {
+  delete SpatialIndex::RTree::createNewRTree(storage, params.fillFactor, params.indexCapacity, params.leafCapacity, dim,
+                                             params.variant, indexIdentifier);
+  PackedTreeWriter writer(storage, dim, params);
+  feed(writer);
+  SpatialIndex::id_type root = writer.finish();
+  writePackedTreeHeader(storage, indexIdentifier, root, writer.levelCounts(), writer.points());
+  return SpatialIndex::RTree::loadRTree(storage, indexIdentifier);
+}
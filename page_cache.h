@@ -0,0 +1,244 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+// --- Buffer de Páginas ---
+// Camada de cache entre a R-Tree e o DiskStorageManager. Implementa IStorageManager,
+// então a árvore é criada/carregada sobre ela sem nenhuma outra mudança. Leituras que
+// acertam o cache não tocam o arquivo; escritas são write-through.
+//
+// Políticas de substituição:
+//  * lru: lista LRU única.
+//  * 2q:  2Q simplificado (Johnson & Shasha, 1994). Páginas novas entram numa fila FIFO
+//         (A1in, 25% da capacidade); só são promovidas à LRU principal (Am) se forem
+//         referenciadas de novo depois de sair da A1in (lembradas na fila fantasma A1out).
+//         Uma varredura longa passa só pela A1in e não expulsa as páginas quentes.
+//
+// A capacidade pode ser dada em bytes (--buffer=64MB) ou em páginas (--buffer=2000p).
+// Nós da árvore maiores que uma página de disco contam como um único item.
+
+enum class PagePolicy { LRU, TwoQ };
+
+struct PageCacheConfig {
+  uint64_t capacityBytes = 0;  // 0 = sem limite por bytes
+  uint64_t capacityPages = 0;  // 0 = sem limite por páginas
+  PagePolicy policy = PagePolicy::LRU;
+
+  bool enabled() const { return capacityBytes > 0 || capacityPages > 0; }
+};
+
+// Interpreta o tamanho do buffer: "<n>MB", "<n>KB", "<n>GB" ou "<n>p" (páginas).
+inline PageCacheConfig parsePageCacheConfig(const std::string& size, const std::string& policy) {
+  PageCacheConfig cfg;
+  if (policy == "2q") cfg.policy = PagePolicy::TwoQ;
+  else if (policy != "lru") throw std::invalid_argument("Política de buffer inválida: " + policy + " (use lru ou 2q)");
+
+  if (size.empty() || size == "0") return cfg;
+  size_t pos = 0;
+  double value = std::stod(size, &pos);
+  std::string unit = size.substr(pos);
+  if (unit == "p" || unit == "pages") cfg.capacityPages = static_cast<uint64_t>(value);
+  else if (unit == "KB") cfg.capacityBytes = static_cast<uint64_t>(value * 1024);
+  else if (unit == "MB" || unit.empty()) cfg.capacityBytes = static_cast<uint64_t>(value * 1024 * 1024);
+  else if (unit == "GB") cfg.capacityBytes = static_cast<uint64_t>(value * 1024 * 1024 * 1024);
+  else throw std::invalid_argument("Tamanho de buffer inválido: " + size + " (ex: 64MB, 2000p)");
+  return cfg;
+}
+
+struct PageCacheCounters {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+};
+
+class PageCache : public SpatialIndex::IStorageManager {
+  public:
+    PageCache(SpatialIndex::IStorageManager& underlying, const PageCacheConfig& cfg) : disk(underlying), config(cfg) {}
+
+    void loadByteArray(const SpatialIndex::id_type page, uint32_t& len, uint8_t** data) override {
+      auto it = entries.find(page);
+      if (it != entries.end()) {
+        counters.hits++;
+        touch(it->second);
+        const std::vector<uint8_t>& bytes = it->second.bytes;
+        len = static_cast<uint32_t>(bytes.size());
+        *data = new uint8_t[len];
+        memcpy(*data, bytes.data(), len);
+        return;
+      }
+
+      counters.misses++;
+      disk.loadByteArray(page, len, data);
+      insert(page, *data, len);
+    }
+
+    void storeByteArray(SpatialIndex::id_type& page, const uint32_t len, const uint8_t* const data) override {
+      disk.storeByteArray(page, len, data);
+      // Write-through: mantém a cópia em cache coerente, se existir
+      auto it = entries.find(page);
+      if (it != entries.end()) {
+        usedBytes -= it->second.bytes.size();
+        if (it->second.queue == Queue::A1in) a1inBytes -= it->second.bytes.size();
+        it->second.bytes.assign(data, data + len);
+        usedBytes += len;
+        if (it->second.queue == Queue::A1in) a1inBytes += len;
+        evictUntilFits();
+      }
+    }
+
+    void deleteByteArray(const SpatialIndex::id_type page) override {
+      disk.deleteByteArray(page);
+      erase(page);
+      forgetGhost(page);
+    }
+
+    void flush() override { disk.flush(); }
+
+    // Esvazia o buffer (páginas e fantasmas do 2Q), mantendo os contadores. Usado nas
+    // execuções com cache frio (--cold-cache).
+    void clear() {
+      entries.clear();
+      am.clear();
+      a1in.clear();
+      a1out.clear();
+      ghosts.clear();
+      usedBytes = a1inBytes = 0;
+    }
+
+    const PageCacheCounters& getCounters() const { return counters; }
+    uint64_t residentPages() const { return entries.size(); }
+    uint64_t residentBytes() const { return usedBytes; }
+    const PageCacheConfig& getConfig() const { return config; }
+
+  private:
+    enum class Queue { Am, A1in };
+    struct Entry {
+      std::vector<uint8_t> bytes;
+      Queue queue;
+      std::list<SpatialIndex::id_type>::iterator pos;
+    };
+
+    SpatialIndex::IStorageManager& disk;
+    PageCacheConfig config;
+    PageCacheCounters counters;
+    std::unordered_map<SpatialIndex::id_type, Entry> entries;
+    std::list<SpatialIndex::id_type> am;    // LRU (frente = mais recente)
+    std::list<SpatialIndex::id_type> a1in;  // FIFO de entrada do 2Q (frente = mais nova)
+    std::list<SpatialIndex::id_type> a1out; // fantasmas do 2Q: apenas IDs, sem dados
+    std::unordered_map<SpatialIndex::id_type, std::list<SpatialIndex::id_type>::iterator> ghosts;
+    uint64_t usedBytes = 0;
+    uint64_t a1inBytes = 0;
+
+    std::list<SpatialIndex::id_type>& listOf(Queue q) { return q == Queue::Am ? am : a1in; }
+
+    void touch(Entry& e) {
+      // No 2Q, acertos na A1in não mudam a posição (é uma FIFO)
+      if (e.queue == Queue::Am) am.splice(am.begin(), am, e.pos);
+    }
+
+    void insert(SpatialIndex::id_type page, const uint8_t* data, uint32_t len) {
+      Queue q = Queue::Am;
+      if (config.policy == PagePolicy::TwoQ) {
+        q = ghosts.count(page) ? Queue::Am : Queue::A1in;
+        forgetGhost(page);
+      }
+      std::list<SpatialIndex::id_type>& lst = listOf(q);
+      lst.push_front(page);
+      Entry& e = entries[page];
+      e.bytes.assign(data, data + len);
+      e.queue = q;
+      e.pos = lst.begin();
+      usedBytes += len;
+      if (q == Queue::A1in) a1inBytes += len;
+      evictUntilFits();
+    }
+
+    bool overCapacity() const {
+      if (config.capacityBytes > 0 && usedBytes > config.capacityBytes) return true;
+      if (config.capacityPages > 0 && entries.size() > config.capacityPages) return true;
+      return false;
+    }
+
+    bool a1inOverTarget() const {
+      if (config.capacityBytes > 0) return a1inBytes > config.capacityBytes / 4;
+      return a1in.size() > config.capacityPages / 4;
+    }
+
+    void evictUntilFits() {
+      while (overCapacity() && !entries.empty()) {
+        if (config.policy == PagePolicy::TwoQ && !a1in.empty() && (a1inOverTarget() || am.empty())) {
+          SpatialIndex::id_type victim = a1in.back();
+          erase(victim);
+          rememberGhost(victim);
+        } else if (!am.empty()) {
+          erase(am.back());
+        } else {
+          erase(a1in.back());
+        }
+        counters.evictions++;
+      }
+    }
+
+    void erase(SpatialIndex::id_type page) {
+      auto it = entries.find(page);
+      if (it == entries.end()) return;
+      usedBytes -= it->second.bytes.size();
+      if (it->second.queue == Queue::A1in) a1inBytes -= it->second.bytes.size();
+      listOf(it->second.queue).erase(it->second.pos);
+      entries.erase(it);
+    }
+
+    void rememberGhost(SpatialIndex::id_type page) {
+      a1out.push_front(page);
+      ghosts[page] = a1out.begin();
+      // A1out lembra até metade das páginas residentes (mínimo de 16)
+      size_t limit = std::max<size_t>(16, entries.size() / 2);
+      while (a1out.size() > limit) {
+        ghosts.erase(a1out.back());
+        a1out.pop_back();
+      }
+    }
+
+    void forgetGhost(SpatialIndex::id_type page) {
+      auto it = ghosts.find(page);
+      if (it == ghosts.end()) return;
+      a1out.erase(it->second);
+      ghosts.erase(it);
+    }
+};
+
+// --- Contador de Leituras ---
+// Conta as leituras de nós feitas pela árvore: RTree::readNode faz exatamente uma
+// chamada de loadByteArray por nó, o mesmo valor de IStatistics::getReads(), mas sem
+// alocar um objeto Statistics a cada consulta (getStatistics sempre faz "new").
+class CountingStorageManager : public SpatialIndex::IStorageManager {
+  public:
+    explicit CountingStorageManager(SpatialIndex::IStorageManager& underlying) : inner(underlying) {}
+
+    void loadByteArray(const SpatialIndex::id_type page, uint32_t& len, uint8_t** data) override {
+      readCount++;
+      inner.loadByteArray(page, len, data);
+    }
+
+    void storeByteArray(SpatialIndex::id_type& page, const uint32_t len, const uint8_t* const data) override {
+      inner.storeByteArray(page, len, data);
+    }
+
+    void deleteByteArray(const SpatialIndex::id_type page) override { inner.deleteByteArray(page); }
+
+    void flush() override { inner.flush(); }
+
+    uint64_t reads() const { return readCount; }
+
+  private:
+    SpatialIndex::IStorageManager& inner;
+    uint64_t readCount = 0;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <algorithm>
+
+// --- Execução Paralela ---
+// Pool simples de threads (fork-join): as tarefas 0..count-1 são distribuídas
+// dinamicamente entre os workers através de um contador atômico.
+
+// Converte a opção --threads (0 ou "auto" = todos os núcleos) em número de threads.
+inline unsigned resolveThreadCount(const std::string& option) {
+  unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  if (option.empty() || option == "auto") return hw;
+  int n = std::stoi(option);
+  return n <= 0 ? hw : static_cast<unsigned>(n);
+}
+
+// Executa body(indice, worker) para cada índice em [0, count) usando até "threads" threads.
+template <class Body>
+void parallelFor(size_t count, unsigned threads, Body&& body) {
+  threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(std::max<size_t>(count, 1))));
+  std::atomic<size_t> next(0);
+  auto worker = [&](unsigned w) {
+    for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) body(i, w);
+  };
+
+  if (threads == 1) { worker(0); return; }
+  std::vector<std::thread> pool;
+  for (unsigned w = 0; w < threads; w++) pool.emplace_back(worker, w);
+  for (auto& t : pool) t.join();
+}
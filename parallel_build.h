@@ -0,0 +1,332 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <mutex>
+#include <exception>
+
+#include "dataset_io.h"
+#include "parallel.h"
+#include "tree_params.h"
+#include "packed_tree.h"
+
+// --- Construção em Lote Paralela ---
+// O bulk loader STR da libspatialindex roda numa thread só. parallelBulkLoad divide o
+// trabalho em três fases:
+//  1. partição: os pontos são separados em "threads" fatias (slabs) contíguas pela primeira
+//     coordenada, como no primeiro nível do STR. Os cortes caem em múltiplos da ocupação
+//     das folhas, então só a última folha de cada fatia pode ficar incompleta;
+//  2. subárvores: cada fatia vira uma R-Tree própria (bulk loading STR da biblioteca) num
+//     arquivo temporário, todas em paralelo;
+//  3. merge: as páginas das subárvores são copiadas para o storage final (ids das páginas
+//     filhas remapeados) e os níveis de cima são montados sobre as raízes das subárvores,
+//     na ordem das fatias. Por fim o cabeçalho da árvore recebe a nova raiz e as estatísticas.
+//
+// A cópia usa o layout de página de Node::storeToByteArray e o cabeçalho de
+// RTree::storeHeader (libspatialindex 1.9), descritos em packed_tree.h; o cabeçalho final é
+// gravado por writePackedTreeHeader.
+
+struct ParallelBuildStats {
+  unsigned threads = 0;
+  uint64_t rows = 0;
+  uint32_t subtrees = 0;
+  uint32_t height = 0;
+  uint64_t nodes = 0;
+  double partitionSeconds = 0;
+  double subtreeSeconds = 0;
+  double mergeSeconds = 0;
+};
+
+// Stream de bulk loading sobre um subconjunto das linhas de um Dataset (IDs = posição original)
+class DatasetSubsetStream : public SpatialIndex::IDataStream {
+  public:
+    DatasetSubsetStream(const Dataset& d, const uint64_t* rowIds, size_t n)
+        : data(d), ids(rowIds), count(n), scratch(d.dimension()) {}
+
+    SpatialIndex::IData* getNext() override {
+      if (!hasNext()) return nullptr;
+      uint64_t id = ids[current++];
+      const double* coords = data.row(id, scratch.data());
+      SpatialIndex::Region r(coords, coords, data.dimension());
+      return new SpatialIndex::RTree::Data(0, nullptr, r, static_cast<SpatialIndex::id_type>(id));
+    }
+
+    bool hasNext() override { return current < count; }
+    uint32_t size() override { return static_cast<uint32_t>(count); }
+    void rewind() override { current = 0; }
+
+  private:
+    const Dataset& data;
+    const uint64_t* ids;
+    size_t count;
+    std::vector<double> scratch;
+    size_t current = 0;
+};
+
+class ParallelTreeMerger {
+  public:
+    ParallelTreeMerger(SpatialIndex::IStorageManager& target, uint32_t dim, uint32_t indexCap)
+        : storage(target), dimension(dim), indexCapacity(indexCap) {}
+
+    // Copia para o storage final a subárvore cujo cabeçalho está em headerPage de "source"
+    void addSubtree(SpatialIndex::IStorageManager& source, SpatialIndex::id_type headerPage) {
+      std::vector<uint8_t> header = loadPage(source, headerPage);
+      SpatialIndex::id_type root;
+      memcpy(&root, header.data(), sizeof(root));
+      roots.push_back(copyNode(source, root));
+    }
+
+    // Monta os níveis acima das subárvores e reescreve o cabeçalho da árvore em headerPage
+    // (criada vazia no storage final). Devolve o número de níveis da árvore.
+    uint32_t finish(SpatialIndex::id_type headerPage, uint64_t dataCount) {
+      if (roots.empty()) throw std::runtime_error("Construção paralela sem subárvores");
+
+      // Subárvores mais baixas (fatia final menor) sobem por nós de um filho até a mesma altura
+      uint32_t top = 0;
+      for (const Entry& e : roots) top = std::max(top, e.level);
+      for (Entry& e : roots) {
+        while (e.level < top) e = writeIndexNode(e.level + 1, std::vector<Entry>{e});
+      }
+      std::vector<Entry> level = roots;
+      while (level.size() > 1) {
+        // Grupos de tamanho equilibrado, no máximo indexCapacity entradas cada
+        size_t groups = (level.size() + indexCapacity - 1) / indexCapacity;
+        std::vector<Entry> next;
+        for (size_t g = 0; g < groups; g++) {
+          size_t from = level.size() * g / groups, to = level.size() * (g + 1) / groups;
+          next.push_back(writeIndexNode(level[0].level + 1, std::vector<Entry>(level.begin() + from, level.begin() + to)));
+        }
+        level.swap(next);
+      }
+
+      uint32_t height = level[0].level + 1;
+      nodesPerLevel.resize(height, 0);
+      writePackedTreeHeader(storage, headerPage, level[0].id, nodesPerLevel, dataCount);
+      return height;
+    }
+
+    uint64_t totalNodes() const {
+      uint64_t n = 0;
+      for (uint64_t c : nodesPerLevel) n += c;
+      return n;
+    }
+
+  private:
+    // Tipos gravados por Node::storeToByteArray
+    static constexpr uint32_t PERSISTENT_INDEX = 1;
+    static constexpr uint32_t NODE_HEADER = 3 * sizeof(uint32_t);
+
+    struct Entry {
+      std::vector<double> low, high;
+      SpatialIndex::id_type id;
+      uint32_t level;
+    };
+
+    SpatialIndex::IStorageManager& storage;
+    uint32_t dimension;
+    uint32_t indexCapacity;
+    std::vector<Entry> roots;
+    std::vector<uint64_t> nodesPerLevel;
+
+    static std::vector<uint8_t> loadPage(SpatialIndex::IStorageManager& sm, SpatialIndex::id_type page) {
+      uint32_t len;
+      uint8_t* bytes;
+      sm.loadByteArray(page, len, &bytes);
+      std::vector<uint8_t> out(bytes, bytes + len);
+      delete[] bytes;
+      return out;
+    }
+
+    template <class T>
+    static void append(std::vector<uint8_t>& out, const T& value) {
+      const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+      out.insert(out.end(), p, p + sizeof(T));
+    }
+
+    void countNode(uint32_t level) {
+      if (level >= nodesPerLevel.size()) nodesPerLevel.resize(level + 1, 0);
+      nodesPerLevel[level]++;
+    }
+
+    // Grava a página (filhos primeiro) no storage final e devolve a entrada que aponta para ela
+    Entry copyNode(SpatialIndex::IStorageManager& source, SpatialIndex::id_type page) {
+      std::vector<uint8_t> node = loadPage(source, page);
+      const size_t box = 2 * dimension * sizeof(double);
+      if (node.size() < NODE_HEADER + box) throw std::runtime_error("Página de subárvore inválida");
+      uint32_t level, children;
+      memcpy(&level, node.data() + sizeof(uint32_t), sizeof(level));
+      memcpy(&children, node.data() + 2 * sizeof(uint32_t), sizeof(children));
+
+      size_t at = NODE_HEADER;
+      for (uint32_t c = 0; c < children; c++) {
+        at += box;
+        if (level > 0) {
+          SpatialIndex::id_type child;
+          memcpy(&child, node.data() + at, sizeof(child));
+          child = copyNode(source, child).id;
+          memcpy(node.data() + at, &child, sizeof(child));
+        }
+        uint32_t dataLength;
+        memcpy(&dataLength, node.data() + at + sizeof(SpatialIndex::id_type), sizeof(dataLength));
+        at += sizeof(SpatialIndex::id_type) + sizeof(uint32_t) + dataLength;
+      }
+      if (at + box != node.size()) throw std::runtime_error("Página de subárvore com layout inesperado");
+
+      Entry e;
+      e.level = level;
+      e.low.resize(dimension);
+      e.high.resize(dimension);
+      memcpy(e.low.data(), node.data() + at, dimension * sizeof(double));
+      memcpy(e.high.data(), node.data() + at + dimension * sizeof(double), dimension * sizeof(double));
+      e.id = SpatialIndex::StorageManager::NewPage;
+      storage.storeByteArray(e.id, static_cast<uint32_t>(node.size()), node.data());
+      countNode(level);
+      return e;
+    }
+
+    Entry writeIndexNode(uint32_t level, const std::vector<Entry>& children) {
+      Entry e;
+      e.level = level;
+      e.low = children[0].low;
+      e.high = children[0].high;
+      std::vector<uint8_t> node;
+      append(node, PERSISTENT_INDEX);
+      append(node, level);
+      append(node, static_cast<uint32_t>(children.size()));
+      for (const Entry& c : children) {
+        for (uint32_t d = 0; d < dimension; d++) {
+          e.low[d] = std::min(e.low[d], c.low[d]);
+          e.high[d] = std::max(e.high[d], c.high[d]);
+        }
+        node.insert(node.end(), reinterpret_cast<const uint8_t*>(c.low.data()),
+                    reinterpret_cast<const uint8_t*>(c.low.data() + dimension));
+        node.insert(node.end(), reinterpret_cast<const uint8_t*>(c.high.data()),
+                    reinterpret_cast<const uint8_t*>(c.high.data() + dimension));
+        append(node, c.id);
+        append(node, uint32_t(0));
+      }
+      node.insert(node.end(), reinterpret_cast<const uint8_t*>(e.low.data()),
+                  reinterpret_cast<const uint8_t*>(e.low.data() + dimension));
+      node.insert(node.end(), reinterpret_cast<const uint8_t*>(e.high.data()),
+                  reinterpret_cast<const uint8_t*>(e.high.data() + dimension));
+      e.id = SpatialIndex::StorageManager::NewPage;
+      storage.storeByteArray(e.id, static_cast<uint32_t>(node.size()), node.data());
+      countNode(level);
+      return e;
+    }
+};
+
+// Separa ids[0, n) em "slabs" fatias pela primeira coordenada: os cortes (bounds) são posições
+// fixas e cada metade é particionada com nth_element, em paralelo, até restar uma fatia.
+inline void partitionSlabs(std::vector<std::pair<double, uint64_t>>& keys, const std::vector<size_t>& bounds,
+                           size_t firstSlab, size_t lastSlab) {
+  if (lastSlab - firstSlab <= 1) return;
+  size_t mid = (firstSlab + lastSlab) / 2;
+  std::nth_element(keys.begin() + bounds[firstSlab], keys.begin() + bounds[mid], keys.begin() + bounds[lastSlab]);
+  std::thread left([&] { partitionSlabs(keys, bounds, firstSlab, mid); });
+  partitionSlabs(keys, bounds, mid, lastSlab);
+  left.join();
+}
+
+// Constrói a árvore de "data" em "storage" com uma subárvore STR por thread (ver acima).
+// Os arquivos das subárvores ficam em tempDir, removido ao final.
+inline SpatialIndex::ISpatialIndex* parallelBulkLoad(const Dataset& data, SpatialIndex::IStorageManager& storage,
+                                                      const TreeParams& params, unsigned threads,
+                                                      const std::string& tempDir, SpatialIndex::id_type& indexIdentifier,
+                                                      ParallelBuildStats* statsOut = nullptr) {
+  using clock = std::chrono::high_resolution_clock;
+  auto seconds = [](clock::time_point start) { return std::chrono::duration<double>(clock::now() - start).count(); };
+  const uint64_t n = data.size();
+  const uint32_t dim = data.dimension();
+  if (n == 0) throw std::runtime_error("Dataset vazio: nada a construir");
+  ParallelBuildStats stats;
+  stats.threads = std::max(1u, threads);
+  stats.rows = n;
+
+  // 1. Partição em fatias com cortes múltiplos da ocupação das folhas do STR
+  auto start = clock::now();
+  uint64_t perLeaf = std::max<uint64_t>(1, static_cast<uint64_t>(params.leafCapacity * params.bulkFillFactor));
+  uint64_t leaves = (n + perLeaf - 1) / perLeaf;
+  size_t slabs = static_cast<size_t>(std::min<uint64_t>(stats.threads, leaves));
+  std::vector<size_t> bounds(slabs + 1);
+  for (size_t s = 0; s <= slabs; s++) bounds[s] = static_cast<size_t>(std::min<uint64_t>(n, leaves * s / slabs * perLeaf));
+
+  std::vector<std::pair<double, uint64_t>> keys(n);
+  const uint64_t block = 65536;
+  parallelFor((n + block - 1) / block, stats.threads, [&](size_t b, unsigned) {
+    std::vector<double> scratch(dim);
+    for (uint64_t i = b * block; i < std::min(n, (b + 1) * block); i++) keys[i] = {data.row(i, scratch.data())[0], i};
+  });
+  partitionSlabs(keys, bounds, 0, slabs);
+  std::vector<uint64_t> ids(n);
+  for (uint64_t i = 0; i < n; i++) ids[i] = keys[i].second;
+  std::vector<std::pair<double, uint64_t>>().swap(keys);
+  stats.partitionSeconds = seconds(start);
+
+  // 2. Uma subárvore STR por fatia, cada uma no seu arquivo temporário
+  start = clock::now();
+  std::filesystem::create_directories(tempDir);
+  std::vector<std::string> bases(slabs);
+  std::vector<SpatialIndex::IStorageManager*> disks(slabs, nullptr);
+  std::vector<SpatialIndex::id_type> headers(slabs, 1);
+  auto cleanup = [&] {
+    std::error_code ec;
+    for (size_t s = 0; s < slabs; s++) {
+      delete disks[s];
+      disks[s] = nullptr;
+      std::filesystem::remove(bases[s] + ".idx", ec);
+      std::filesystem::remove(bases[s] + ".dat", ec);
+    }
+    std::filesystem::remove(tempDir, ec);
+  };
+  for (size_t s = 0; s < slabs; s++) {
+    bases[s] = tempDir + "/slab_" + std::to_string(s);
+    disks[s] = SpatialIndex::StorageManager::createNewDiskStorageManager(bases[s], params.pageSize);
+  }
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  parallelFor(slabs, stats.threads, [&](size_t s, unsigned) {
+    try {
+      DatasetSubsetStream stream(data, ids.data() + bounds[s], bounds[s + 1] - bounds[s]);
+      SpatialIndex::ISpatialIndex* subtree = SpatialIndex::RTree::createAndBulkLoadNewRTree(
+          SpatialIndex::RTree::BLM_STR, stream, *disks[s], params.bulkFillFactor, params.indexCapacity,
+          params.leafCapacity, dim, params.variant, headers[s]);
+      delete subtree;  // Grava o cabeçalho da subárvore
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      if (!error) error = std::current_exception();
+    }
+  });
+  if (error) {
+    cleanup();
+    std::rethrow_exception(error);
+  }
+  stats.subtreeSeconds = seconds(start);
+
+  // 3. Merge: árvore vazia no storage final, cópia das subárvores e novos níveis de cima
+  start = clock::now();
+  try {
+    delete SpatialIndex::RTree::createNewRTree(storage, params.fillFactor, params.indexCapacity, params.leafCapacity,
+                                               dim, params.variant, indexIdentifier);
+    ParallelTreeMerger merger(storage, dim, params.indexCapacity);
+    for (size_t s = 0; s < slabs; s++) merger.addSubtree(*disks[s], headers[s]);
+    stats.height = merger.finish(indexIdentifier, n);
+    stats.nodes = merger.totalNodes();
+  } catch (...) {
+    cleanup();
+    throw;
+  }
+  cleanup();
+  stats.subtrees = static_cast<uint32_t>(slabs);
+  stats.mergeSeconds = seconds(start);
+  if (statsOut) *statsOut = stats;
+  return SpatialIndex::RTree::loadRTree(storage, indexIdentifier);
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+#include "dataset_io.h"
+#include "parallel.h"
+
+// --- Redução de Dimensionalidade (PCA) ---
+// Em dimensão alta os MBRs da R*-Tree se sobrepõem quase por completo e a poda deixa de
+// funcionar. PcaProjection ajusta uma projeção nas m componentes principais do dataset e o
+// índice guarda os vetores reduzidos y = W·(x - média).
+//
+// As linhas de W são ortonormais, então ||W·(x - q)|| <= ||x - q||: a distância no espaço
+// reduzido é um limite inferior da distância L2 completa. Isso permite consultar o índice
+// reduzido como filtro e refinar os candidatos com as coordenadas completas do dataset sem
+// perder nenhum resultado (recall 1.0):
+//  * k-NN: candidatos em ordem crescente de distância reduzida, até que ela passe da k-ésima
+//    distância exata (rerankedNearestNeighbors);
+//  * Range: bola de mesmo raio no espaço reduzido, seguida do filtro L2 exato.
+
+// Jacobi cíclico para matriz simétrica n x n: zera os elementos fora da diagonal por
+// rotações de Givens até a soma dos seus quadrados ficar desprezível. Ao final "a" tem os
+// autovalores na diagonal e "v" os autovetores nas colunas (ortonormais por construção).
+inline void jacobiEigen(std::vector<double> a, uint32_t n, std::vector<double>& values, std::vector<double>& v) {
+  v.assign(static_cast<size_t>(n) * n, 0.0);
+  for (uint32_t i = 0; i < n; i++) v[static_cast<size_t>(i) * n + i] = 1.0;
+  auto at = [&](uint32_t i, uint32_t j) -> double& { return a[static_cast<size_t>(i) * n + j]; };
+
+  double diag = 0;
+  for (uint32_t i = 0; i < n; i++) diag += at(i, i) * at(i, i);
+  for (int sweep = 0; sweep < 100; sweep++) {
+    double off = 0;
+    for (uint32_t i = 0; i < n; i++)
+      for (uint32_t j = i + 1; j < n; j++) off += at(i, j) * at(i, j);
+    if (off <= 1e-30 * std::max(diag, 1e-300)) break;
+
+    for (uint32_t p = 0; p < n; p++) {
+      for (uint32_t q = p + 1; q < n; q++) {
+        double apq = at(p, q);
+        if (std::fabs(apq) < 1e-300) continue;
+        double theta = (at(q, q) - at(p, p)) / (2 * apq);
+        double t = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+        double c = 1 / std::sqrt(t * t + 1), s = t * c;
+        for (uint32_t k = 0; k < n; k++) {
+          double akp = at(k, p), akq = at(k, q);
+          at(k, p) = c * akp - s * akq;
+          at(k, q) = s * akp + c * akq;
+        }
+        for (uint32_t k = 0; k < n; k++) {
+          double apk = at(p, k), aqk = at(q, k);
+          at(p, k) = c * apk - s * aqk;
+          at(q, k) = s * apk + c * aqk;
+        }
+        for (uint32_t k = 0; k < n; k++) {
+          double vkp = v[static_cast<size_t>(k) * n + p], vkq = v[static_cast<size_t>(k) * n + q];
+          v[static_cast<size_t>(k) * n + p] = c * vkp - s * vkq;
+          v[static_cast<size_t>(k) * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  values.resize(n);
+  for (uint32_t i = 0; i < n; i++) values[i] = at(i, i);
+}
+
+struct PcaProjection {
+  uint32_t inputDim = 0;
+  uint32_t outputDim = 0;
+  std::vector<double> mean;        // [inputDim]
+  std::vector<double> components;  // [outputDim][inputDim], row-major, linhas ortonormais
+  std::vector<double> variances;   // Autovalores das componentes mantidas (decrescentes)
+  double totalVariance = 0;        // Traço da covariância (variância de todas as dimensões)
+
+  // Fração da variância preservada pelas m componentes
+  double explainedVariance() const {
+    double kept = std::accumulate(variances.begin(), variances.end(), 0.0);
+    return totalVariance > 0 ? kept / totalVariance : 1.0;
+  }
+
+  // out[outputDim] = W·(in - média)
+  void project(const double* in, double* out) const {
+    for (uint32_t c = 0; c < outputDim; c++) {
+      const double* w = &components[static_cast<size_t>(c) * inputDim];
+      double sum = 0;
+      for (uint32_t d = 0; d < inputDim; d++) sum += w[d] * (in[d] - mean[d]);
+      out[c] = sum;
+    }
+  }
+
+  std::vector<double> project(const std::vector<double>& in) const {
+    std::vector<double> out(outputDim);
+    project(in.data(), out.data());
+    return out;
+  }
+
+  // Ajusta média e componentes sobre até maxSamples linhas (amostra com passo fixo).
+  // A covariância é acumulada em paralelo por blocos de linhas e decomposta por Jacobi.
+  static PcaProjection fit(const Dataset& data, uint32_t outDim, uint64_t maxSamples = 100000,
+                           unsigned threads = 0) {
+    const uint32_t dim = data.dimension();
+    if (outDim == 0 || outDim > dim) {
+      throw std::invalid_argument("Dimensão PCA inválida: " + std::to_string(outDim) +
+                                  " (use 1.." + std::to_string(dim) + ")");
+    }
+    if (data.size() == 0) throw std::runtime_error("Dataset vazio: não há como ajustar o PCA");
+    if (threads == 0) threads = resolveThreadCount("auto");
+
+    uint64_t step = std::max<uint64_t>(1, data.size() / std::max<uint64_t>(1, maxSamples));
+    uint64_t samples = (data.size() + step - 1) / step;
+
+    PcaProjection p;
+    p.inputDim = dim;
+    p.outputDim = outDim;
+    p.mean.assign(dim, 0.0);
+    std::vector<double> scratch(dim);
+    for (uint64_t s = 0; s < samples; s++) {
+      const double* r = data.row(s * step, scratch.data());
+      for (uint32_t d = 0; d < dim; d++) p.mean[d] += r[d];
+    }
+    for (double& m : p.mean) m /= samples;
+
+    // Triângulo superior da covariância, um acumulador por bloco de linhas
+    const uint64_t block = 4096;
+    size_t blocks = (samples + block - 1) / block;
+    std::vector<std::vector<double>> partial(blocks);
+    parallelFor(blocks, threads, [&](size_t b, unsigned) {
+      std::vector<double>& acc = partial[b];
+      acc.assign(static_cast<size_t>(dim) * dim, 0.0);
+      std::vector<double> rowScratch(dim), centered(dim);
+      for (uint64_t s = b * block; s < std::min<uint64_t>(samples, (b + 1) * block); s++) {
+        const double* r = data.row(s * step, rowScratch.data());
+        for (uint32_t d = 0; d < dim; d++) centered[d] = r[d] - p.mean[d];
+        for (uint32_t i = 0; i < dim; i++) {
+          double ci = centered[i];
+          double* row = &acc[static_cast<size_t>(i) * dim];
+          for (uint32_t j = i; j < dim; j++) row[j] += ci * centered[j];
+        }
+      }
+    });
+    std::vector<double> cov(static_cast<size_t>(dim) * dim, 0.0);
+    for (const std::vector<double>& acc : partial) {
+      for (size_t i = 0; i < acc.size(); i++) cov[i] += acc[i];
+    }
+    for (uint32_t i = 0; i < dim; i++) {
+      for (uint32_t j = i; j < dim; j++) {
+        double v = cov[static_cast<size_t>(i) * dim + j] / samples;
+        cov[static_cast<size_t>(i) * dim + j] = v;
+        cov[static_cast<size_t>(j) * dim + i] = v;
+      }
+    }
+
+    std::vector<double> eigenvalues, eigenvectors;
+    jacobiEigen(cov, dim, eigenvalues, eigenvectors);
+
+    std::vector<uint32_t> order(dim);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return eigenvalues[a] > eigenvalues[b]; });
+
+    p.totalVariance = 0;
+    for (double v : eigenvalues) p.totalVariance += std::max(0.0, v);
+    p.components.resize(static_cast<size_t>(outDim) * dim);
+    for (uint32_t c = 0; c < outDim; c++) {
+      uint32_t e = order[c];
+      p.variances.push_back(std::max(0.0, eigenvalues[e]));
+      // Autovetores ficam nas colunas de "eigenvectors"
+      for (uint32_t d = 0; d < dim; d++) {
+        p.components[static_cast<size_t>(c) * dim + d] = eigenvectors[static_cast<size_t>(d) * dim + e];
+      }
+    }
+    return p;
+  }
+
+  // Arquivo <índice>.pca: magic "RTPCA001" | uint32 dimEntrada | uint32 dimSaida |
+  // variânciaTotal | média[dimEntrada] | variâncias[dimSaida] | componentes[dimSaida][dimEntrada]
+  void save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write("RTPCA001", 8);
+    out.write(reinterpret_cast<const char*>(&inputDim), sizeof(inputDim));
+    out.write(reinterpret_cast<const char*>(&outputDim), sizeof(outputDim));
+    out.write(reinterpret_cast<const char*>(&totalVariance), sizeof(totalVariance));
+    out.write(reinterpret_cast<const char*>(mean.data()), mean.size() * sizeof(double));
+    out.write(reinterpret_cast<const char*>(variances.data()), variances.size() * sizeof(double));
+    out.write(reinterpret_cast<const char*>(components.data()), components.size() * sizeof(double));
+    if (!out) throw std::runtime_error("Falha ao gravar " + path);
+  }
+
+  static PcaProjection load(const std::string& path, uint32_t expectedInputDim, uint32_t expectedOutputDim) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    PcaProjection p;
+    in.read(magic, 8);
+    in.read(reinterpret_cast<char*>(&p.inputDim), sizeof(p.inputDim));
+    in.read(reinterpret_cast<char*>(&p.outputDim), sizeof(p.outputDim));
+    in.read(reinterpret_cast<char*>(&p.totalVariance), sizeof(p.totalVariance));
+    if (!in || memcmp(magic, "RTPCA001", 8) != 0 || p.inputDim != expectedInputDim || p.outputDim != expectedOutputDim) {
+      throw std::runtime_error("Projeção PCA inválida ou ausente: " + path);
+    }
+    p.mean.resize(p.inputDim);
+    p.variances.resize(p.outputDim);
+    p.components.resize(static_cast<size_t>(p.outputDim) * p.inputDim);
+    in.read(reinterpret_cast<char*>(p.mean.data()), p.mean.size() * sizeof(double));
+    in.read(reinterpret_cast<char*>(p.variances.data()), p.variances.size() * sizeof(double));
+    in.read(reinterpret_cast<char*>(p.components.data()), p.components.size() * sizeof(double));
+    if (!in) throw std::runtime_error("Arquivo PCA truncado: " + path);
+    return p;
+  }
+};
+
+// Stream de bulk loading sobre as linhas projetadas (IDs = posição original no dataset)
+class ProjectedDataStream : public SpatialIndex::IDataStream {
+  public:
+    ProjectedDataStream(const Dataset& d, const PcaProjection& p)
+        : data(d), pca(p), scratch(d.dimension()), reduced(p.outputDim) {}
+
+    SpatialIndex::IData* getNext() override {
+      if (!hasNext()) return nullptr;
+      pca.project(data.row(current, scratch.data()), reduced.data());
+      SpatialIndex::Region r(reduced.data(), reduced.data(), pca.outputDim);
+      SpatialIndex::RTree::Data* ret = new SpatialIndex::RTree::Data(0, nullptr, r, static_cast<SpatialIndex::id_type>(current));
+      current++;
+      return ret;
+    }
+
+    bool hasNext() override { return current < data.size(); }
+    uint32_t size() override { return static_cast<uint32_t>(data.size()); }
+    void rewind() override { current = 0; }
+
+  private:
+    const Dataset& data;
+    const PcaProjection& pca;
+    std::vector<double> scratch;
+    std::vector<double> reduced;
+    uint64_t current = 0;
+};
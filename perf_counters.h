@@ -0,0 +1,161 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <ostream>
+#include <algorithm>
+
+// --- Contadores de Hardware ---
+// Tempo e páginas lidas não dizem se o k-NN em dimensão alta gasta o tempo no laço de
+// distância (limitado por computação) ou decodificando nós (limitado por memória).
+// PerfCounters abre, via perf_event_open, cinco contadores da thread atual:
+//
+//  * ciclos e instruções (IPC = instruções / ciclos);
+//  * falhas de leitura no último nível de cache (LLC);
+//  * desvios mal previstos;
+//  * falhas de leitura na dTLB.
+//
+// Só o modo usuário é contado (exclude_kernel), o que funciona com perf_event_paranoid <= 2
+// sem privilégios; o custo das syscalls de I/O fica de fora. Cada contador é aberto
+// separadamente: se o kernel, a VM ou o container não oferecer algum, só ele fica
+// indisponível (coluna vazia no CSV) e os demais continuam valendo. Com multiplexação, os
+// valores são escalados por tempo habilitado / tempo em execução.
+
+enum PerfEvent { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_DTLB_MISSES, PERF_EVENT_COUNT };
+
+struct PerfSample {
+  double values[PERF_EVENT_COUNT] = {0, 0, 0, 0, 0};
+  bool valid[PERF_EVENT_COUNT] = {false, false, false, false, false};
+
+  double ipc() const {
+    return (valid[PERF_CYCLES] && valid[PERF_INSTRUCTIONS] && values[PERF_CYCLES] > 0)
+             ? values[PERF_INSTRUCTIONS] / values[PERF_CYCLES] : 0.0;
+  }
+
+  // Acumula outra amostra (totais por fase): um contador só vale se valer em todas
+  void add(const PerfSample& o) {
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+      values[e] += o.values[e];
+      valid[e] = (samples == 0 || valid[e]) && o.valid[e];
+    }
+    samples++;
+  }
+
+  uint64_t samples = 0;
+};
+
+class PerfCounters {
+  public:
+    PerfCounters() {
+      for (int e = 0; e < PERF_EVENT_COUNT; e++) fds[e] = -1;
+      const uint64_t llcRead = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      const uint64_t dtlbRead = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      fds[PERF_CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+      fds[PERF_INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+      fds[PERF_LLC_MISSES] = openEvent(PERF_TYPE_HW_CACHE, llcRead);
+      // Sem o evento LLC genérico, "cache-misses" costuma medir o mesmo nível
+      if (fds[PERF_LLC_MISSES] < 0) fds[PERF_LLC_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      fds[PERF_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+      fds[PERF_DTLB_MISSES] = openEvent(PERF_TYPE_HW_CACHE, dtlbRead);
+    }
+
+    ~PerfCounters() {
+      for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fds[e] >= 0) close(fds[e]);
+      }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const {
+      for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fds[e] >= 0) return true;
+      }
+      return false;
+    }
+
+    // Ex: "ciclos, instrucoes, llc, branch (indisponíveis: dtlb)" ou o motivo da falha
+    std::string describe() const {
+      std::string on, off;
+      for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        std::string& list = fds[e] >= 0 ? on : off;
+        list += (list.empty() ? "" : ", ") + std::string(eventName(e));
+      }
+      if (on.empty()) {
+        return "indisponíveis (" + std::string(strerror(firstError)) + "; veja /proc/sys/kernel/perf_event_paranoid)";
+      }
+      return off.empty() ? on : on + " (indisponíveis: " + off + ")";
+    }
+
+    // Leitura acumulada desde a abertura; a diferença entre duas leituras é o custo do trecho
+    PerfSample read() const {
+      PerfSample s;
+      for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fds[e] < 0) continue;
+        uint64_t buf[3];  // valor, tempo habilitado, tempo em execução
+        if (::read(fds[e], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf))) continue;
+        s.values[e] = (buf[2] > 0 && buf[2] < buf[1]) ? static_cast<double>(buf[0]) * buf[1] / buf[2] : static_cast<double>(buf[0]);
+        s.valid[e] = true;
+      }
+      return s;
+    }
+
+    static PerfSample delta(const PerfSample& before, const PerfSample& after) {
+      PerfSample d;
+      for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        d.valid[e] = before.valid[e] && after.valid[e];
+        // A escala da multiplexação muda entre leituras e pode dar diferença negativa: zera
+        d.values[e] = d.valid[e] ? std::max(0.0, after.values[e] - before.values[e]) : 0.0;
+      }
+      return d;
+    }
+
+    static const char* eventName(int e) {
+      static const char* names[PERF_EVENT_COUNT] = {"ciclos", "instrucoes", "llc", "branch", "dtlb"};
+      return names[e];
+    }
+
+  private:
+    int fds[PERF_EVENT_COUNT];
+    int firstError = 0;
+
+    int openEvent(uint32_t type, uint64_t config) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      // Thread atual (pid 0) em qualquer CPU; habilitado desde a abertura
+      int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fd < 0 && firstError == 0) firstError = errno;
+      return fd;
+    }
+};
+
+// Colunas de contadores do CSV por consulta: Ciclos,Instrucoes,IPC,LLC_Misses,Branch_Misses,DTLB_Misses
+// (vazias quando o contador não está disponível)
+inline void writePerfColumns(std::ostream& out, const PerfSample& s) {
+  auto value = [&](int e) {
+    if (s.valid[e]) out << static_cast<uint64_t>(s.values[e] + 0.5);
+  };
+  value(PERF_CYCLES);
+  out << ",";
+  value(PERF_INSTRUCTIONS);
+  out << ",";
+  if (s.valid[PERF_CYCLES] && s.valid[PERF_INSTRUCTIONS]) out << s.ipc();
+  out << ",";
+  value(PERF_LLC_MISSES);
+  out << ",";
+  value(PERF_BRANCH_MISSES);
+  out << ",";
+  value(PERF_DTLB_MISSES);
+}
@@ -0,0 +1,600 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+// --- Prefetch Assíncrono de Páginas ---
+// Com o índice frio, cada nó lido pelo DiskStorageManager bloqueia a travessia numa leitura
+// síncrona de 4 KB. PrefetchingStorageManager é um storage somente leitura sobre os mesmos
+// arquivos <índice>.idx/.dat que, ao entregar um nó interno à árvore, já dispara as leituras
+// dos filhos que a consulta vai visitar:
+//
+//  * Range (caixa ou bola): todos os filhos cujo MBR está a MINDIST² <= limite da consulta,
+//    o mesmo teste de poda da árvore, na ordem dos filhos e à frente das páginas já na fila;
+//  * k-NN: uma fila de prioridade "sombra" com os filhos de todos os nós lidos, por MINDIST²
+//    ao ponto; as "lookahead" entradas mais próximas ficam sempre em voo, antecipando a ordem
+//    best-first em que a árvore vai pedir os nós.
+//
+// As leituras vão para um AsyncReader: io_uring (syscalls diretas, sem liburing) ou, se o
+// kernel/container não permitir, um pool de threads com pread. No máximo "depth" leituras
+// ficam em voo; as demais esperam numa fila. Quando a árvore pede uma página já disparada, o
+// storage espera só por ela; páginas não disparadas são lidas de forma síncrona.
+//
+// O storage precisa saber a forma da consulta: beginRange / beginBall / beginKnn antes e
+// endQuery depois de cada consulta (endQuery espera as leituras em voo e conta as não usadas
+// como desperdício). Não é seguro para várias threads.
+
+// Layout de <índice>.idx (DiskStorageManager da libspatialindex 1.9):
+//   uint32 tamanho da página | id_type próxima página | uint32 vazias | id_type vazias[] |
+//   uint32 entradas | por entrada: id_type id | uint32 bytes | uint32 páginas | id_type páginas[]
+// A página física p fica no offset p · tamanho da página de <índice>.dat.
+
+// Leituras conjuntas por consulta
+struct PrefetchStats {
+  uint64_t queries = 0;
+  uint64_t loads = 0;         // Páginas pedidas pela árvore
+  uint64_t prefetchHits = 0;  // Servidas por uma leitura antecipada (concluída ou em voo)
+  uint64_t syncReads = 0;     // Lidas de forma síncrona (sem prefetch ou ainda na fila)
+  uint64_t issued = 0;        // Leituras antecipadas submetidas
+  uint64_t wasted = 0;        // Submetidas e não usadas pela consulta
+  uint64_t depthSamples = 0;  // Profundidade de I/O amostrada a cada submissão
+  double depthSum = 0;
+  uint32_t maxDepth = 0;
+
+  double averageDepth() const { return depthSamples > 0 ? depthSum / depthSamples : 0.0; }
+
+  void add(const PrefetchStats& o) {
+    queries += o.queries;
+    loads += o.loads;
+    prefetchHits += o.prefetchHits;
+    syncReads += o.syncReads;
+    issued += o.issued;
+    wasted += o.wasted;
+    depthSamples += o.depthSamples;
+    depthSum += o.depthSum;
+    maxDepth = std::max(maxDepth, o.maxDepth);
+  }
+};
+
+struct ReadCompletion {
+  uint64_t token;
+  int64_t result;  // Bytes lidos ou -errno
+};
+
+// Leitor assíncrono: submit enfileira, flush envia, poll recolhe as leituras concluídas
+class AsyncReader {
+  public:
+    virtual ~AsyncReader() {}
+    virtual const char* name() const = 0;
+    virtual bool submit(int fd, uint64_t offset, uint32_t length, uint8_t* dst, uint64_t token) = 0;
+    virtual void flush() = 0;
+    // Acrescenta as concluídas em "out"; com "block", espera ao menos uma
+    virtual void poll(std::vector<ReadCompletion>& out, bool block) = 0;
+};
+
+class UringReader : public AsyncReader {
+  public:
+    // nullptr se io_uring não estiver disponível (kernel antigo, seccomp do container)
+    static std::unique_ptr<UringReader> create(unsigned entries) {
+      std::unique_ptr<UringReader> r(new UringReader());
+      if (!r->setup(entries)) return nullptr;
+      return r;
+    }
+
+    ~UringReader() override {
+      if (sqes != nullptr) munmap(sqes, sqesSize);
+      if (cqRing != nullptr && cqRing != sqRing) munmap(cqRing, cqRingSize);
+      if (sqRing != nullptr) munmap(sqRing, sqRingSize);
+      if (ringFd >= 0) close(ringFd);
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+    bool submit(int fd, uint64_t offset, uint32_t length, uint8_t* dst, uint64_t token) override {
+      unsigned tail = *sqTail;
+      if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) return false;
+      unsigned index = tail & *sqMask;
+      io_uring_sqe* sqe = &sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(dst);
+      sqe->len = length;
+      sqe->off = offset;
+      sqe->user_data = token;
+      sqArray[index] = index;
+      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+      toSubmit++;
+      return true;
+    }
+
+    void flush() override {
+      while (toSubmit > 0) {
+        int n = static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, 0, nullptr, 0));
+        if (n < 0) {
+          if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+          throw std::runtime_error(std::string("io_uring_enter: ") + strerror(errno));
+        }
+        toSubmit -= static_cast<unsigned>(n);
+      }
+    }
+
+    void poll(std::vector<ReadCompletion>& out, bool block) override {
+      flush();
+      size_t before = out.size();
+      reap(out);
+      while (block && out.size() == before) {
+        int n = static_cast<int>(syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (n < 0 && errno != EINTR) throw std::runtime_error(std::string("io_uring_enter: ") + strerror(errno));
+        reap(out);
+      }
+    }
+
+  private:
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned sqEntries = 0;
+    unsigned toSubmit = 0;
+
+    UringReader() {}
+
+    bool setup(unsigned entries) {
+      io_uring_params p;
+      memset(&p, 0, sizeof(p));
+      ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+      if (ringFd < 0) return false;
+      sqEntries = p.sq_entries;
+      sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+      bool singleMap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if (singleMap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+      sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+      if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        return false;
+      }
+      cqRing = singleMap ? sqRing
+                         : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+      if (cqRing == MAP_FAILED) {
+        cqRing = nullptr;
+        return false;
+      }
+      sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+      void* s = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+      if (s == MAP_FAILED) return false;
+      sqes = static_cast<io_uring_sqe*>(s);
+
+      char* sq = static_cast<char*>(sqRing);
+      char* cq = static_cast<char*>(cqRing);
+      sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+      sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+      sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+      sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+      cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+      cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+      cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+      cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+      return true;
+    }
+
+    void reap(std::vector<ReadCompletion>& out) {
+      unsigned head = *cqHead;
+      unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++) {
+        const io_uring_cqe& cqe = cqes[head & *cqMask];
+        out.push_back({cqe.user_data, cqe.res});
+      }
+      __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+};
+
+// Alternativa sem io_uring: "threads" workers fazendo pread
+class ThreadPoolReader : public AsyncReader {
+  public:
+    explicit ThreadPoolReader(unsigned threads) {
+      for (unsigned t = 0; t < std::max(1u, threads); t++) workers.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPoolReader() override {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      requestReady.notify_all();
+      for (auto& w : workers) w.join();
+    }
+
+    const char* name() const override { return "threads"; }
+
+    bool submit(int fd, uint64_t offset, uint32_t length, uint8_t* dst, uint64_t token) override {
+      std::lock_guard<std::mutex> lock(mutex);
+      requests.push_back({fd, offset, length, dst, token});
+      return true;
+    }
+
+    void flush() override { requestReady.notify_all(); }
+
+    void poll(std::vector<ReadCompletion>& out, bool block) override {
+      flush();
+      std::unique_lock<std::mutex> lock(mutex);
+      if (block) completionReady.wait(lock, [this] { return !completions.empty(); });
+      out.insert(out.end(), completions.begin(), completions.end());
+      completions.clear();
+    }
+
+  private:
+    struct Request {
+      int fd;
+      uint64_t offset;
+      uint32_t length;
+      uint8_t* dst;
+      uint64_t token;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable requestReady, completionReady;
+    std::deque<Request> requests;
+    std::vector<ReadCompletion> completions;
+    bool stopping = false;
+
+    void work() {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        requestReady.wait(lock, [this] { return stopping || !requests.empty(); });
+        if (requests.empty()) return;
+        Request r = requests.front();
+        requests.pop_front();
+        lock.unlock();
+        ssize_t n = pread(r.fd, r.dst, r.length, static_cast<off_t>(r.offset));
+        int64_t result = n < 0 ? -static_cast<int64_t>(errno) : static_cast<int64_t>(n);
+        lock.lock();
+        completions.push_back({r.token, result});
+        completionReady.notify_one();
+      }
+    }
+};
+
+class PrefetchingStorageManager : public SpatialIndex::IStorageManager {
+  public:
+    // backend: "auto" (io_uring, senão threads), "uring" ou "threads"
+    PrefetchingStorageManager(const std::string& baseName, uint32_t dim, const std::string& backend = "auto",
+                              uint32_t maxDepth = 32, uint32_t knnLookahead = 4)
+        : dimension(dim), depth(std::max(1u, maxDepth)), lookahead(knnLookahead), queryLow(dim), queryHigh(dim) {
+      loadPageIndex(baseName + ".idx");
+      dataFd = ::open((baseName + ".dat").c_str(), O_RDONLY);
+      if (dataFd < 0) throw std::runtime_error("Não foi possível abrir " + baseName + ".dat");
+      if (backend != "threads") reader = UringReader::create(depth * 2);
+      if (!reader && backend == "uring") {
+        ::close(dataFd);
+        throw std::runtime_error("io_uring indisponível neste kernel/container");
+      }
+      if (!reader) reader.reset(new ThreadPoolReader(depth));
+    }
+
+    ~PrefetchingStorageManager() override {
+      endQuery();
+      reader.reset();
+      if (dataFd >= 0) ::close(dataFd);
+    }
+
+    PrefetchingStorageManager(const PrefetchingStorageManager&) = delete;
+    PrefetchingStorageManager& operator=(const PrefetchingStorageManager&) = delete;
+
+    const char* backendName() const { return reader->name(); }
+    const PrefetchStats& stats() const { return totals; }
+    void resetStats() { totals = PrefetchStats(); }
+
+    // Range com a caixa [low, high]
+    void beginRange(const double* low, const double* high) {
+      beginQuery(Mode::Range, 0.0);
+      std::copy(low, low + dimension, queryLow.begin());
+      std::copy(high, high + dimension, queryHigh.begin());
+    }
+
+    // Range com a bola L2 (mesmo teste de BallRegion)
+    void beginBall(const double* center, double radius) {
+      beginQuery(Mode::Range, radius * radius);
+      std::copy(center, center + dimension, queryLow.begin());
+      std::copy(center, center + dimension, queryHigh.begin());
+    }
+
+    void beginKnn(const double* point) {
+      beginQuery(Mode::Knn, 0.0);
+      std::copy(point, point + dimension, queryLow.begin());
+      std::copy(point, point + dimension, queryHigh.begin());
+    }
+
+    // Espera as leituras em voo e descarta as não usadas
+    void endQuery() {
+      backlog.clear();
+      while (inFlight > 0) reap(true);
+      for (const auto& s : slots) {
+        if (s.second.submitted) totals.wasted++;
+      }
+      slots.clear();
+      loaded.clear();
+      frontier.clear();
+      mode = Mode::None;
+    }
+
+    void loadByteArray(const SpatialIndex::id_type page, uint32_t& len, uint8_t** data) override {
+      totals.loads++;
+      if (inFlight > 0) reap(false);
+      std::vector<uint8_t> bytes;
+      auto it = slots.find(page);
+      if (it != slots.end() && it->second.submitted) {
+        while (it->second.remaining > 0) {
+          reap(true);
+          it = slots.find(page);
+        }
+        if (!it->second.failed) {
+          bytes.swap(it->second.bytes);
+          totals.prefetchHits++;
+        }
+      }
+      if (it != slots.end()) slots.erase(it);
+      if (bytes.empty()) {
+        readSync(page, bytes);
+        totals.syncReads++;
+      }
+      if (mode != Mode::None) {
+        loaded.insert(page);
+        scheduleChildren(bytes);
+      }
+      len = static_cast<uint32_t>(bytes.size());
+      *data = new uint8_t[len];
+      memcpy(*data, bytes.data(), len);
+    }
+
+    void storeByteArray(SpatialIndex::id_type&, const uint32_t, const uint8_t* const) override {
+      throw std::runtime_error("PrefetchingStorageManager é somente leitura");
+    }
+
+    void deleteByteArray(const SpatialIndex::id_type) override {
+      throw std::runtime_error("PrefetchingStorageManager é somente leitura");
+    }
+
+    void flush() override {}
+
+  private:
+    enum class Mode { None, Range, Knn };
+
+    struct PageEntry {
+      uint32_t length;
+      std::vector<SpatialIndex::id_type> pages;
+    };
+
+    // Leitura antecipada de uma página lógica (uma leitura por página física)
+    struct Slot {
+      std::vector<uint8_t> bytes;
+      uint32_t remaining = 0;
+      bool submitted = false;
+      bool failed = false;
+    };
+
+    struct FrontierEntry {
+      double dist2;
+      SpatialIndex::id_type page;
+      bool operator>(const FrontierEntry& o) const { return dist2 > o.dist2; }
+    };
+
+    uint32_t dimension;
+    uint32_t depth;
+    uint32_t lookahead;
+    uint32_t pageSize = 0;
+    int dataFd = -1;
+    std::unordered_map<SpatialIndex::id_type, PageEntry> pageIndex;
+    std::unique_ptr<AsyncReader> reader;
+
+    Mode mode = Mode::None;
+    double limit = 0;  // MINDIST² máxima dos filhos na Range (0 na caixa, raio² na bola)
+    std::vector<double> queryLow, queryHigh;
+    std::unordered_map<SpatialIndex::id_type, Slot> slots;
+    std::unordered_set<SpatialIndex::id_type> loaded;   // Páginas já entregues nesta consulta
+    std::deque<SpatialIndex::id_type> backlog;          // Aguardando vaga na profundidade
+    std::vector<FrontierEntry> frontier;                // Heap de mínimo do k-NN
+    uint32_t inFlight = 0;
+    std::vector<ReadCompletion> completed;
+    PrefetchStats totals;
+
+    void loadPageIndex(const std::string& path) {
+      std::ifstream in(path, std::ios::binary);
+      if (!in.is_open()) throw std::runtime_error("Não foi possível abrir " + path);
+      SpatialIndex::id_type nextPage;
+      uint32_t count;
+      in.read(reinterpret_cast<char*>(&pageSize), sizeof(pageSize));
+      in.read(reinterpret_cast<char*>(&nextPage), sizeof(nextPage));
+      in.read(reinterpret_cast<char*>(&count), sizeof(count));
+      in.seekg(static_cast<std::streamoff>(count) * sizeof(SpatialIndex::id_type), std::ios::cur);
+      in.read(reinterpret_cast<char*>(&count), sizeof(count));
+      for (uint32_t i = 0; in && i < count; i++) {
+        SpatialIndex::id_type id;
+        uint32_t parts;
+        PageEntry e;
+        in.read(reinterpret_cast<char*>(&id), sizeof(id));
+        in.read(reinterpret_cast<char*>(&e.length), sizeof(e.length));
+        in.read(reinterpret_cast<char*>(&parts), sizeof(parts));
+        e.pages.resize(parts);
+        in.read(reinterpret_cast<char*>(e.pages.data()), parts * sizeof(SpatialIndex::id_type));
+        pageIndex[id] = std::move(e);
+      }
+      if (!in || pageSize == 0) throw std::runtime_error("Índice de páginas inválido: " + path);
+    }
+
+    const PageEntry& entryOf(SpatialIndex::id_type page) const {
+      auto it = pageIndex.find(page);
+      if (it == pageIndex.end()) throw std::runtime_error("Página inexistente: " + std::to_string(page));
+      return it->second;
+    }
+
+    void readSync(SpatialIndex::id_type page, std::vector<uint8_t>& bytes) {
+      const PageEntry& e = entryOf(page);
+      bytes.resize(e.length);
+      for (size_t p = 0; p < e.pages.size(); p++) {
+        size_t at = p * pageSize;
+        size_t n = std::min<size_t>(pageSize, e.length - at);
+        if (pread(dataFd, bytes.data() + at, n, static_cast<off_t>(e.pages[p]) * pageSize) != static_cast<ssize_t>(n)) {
+          throw std::runtime_error("Falha ao ler a página " + std::to_string(page));
+        }
+      }
+    }
+
+    void beginQuery(Mode m, double l) {
+      endQuery();
+      mode = m;
+      limit = l;
+      totals.queries++;
+    }
+
+    // Nó interno recém-lido: dispara (Range) ou enfileira na fronteira (k-NN) os filhos.
+    // Layout como em flat_index.h; páginas que não batem com o layout são ignoradas.
+    void scheduleChildren(const std::vector<uint8_t>& bytes) {
+      const size_t header = 3 * sizeof(uint32_t);
+      const size_t box = 2 * dimension * sizeof(double);
+      if (bytes.size() < header + box) return;
+      uint32_t level, count;
+      memcpy(&level, bytes.data() + sizeof(uint32_t), sizeof(level));
+      memcpy(&count, bytes.data() + 2 * sizeof(uint32_t), sizeof(count));
+      if (level == 0) return;
+      size_t at = header;
+      std::vector<std::pair<double, SpatialIndex::id_type>> children;
+      for (uint32_t j = 0; j < count; j++) {
+        if (at + box + sizeof(SpatialIndex::id_type) + sizeof(uint32_t) > bytes.size()) return;
+        double dist2 = 0;
+        for (uint32_t d = 0; d < dimension; d++) {
+          double lo, hi;
+          memcpy(&lo, bytes.data() + at + d * sizeof(double), sizeof(double));
+          memcpy(&hi, bytes.data() + at + (dimension + d) * sizeof(double), sizeof(double));
+          double gap = std::max(std::max(lo - queryHigh[d], queryLow[d] - hi), 0.0);
+          dist2 += gap * gap;
+        }
+        at += box;
+        SpatialIndex::id_type id;
+        uint32_t dataLength;
+        memcpy(&id, bytes.data() + at, sizeof(id));
+        memcpy(&dataLength, bytes.data() + at + sizeof(id), sizeof(dataLength));
+        at += sizeof(id) + sizeof(uint32_t) + dataLength;
+        children.push_back({dist2, id});
+      }
+      if (at + box != bytes.size()) return;
+
+      if (mode == Mode::Range) {
+        // A rangeQuery da biblioteca lê os filhos que passam na poda em sequência (0..n-1)
+        // ao desempilhar o nó, antes de descer: os filhos deste nó vêm em bloco, na ordem,
+        // à frente das páginas mais profundas enfileiradas por nós anteriores
+        std::vector<SpatialIndex::id_type> block;
+        for (const auto& c : children) {
+          if (c.first <= limit && schedule(c.second)) block.push_back(c.second);
+        }
+        backlog.insert(backlog.begin(), block.begin(), block.end());
+      } else {
+        for (const auto& c : children) {
+          frontier.push_back({c.first, c.second});
+          std::push_heap(frontier.begin(), frontier.end(), std::greater<FrontierEntry>());
+        }
+        refillKnnWindow();
+      }
+      pump();
+    }
+
+    // Mantém as "lookahead" entradas mais próximas da fronteira disparadas
+    void refillKnnWindow() {
+      size_t pending = slots.size();
+      while (pending < lookahead && !frontier.empty()) {
+        std::pop_heap(frontier.begin(), frontier.end(), std::greater<FrontierEntry>());
+        SpatialIndex::id_type page = frontier.back().page;
+        frontier.pop_back();
+        if (schedule(page)) {
+          backlog.push_back(page);
+          pending++;
+        }
+      }
+    }
+
+    // Reserva o slot da página; quem chama a põe na fila na posição do modo
+    bool schedule(SpatialIndex::id_type page) {
+      if (loaded.count(page) || slots.count(page) || !pageIndex.count(page)) return false;
+      Slot& s = slots[page];
+      s.bytes.resize(pageIndex[page].length);
+      return true;
+    }
+
+    // Submete a fila, da frente, enquanto houver vaga na profundidade: na Range a ordem em
+    // que a árvore vai ler (scheduleChildren), no k-NN a ordem de distância da janela.
+    void pump() {
+      bool submittedAny = false;
+      while (!backlog.empty() && inFlight < depth) {
+        SpatialIndex::id_type page = backlog.front();
+        backlog.pop_front();
+        auto it = slots.find(page);
+        if (it == slots.end() || it->second.submitted) continue;
+        const PageEntry& e = entryOf(page);
+        Slot& s = it->second;
+        bool ok = true;
+        for (size_t p = 0; p < e.pages.size() && ok; p++) {
+          size_t at = p * pageSize;
+          uint32_t n = static_cast<uint32_t>(std::min<size_t>(pageSize, e.length - at));
+          ok = reader->submit(dataFd, static_cast<uint64_t>(e.pages[p]) * pageSize, n, s.bytes.data() + at,
+                              static_cast<uint64_t>(page));
+          if (ok) {
+            s.remaining++;
+            inFlight++;
+          }
+        }
+        // Fila de submissão cheia no meio da página: as partes já enviadas completam e a
+        // página é lida de novo de forma síncrona
+        if (!ok) s.failed = true;
+        s.submitted = true;
+        submittedAny = true;
+        totals.issued++;
+        totals.depthSamples++;
+        totals.depthSum += inFlight;
+        totals.maxDepth = std::max(totals.maxDepth, inFlight);
+        if (!ok) break;
+      }
+      if (submittedAny) reader->flush();
+    }
+
+    void reap(bool block) {
+      completed.clear();
+      reader->poll(completed, block);
+      for (const ReadCompletion& c : completed) {
+        inFlight--;
+        auto it = slots.find(static_cast<SpatialIndex::id_type>(c.token));
+        if (it == slots.end()) continue;
+        if (c.result <= 0) it->second.failed = true;
+        it->second.remaining--;
+      }
+      pump();
+      if (mode == Mode::Knn) {
+        refillKnnWindow();
+        pump();
+      }
+    }
+};
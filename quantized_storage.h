@@ -0,0 +1,278 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "dataset_io.h"
+#include "scalar_quantizer.h"
+
+// --- Coordenadas em Precisão Reduzida ---
+// A libspatialindex serializa cada entrada de nó como low[dim] + high[dim] em double, então
+// a precisão não pode ser trocada dentro da árvore. QuantizingStorageManager fica entre a
+// árvore e o DiskStorageManager e recodifica as coordenadas de cada nó ao gravar:
+//  * float32: 4 bytes por coordenada;
+//  * int8:    1 byte por coordenada, quantização escalar com min/escala por dimensão.
+// Na leitura os nós voltam a ser doubles, e a árvore não percebe a diferença.
+//
+// O arredondamento é sempre para fora (low para baixo, high para cima), então cada MBR
+// decodificado contém o original: nenhuma subárvore com resultado é podada. As distâncias
+// calculadas sobre as caixas decodificadas são limites inferiores das distâncias reais, e
+// os candidatos são reordenados com as coordenadas completas do dataset (ver
+// rerankedNearestNeighbors), o que mantém as respostas exatas.
+//
+// Layout de um nó da RTree (Node::storeToByteArray, libspatialindex 1.9):
+//   uint32 tipo | uint32 nível | uint32 filhos |
+//   por filho: low[dim] high[dim] (double) | id_type id | uint32 tamanho | dados |
+//   MBR do nó: low[dim] high[dim]
+// Páginas que não seguem esse layout (o cabeçalho da árvore) ou com coordenadas fora da
+// faixa do int8 são gravadas sem alteração.
+
+class QuantizingStorageManager : public SpatialIndex::IStorageManager {
+  public:
+    QuantizingStorageManager(SpatialIndex::IStorageManager& underlying, uint32_t dim, CoordPrecision p,
+                             const ScalarQuantizer& q = ScalarQuantizer())
+        : inner(underlying), dimension(dim), precision(p), quantizer(q) {}
+
+    void loadByteArray(const SpatialIndex::id_type page, uint32_t& len, uint8_t** data) override {
+      uint32_t storedLen;
+      uint8_t* stored;
+      inner.loadByteArray(page, storedLen, &stored);
+      std::vector<uint8_t> decoded;
+      if (storedLen == 0 || !decodeNode(stored, storedLen, decoded)) {
+        delete[] stored;
+        throw std::runtime_error("Página corrompida no índice quantizado");
+      }
+      delete[] stored;
+      len = static_cast<uint32_t>(decoded.size());
+      *data = new uint8_t[len];
+      memcpy(*data, decoded.data(), len);
+    }
+
+    void storeByteArray(SpatialIndex::id_type& page, const uint32_t len, const uint8_t* const data) override {
+      std::vector<uint8_t> encoded;
+      if (!encodeNode(data, len, encoded)) {
+        encoded.assign(1, TAG_RAW);
+        encoded.insert(encoded.end(), data, data + len);
+      }
+      logicalBytes += len;
+      storedBytes += encoded.size();
+      inner.storeByteArray(page, static_cast<uint32_t>(encoded.size()), encoded.data());
+    }
+
+    void deleteByteArray(const SpatialIndex::id_type page) override { inner.deleteByteArray(page); }
+
+    void flush() override { inner.flush(); }
+
+    // Bytes recebidos da árvore e bytes efetivamente gravados (desde a criação)
+    uint64_t getLogicalBytes() const { return logicalBytes; }
+    uint64_t getStoredBytes() const { return storedBytes; }
+
+  private:
+    static constexpr uint8_t TAG_RAW = 0;
+    static constexpr uint8_t TAG_NODE = 1;
+    static constexpr uint32_t NODE_HEADER = 3 * sizeof(uint32_t);
+
+    SpatialIndex::IStorageManager& inner;
+    uint32_t dimension;
+    CoordPrecision precision;
+    ScalarQuantizer quantizer;
+    uint64_t logicalBytes = 0;
+    uint64_t storedBytes = 0;
+
+    size_t coordBytes() const {
+      return precision == CoordPrecision::Float32 ? sizeof(float) : precision == CoordPrecision::Int8 ? 1 : sizeof(double);
+    }
+
+    // Retorna false se alguma coordenada cair fora da faixa representável em int8
+    bool putCoords(const double* src, bool up, std::vector<uint8_t>& out) const {
+      size_t at = out.size();
+      out.resize(at + dimension * coordBytes());
+      uint8_t* dst = out.data() + at;
+      for (uint32_t d = 0; d < dimension; d++) {
+        double x;
+        memcpy(&x, src + d, sizeof(double));
+        if (precision == CoordPrecision::Float32) {
+          float f = static_cast<float>(x);
+          if (up ? (static_cast<double>(f) < x) : (static_cast<double>(f) > x)) {
+            f = std::nextafter(f, up ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity());
+          }
+          memcpy(dst + d * sizeof(float), &f, sizeof(float));
+        } else if (precision == CoordPrecision::Int8) {
+          dst[d] = up ? quantizer.encodeUp(d, x) : quantizer.encodeDown(d, x);
+          if (up ? quantizer.decode(d, dst[d]) < x : quantizer.decode(d, dst[d]) > x) return false;
+        } else {
+          memcpy(dst + d * sizeof(double), &x, sizeof(double));
+        }
+      }
+      return true;
+    }
+
+    void getCoords(const uint8_t* src, std::vector<uint8_t>& out) const {
+      size_t at = out.size();
+      out.resize(at + dimension * sizeof(double));
+      double* dst = reinterpret_cast<double*>(out.data() + at);
+      for (uint32_t d = 0; d < dimension; d++) {
+        double x;
+        if (precision == CoordPrecision::Float32) {
+          float f;
+          memcpy(&f, src + d * sizeof(float), sizeof(float));
+          x = f;
+        } else if (precision == CoordPrecision::Int8) {
+          x = quantizer.decode(d, src[d]);
+        } else {
+          memcpy(&x, src + d * sizeof(double), sizeof(double));
+        }
+        memcpy(dst + d, &x, sizeof(double));
+      }
+    }
+
+    // Recodifica um nó; retorna false se a página não tiver exatamente o layout de um nó
+    bool encodeNode(const uint8_t* data, uint32_t len, std::vector<uint8_t>& out) const {
+      if (len < NODE_HEADER) return false;
+      uint32_t type, children;
+      memcpy(&type, data, sizeof(uint32_t));
+      memcpy(&children, data + 2 * sizeof(uint32_t), sizeof(uint32_t));
+      if (type != 1 && type != 2) return false;  // PersistentIndex / PersistentLeaf
+
+      size_t box = 2 * dimension * sizeof(double);
+      size_t pos = NODE_HEADER;
+      out.clear();
+      out.push_back(TAG_NODE);
+      out.insert(out.end(), data, data + NODE_HEADER);
+      for (uint32_t c = 0; c <= children; c++) {
+        // c == children: MBR do próprio nó, sem id/dados
+        if (pos + box > len) return false;
+        if (!putCoords(reinterpret_cast<const double*>(data + pos), false, out) ||
+            !putCoords(reinterpret_cast<const double*>(data + pos + box / 2), true, out)) {
+          return false;
+        }
+        pos += box;
+        if (c == children) break;
+        size_t fixed = sizeof(SpatialIndex::id_type) + sizeof(uint32_t);
+        if (pos + fixed > len) return false;
+        uint32_t dataLen;
+        memcpy(&dataLen, data + pos + sizeof(SpatialIndex::id_type), sizeof(uint32_t));
+        if (pos + fixed + dataLen > len) return false;
+        out.insert(out.end(), data + pos, data + pos + fixed + dataLen);
+        pos += fixed + dataLen;
+      }
+      return pos == len;
+    }
+
+    bool decodeNode(const uint8_t* data, uint32_t len, std::vector<uint8_t>& out) const {
+      if (data[0] == TAG_RAW) {
+        out.assign(data + 1, data + len);
+        return true;
+      }
+      if (data[0] != TAG_NODE || len < 1 + NODE_HEADER) return false;
+      uint32_t children;
+      memcpy(&children, data + 1 + 2 * sizeof(uint32_t), sizeof(uint32_t));
+      size_t box = 2 * dimension * coordBytes();
+      size_t pos = 1 + NODE_HEADER;
+      out.assign(data + 1, data + 1 + NODE_HEADER);
+      for (uint32_t c = 0; c <= children; c++) {
+        if (pos + box > len) return false;
+        getCoords(data + pos, out);
+        getCoords(data + pos + box / 2, out);
+        pos += box;
+        if (c == children) break;
+        size_t fixed = sizeof(SpatialIndex::id_type) + sizeof(uint32_t);
+        if (pos + fixed > len) return false;
+        uint32_t dataLen;
+        memcpy(&dataLen, data + pos + sizeof(SpatialIndex::id_type), sizeof(uint32_t));
+        if (pos + fixed + dataLen > len) return false;
+        out.insert(out.end(), data + pos, data + pos + fixed + dataLen);
+        pos += fixed + dataLen;
+      }
+      return pos == len;
+    }
+};
+
+// --- Reordenação Exata ---
+// Coleta os candidatos do k-NN da árvore em ordem crescente de limite inferior (MINDIST²
+// até a caixa decodificada da entrada).
+class CandidateVisitor : public SpatialIndex::IVisitor {
+  public:
+    std::vector<std::pair<double, SpatialIndex::id_type>> candidates;  // (limite inferior², id)
+
+    CandidateVisitor(const double* q, uint32_t d) : query(q), dimension(d) {}
+
+    void visitNode(const SpatialIndex::INode&) override {}
+
+    void visitData(const SpatialIndex::IData& d) override {
+      const SpatialIndex::RTree::Data* data = dynamic_cast<const SpatialIndex::RTree::Data*>(&d);
+      double lb = 0;
+      if (data != nullptr) {
+        const double* low = data->m_region.m_pLow;
+        const double* high = data->m_region.m_pHigh;
+        for (uint32_t i = 0; i < dimension; i++) {
+          double diff = query[i] < low[i] ? low[i] - query[i] : (query[i] > high[i] ? query[i] - high[i] : 0.0);
+          lb += diff * diff;
+        }
+      }
+      candidates.push_back({lb, d.getIdentifier()});
+    }
+
+    void visitData(std::vector<const SpatialIndex::IData*>&) override {}
+
+  private:
+    const double* query;
+    uint32_t dimension;
+};
+
+struct RerankedKnn {
+  std::vector<std::pair<double, SpatialIndex::id_type>> neighbors;  // (distância² exata, id), crescente
+  std::vector<SpatialIndex::id_type> approximateIds;                // top-k da árvore antes da reordenação
+  uint64_t candidates = 0;                                          // candidatos avaliados exatamente
+};
+
+// k-NN exato a partir de um índice filtro (precisão reduzida ou espaço projetado): pede k'
+// candidatos à árvore com treeQuery, calcula as distâncias exatas de q no dataset e para
+// quando o limite inferior do último candidato já é maior ou igual à k-ésima distância
+// exata (nenhum ponto não visto pode ser melhor). Caso contrário dobra k' e repete.
+inline RerankedKnn rerankedNearestNeighbors(SpatialIndex::ISpatialIndex& tree, const double* treeQuery, uint32_t treeDim,
+                                            const double* q, uint32_t k, const Dataset& exact, uint32_t overfetch = 4) {
+  uint32_t dim = exact.dimension();
+  std::vector<double> scratch(dim);
+  RerankedKnn out;
+  for (uint64_t want = std::max<uint64_t>(k, uint64_t(k) * overfetch); ; want *= 2) {
+    CandidateVisitor visitor(treeQuery, treeDim);
+    SpatialIndex::Point queryPoint(treeQuery, treeDim);
+    tree.nearestNeighborQuery(static_cast<uint32_t>(std::min<uint64_t>(want, exact.size())), queryPoint, visitor);
+
+    out.approximateIds.clear();
+    for (size_t i = 0; i < visitor.candidates.size() && i < k; i++) out.approximateIds.push_back(visitor.candidates[i].second);
+    out.neighbors.clear();
+    for (const auto& c : visitor.candidates) {
+      const double* row = exact.row(static_cast<uint64_t>(c.second), scratch.data());
+      double d2 = 0;
+      for (uint32_t i = 0; i < dim; i++) {
+        double diff = row[i] - q[i];
+        d2 += diff * diff;
+      }
+      out.neighbors.push_back({d2, c.second});
+    }
+    out.candidates += visitor.candidates.size();
+
+    size_t keep = std::min<size_t>(k, out.neighbors.size());
+    std::partial_sort(out.neighbors.begin(), out.neighbors.begin() + keep, out.neighbors.end());
+    out.neighbors.resize(keep);
+
+    bool exhausted = visitor.candidates.size() < want || want >= exact.size();
+    double lastBound = visitor.candidates.empty() ? 0.0 : visitor.candidates.back().first;
+    if (exhausted || (keep == k && lastBound >= out.neighbors.back().first)) return out;
+  }
+}
+
+// Índice quantizado: a árvore é consultada no mesmo espaço das coordenadas exatas
+inline RerankedKnn rerankedNearestNeighbors(SpatialIndex::ISpatialIndex& tree, const double* q, uint32_t k,
+                                            const Dataset& exact, uint32_t overfetch = 4) {
+  return rerankedNearestNeighbors(tree, q, exact.dimension(), q, k, exact, overfetch);
+}
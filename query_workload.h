@@ -0,0 +1,259 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include "dataset_io.h"
+#include "l2_kernels.h"
+#include "parallel.h"
+
+// --- Conjuntos de Consultas Calibrados ---
+// generateQueryFiles sorteia 200 linhas do dataset e o raio da Range Query é fixo (0.1): no
+// cophir a Range devolve 1 resultado, no forest até ~180 mil. Um conjunto de consultas aqui
+// é descrito por QueryWorkloadSpec:
+//
+//  * distribuição: "dataset" (linhas sorteadas), "ood" (uniforme na caixa envolvente do
+//    dataset, fora da distribuição dos dados) ou "zipf" (pontos quentes: centros sorteados
+//    do dataset, escolhidos com probabilidade ∝ 1/posição^s e deslocados por um ruído
+//    gaussiano de 1% do desvio padrão de cada dimensão);
+//  * seletividade: número de resultados alvo por Range Query. O raio é calibrado no dataset
+//    como a mediana, entre as Range Queries do conjunto, da distância até o t-ésimo vizinho
+//    (busca exata), de modo que a consulta mediana devolve t resultados.
+//
+// O conjunto é gravado em queries/<dataset>_<nome>_{knn,range}.csv e os parâmetros (incluindo
+// o raio calibrado e a dispersão das distâncias do t-ésimo vizinho) em
+// queries/<dataset>_<nome>.params, lido pelo benchmark e pelo validar com --queries=<nome>.
+
+enum class QueryDistribution { Dataset = 0, OutOfDistribution = 1, Zipf = 2 };
+
+inline const char* queryDistributionName(QueryDistribution d) {
+  static const char* names[] = {"dataset", "ood", "zipf"};
+  return names[static_cast<int>(d)];
+}
+
+inline QueryDistribution parseQueryDistribution(const std::string& name) {
+  if (name == "dataset") return QueryDistribution::Dataset;
+  if (name == "ood") return QueryDistribution::OutOfDistribution;
+  if (name == "zipf") return QueryDistribution::Zipf;
+  throw std::invalid_argument("Distribuição de consultas inválida: " + name + " (use dataset, ood ou zipf)");
+}
+
+struct QueryWorkloadSpec {
+  QueryDistribution distribution = QueryDistribution::Dataset;
+  uint64_t selectivity = 0;   // Resultados alvo por Range Query (0: sem calibração, raio padrão)
+  size_t count = 100;         // Queries por tipo
+  double zipfExponent = 1.1;  // s da Zipf sobre os pontos quentes
+  uint32_t hotspots = 16;     // Número de pontos quentes
+  double jitter = 0.01;       // Ruído em torno dos pontos quentes, em desvios padrão
+  uint64_t seed = 12345;
+
+  // Ex: "dataset_sel100", "ood_sel1000", "zipf1.1x16_sel100_n500"
+  std::string name() const {
+    std::ostringstream out;
+    out << queryDistributionName(distribution);
+    if (distribution == QueryDistribution::Zipf) out << zipfExponent << "x" << hotspots;
+    if (selectivity > 0) out << "_sel" << selectivity;
+    if (count != 100) out << "_n" << count;
+    return out.str();
+  }
+};
+
+// Parâmetros gravados em queries/<dataset>_<nome>.params (uma chave=valor por linha)
+struct QueryWorkloadInfo {
+  std::string name;
+  std::string distribution;
+  uint64_t count = 0;
+  uint64_t selectivity = 0;
+  double radius = 0;          // Raio calibrado (0 sem calibração)
+  double radiusP10 = 0, radiusP90 = 0;  // Dispersão da distância ao t-ésimo vizinho entre as queries
+  double zipfExponent = 0;
+  uint32_t hotspots = 0;
+  uint64_t seed = 0;
+  uint64_t points = 0;        // Pontos do dataset na calibração
+
+  void save(const std::string& path) const {
+    std::ofstream out(path);
+    out << std::setprecision(17);
+    out << "conjunto=" << name << "\n"
+        << "distribuicao=" << distribution << "\n"
+        << "consultas=" << count << "\n"
+        << "seletividade=" << selectivity << "\n"
+        << "raio=" << radius << "\n"
+        << "raio_p10=" << radiusP10 << "\n"
+        << "raio_p90=" << radiusP90 << "\n"
+        << "zipf_s=" << zipfExponent << "\n"
+        << "pontos_quentes=" << hotspots << "\n"
+        << "semente=" << seed << "\n"
+        << "pontos_dataset=" << points << "\n";
+    if (!out) throw std::runtime_error("Falha ao gravar " + path);
+  }
+
+  static QueryWorkloadInfo load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) throw std::runtime_error("Conjunto de consultas não encontrado: " + path);
+    QueryWorkloadInfo info;
+    std::string line;
+    while (getline(in, line)) {
+      size_t eq = line.find('=');
+      if (eq == std::string::npos) continue;
+      std::string key = line.substr(0, eq), value = line.substr(eq + 1);
+      if (key == "conjunto") info.name = value;
+      else if (key == "distribuicao") info.distribution = value;
+      else if (key == "consultas") info.count = std::stoull(value);
+      else if (key == "seletividade") info.selectivity = std::stoull(value);
+      else if (key == "raio") info.radius = std::stod(value);
+      else if (key == "raio_p10") info.radiusP10 = std::stod(value);
+      else if (key == "raio_p90") info.radiusP90 = std::stod(value);
+      else if (key == "zipf_s") info.zipfExponent = std::stod(value);
+      else if (key == "pontos_quentes") info.hotspots = static_cast<uint32_t>(std::stoul(value));
+      else if (key == "semente") info.seed = std::stoull(value);
+      else if (key == "pontos_dataset") info.points = std::stoull(value);
+    }
+    return info;
+  }
+};
+
+struct QueryWorkloadPaths {
+  std::string knn, range, params;
+};
+
+inline QueryWorkloadPaths queryWorkloadPaths(const std::string& datasetName, const std::string& setName) {
+  std::string base = "queries/" + datasetName + "_" + setName;
+  return {base + "_knn.csv", base + "_range.csv", base + ".params"};
+}
+
+// Distância ao t-ésimo vizinho de cada query (busca exata, paralela por query)
+inline std::vector<double> kthNeighborDistances(const Dataset& data, const std::vector<std::vector<double>>& queries,
+                                                uint64_t t, unsigned threads) {
+  const uint32_t dim = data.dimension();
+  const uint64_t n = data.size();
+  t = std::min<uint64_t>(std::max<uint64_t>(t, 1), n);
+  L2Kernels kernels = selectL2Kernels();
+  std::vector<double> kth(queries.size(), 0.0);
+  std::vector<std::vector<double>> dist(threads), scratch(threads, std::vector<double>(dim));
+  parallelFor(queries.size(), threads, [&](size_t q, unsigned w) {
+    dist[w].resize(n);
+    for (uint64_t i = 0; i < n; i++) dist[w][i] = kernels.row(data.row(i, scratch[w].data()), queries[q].data(), dim);
+    std::nth_element(dist[w].begin(), dist[w].begin() + (t - 1), dist[w].end());
+    kth[q] = std::sqrt(dist[w][t - 1]);
+  });
+  return kth;
+}
+
+// Gera as queries k-NN e Range de "spec" a partir de "data" e, com seletividade, calibra o raio
+inline QueryWorkloadInfo generateQueryWorkload(const Dataset& data, const QueryWorkloadSpec& spec,
+                                               std::vector<std::vector<double>>& knnQueries,
+                                               std::vector<std::vector<double>>& rangeQueries, unsigned threads) {
+  const uint32_t dim = data.dimension();
+  const uint64_t n = data.size();
+  if (n == 0) throw std::runtime_error("Dataset vazio: não há de onde gerar consultas");
+  std::mt19937_64 gen(spec.seed);
+  std::vector<double> scratch(dim);
+  auto rowAt = [&](uint64_t i) {
+    const double* r = data.row(i, scratch.data());
+    return std::vector<double>(r, r + dim);
+  };
+
+  // Caixa envolvente e desvio padrão por dimensão (OOD e ruído dos pontos quentes)
+  std::vector<double> low(dim, INFINITY), high(dim, -INFINITY), mean(dim, 0.0), m2(dim, 0.0);
+  if (spec.distribution != QueryDistribution::Dataset) {
+    for (uint64_t i = 0; i < n; i++) {
+      const double* r = data.row(i, scratch.data());
+      for (uint32_t d = 0; d < dim; d++) {
+        low[d] = std::min(low[d], r[d]);
+        high[d] = std::max(high[d], r[d]);
+        double delta = r[d] - mean[d];
+        mean[d] += delta / (i + 1);
+        m2[d] += delta * (r[d] - mean[d]);
+      }
+    }
+  }
+
+  // Linhas distintas sorteadas (algoritmo de Floyd), na ordem do sorteio
+  auto sampleRows = [&](uint64_t total) {
+    total = std::min(total, n);
+    std::set<uint64_t> chosen;
+    std::vector<uint64_t> order;
+    for (uint64_t j = n - total; j < n; j++) {
+      uint64_t r = std::uniform_int_distribution<uint64_t>(0, j)(gen);
+      uint64_t pick = chosen.count(r) ? j : r;
+      chosen.insert(pick);
+      order.push_back(pick);
+    }
+    return order;
+  };
+
+  const size_t total = spec.count * 2;
+  std::vector<std::vector<double>> queries;
+  if (spec.distribution == QueryDistribution::Dataset) {
+    for (uint64_t i : sampleRows(total)) queries.push_back(rowAt(i));
+  } else if (spec.distribution == QueryDistribution::OutOfDistribution) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (size_t q = 0; q < total; q++) {
+      std::vector<double> p(dim);
+      for (uint32_t d = 0; d < dim; d++) p[d] = low[d] + unit(gen) * (high[d] - low[d]);
+      queries.push_back(p);
+    }
+  } else {
+    std::vector<std::vector<double>> centers;
+    for (uint64_t i : sampleRows(std::max<uint32_t>(spec.hotspots, 1))) centers.push_back(rowAt(i));
+    std::vector<double> weights(centers.size());
+    for (size_t r = 0; r < weights.size(); r++) weights[r] = 1.0 / std::pow(r + 1.0, spec.zipfExponent);
+    std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+    std::normal_distribution<double> noise(0.0, 1.0);
+    for (size_t q = 0; q < total; q++) {
+      std::vector<double> p = centers[zipf(gen)];
+      for (uint32_t d = 0; d < dim; d++) p[d] += noise(gen) * spec.jitter * std::sqrt(m2[d] / n);
+      queries.push_back(p);
+    }
+  }
+  size_t half = std::min(spec.count, queries.size());
+  knnQueries.assign(queries.begin(), queries.begin() + half);
+  rangeQueries.assign(queries.begin() + half, queries.end());
+
+  QueryWorkloadInfo info;
+  info.name = spec.name();
+  info.distribution = queryDistributionName(spec.distribution);
+  info.count = spec.count;
+  info.selectivity = spec.selectivity;
+  info.zipfExponent = spec.distribution == QueryDistribution::Zipf ? spec.zipfExponent : 0.0;
+  info.hotspots = spec.distribution == QueryDistribution::Zipf ? spec.hotspots : 0;
+  info.seed = spec.seed;
+  info.points = n;
+  if (spec.selectivity > 0 && !rangeQueries.empty()) {
+    std::vector<double> kth = kthNeighborDistances(data, rangeQueries, spec.selectivity, threads);
+    std::sort(kth.begin(), kth.end());
+    auto at = [&](double p) { return kth[std::min(kth.size() - 1, static_cast<size_t>(p * (kth.size() - 1) + 0.5))]; };
+    info.radius = at(0.5);
+    info.radiusP10 = at(0.1);
+    info.radiusP90 = at(0.9);
+  }
+  return info;
+}
+
+// Grava as queries em CSV (precisão completa) e os parâmetros do conjunto
+inline void writeQueryWorkload(const QueryWorkloadPaths& paths, const QueryWorkloadInfo& info,
+                               const std::vector<std::vector<double>>& knnQueries,
+                               const std::vector<std::vector<double>>& rangeQueries) {
+  auto writeCsv = [](const std::string& path, const std::vector<std::vector<double>>& queries) {
+    std::ofstream out(path);
+    out << std::setprecision(17);
+    for (const auto& q : queries) {
+      for (size_t d = 0; d < q.size(); d++) out << (d ? "," : "") << q[d];
+      out << "\n";
+    }
+    if (!out) throw std::runtime_error("Falha ao gravar " + path);
+  };
+  writeCsv(paths.knn, knnQueries);
+  writeCsv(paths.range, rangeQueries);
+  info.save(paths.params);
+}
@@ -0,0 +1,349 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "cli_options.h"
+
+namespace fs = std::filesystem;
+using namespace std;
+
+// Execução de regressão: roda o benchmark e a validação para uma lista de datasets, junta as
+// métricas de cada um num resumo (results/regressao/<execução>.{json,csv}) e compara com uma
+// linha de base. Sai com código 2 se alguma métrica piorar além do limite.
+//
+// Métricas por dataset:
+//  * Construcao_s, Disco_MB: última linha de results/construcao_<dataset>.csv (o benchmark é
+//    sempre executado com --build, para medir a construção);
+//  * RSS_Pico_MB: pico de memória residente do processo do benchmark (wait4);
+//  * <Tipo>_Tempo_ms_p50/p95/p99, <Tipo>_Paginas_p50/p95/p99 e <Tipo>_QPS (1000 / tempo médio,
+//    consultas sequenciais): linhas por consulta de results/benchmark_<dataset>.csv;
+//  * <Tipo>_Recall_Medio: results/validacao_rtree_<dataset>.csv.
+// Tipo é kNN ou Range.
+
+struct DatasetSpec {
+  string path;
+  string name;
+  uint32_t dimension;
+};
+
+struct ProcessResult {
+  bool ok = false;
+  double seconds = 0;
+  double peakRssMB = 0;
+};
+
+// Métricas de um dataset, na ordem em que são gravadas
+typedef vector<pair<string, double>> MetricList;
+
+// Percentil p (0-100) de um vetor já ordenado (interpolação linear, como em concurrent_queries.h)
+double percentileOf(const vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  double rank = (p / 100.0) * (sorted.size() - 1);
+  size_t lo = static_cast<size_t>(floor(rank));
+  size_t hi = min(sorted.size() - 1, lo + 1);
+  return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+vector<string> splitCsvLine(const string& line) {
+  vector<string> fields;
+  stringstream ss(line);
+  string field;
+  while (getline(ss, field, ',')) fields.push_back(field);
+  return fields;
+}
+
+vector<string> splitWords(const string& text) {
+  vector<string> words;
+  stringstream ss(text);
+  string w;
+  while (ss >> w) words.push_back(w);
+  return words;
+}
+
+// Executa o programa com a saída em logPath e mede tempo e pico de RSS do processo
+ProcessResult runProcess(const vector<string>& args, const string& logPath) {
+  ProcessResult r;
+  auto start = chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) return r;
+  if (pid == 0) {
+    int fd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      close(fd);
+    }
+    vector<char*> argv;
+    for (const string& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+    execvp(argv[0], argv.data());
+    perror(argv[0]);
+    _exit(127);
+  }
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) return r;
+  r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  r.peakRssMB = usage.ru_maxrss / 1024.0;  // ru_maxrss em KB
+  r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return r;
+}
+
+// Linhas do CSV como mapas coluna -> valor (arquivo ausente: vazio)
+vector<map<string, string>> readCsvRows(const string& path) {
+  vector<map<string, string>> rows;
+  ifstream in(path);
+  string line;
+  if (!getline(in, line)) return rows;
+  vector<string> header = splitCsvLine(line);
+  while (getline(in, line)) {
+    vector<string> fields = splitCsvLine(line);
+    map<string, string> row;
+    for (size_t i = 0; i < header.size() && i < fields.size(); i++) row[header[i]] = fields[i];
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+double toNumber(const map<string, string>& row, const string& column) {
+  auto it = row.find(column);
+  if (it == row.end() || it->second.empty()) return NAN;
+  try {
+    return stod(it->second);
+  } catch (std::exception&) {
+    return NAN;
+  }
+}
+
+// Métricas de consulta por tipo a partir dos CSVs do benchmark e da validação
+void collectQueryMetrics(const string& datasetName, MetricList& metrics) {
+  vector<map<string, string>> benchmarkRows = readCsvRows("results/benchmark_" + datasetName + ".csv");
+  vector<map<string, string>> validationRows = readCsvRows("results/validacao_rtree_" + datasetName + ".csv");
+  for (const string type : {"kNN", "Range"}) {
+    vector<double> times, pages;
+    for (const auto& row : benchmarkRows) {
+      if (row.count("Query_ID") == 0 || row.at("Query_ID") == "resumo" || row.count("Tipo") == 0 || row.at("Tipo") != type) continue;
+      double t = toNumber(row, "Tempo_ms"), p = toNumber(row, "Paginas_Lidas");
+      if (!std::isnan(t)) times.push_back(t);
+      if (!std::isnan(p)) pages.push_back(p);
+    }
+    if (!times.empty()) {
+      double mean = 0;
+      for (double t : times) mean += t;
+      mean /= times.size();
+      sort(times.begin(), times.end());
+      sort(pages.begin(), pages.end());
+      metrics.push_back({type + "_Tempo_ms_p50", percentileOf(times, 50)});
+      metrics.push_back({type + "_Tempo_ms_p95", percentileOf(times, 95)});
+      metrics.push_back({type + "_Tempo_ms_p99", percentileOf(times, 99)});
+      if (!pages.empty()) {
+        metrics.push_back({type + "_Paginas_p50", percentileOf(pages, 50)});
+        metrics.push_back({type + "_Paginas_p95", percentileOf(pages, 95)});
+        metrics.push_back({type + "_Paginas_p99", percentileOf(pages, 99)});
+      }
+      metrics.push_back({type + "_QPS", mean > 0 ? 1000.0 / mean : 0.0});
+    }
+
+    double recallSum = 0;
+    size_t recallCount = 0;
+    for (const auto& row : validationRows) {
+      if (row.count("Tipo") == 0 || row.at("Tipo") != type) continue;
+      double r = toNumber(row, "Recall");
+      if (std::isnan(r)) continue;
+      recallSum += r;
+      recallCount++;
+    }
+    if (recallCount > 0) metrics.push_back({type + "_Recall_Medio", recallSum / recallCount});
+  }
+}
+
+// QPS e recall: maior é melhor; as demais métricas (tempos, páginas, disco, memória): menor
+bool higherIsBetter(const string& metric) {
+  return metric.find("_QPS") != string::npos || metric.find("Recall") != string::npos;
+}
+
+void writeSummaryJson(const string& path, const string& runId, double thresholdPct,
+                      const vector<pair<string, MetricList>>& summary) {
+  ofstream out(path);
+  out << setprecision(10);
+  out << "{\n  \"execucao\": \"" << runId << "\",\n  \"limite_pct\": " << thresholdPct << ",\n  \"datasets\": {";
+  for (size_t d = 0; d < summary.size(); d++) {
+    out << (d ? "," : "") << "\n    \"" << summary[d].first << "\": {";
+    const MetricList& metrics = summary[d].second;
+    for (size_t m = 0; m < metrics.size(); m++) {
+      out << (m ? "," : "") << "\n      \"" << metrics[m].first << "\": " << metrics[m].second;
+    }
+    out << "\n    }";
+  }
+  out << "\n  }\n}\n";
+}
+
+// Formato longo (Execucao,Dataset,Metrica,Valor): o mesmo arquivo serve de linha de base
+void writeSummaryCsv(const string& path, const string& runId, const vector<pair<string, MetricList>>& summary) {
+  ofstream out(path);
+  out << setprecision(10);
+  out << "Execucao,Dataset,Metrica,Valor\n";
+  for (const auto& dataset : summary) {
+    for (const auto& metric : dataset.second) out << runId << "," << dataset.first << "," << metric.first << "," << metric.second << "\n";
+  }
+}
+
+map<pair<string, string>, double> loadBaseline(const string& path) {
+  map<pair<string, string>, double> baseline;
+  for (const auto& row : readCsvRows(path)) {
+    double v = toNumber(row, "Valor");
+    if (row.count("Dataset") && row.count("Metrica") && !std::isnan(v)) baseline[{row.at("Dataset"), row.at("Metrica")}] = v;
+  }
+  return baseline;
+}
+
+int main(int argc, char** argv) {
+  vector<DatasetSpec> datasets;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.rfind("--", 0) == 0) continue;
+    size_t colon = arg.rfind(':');
+    if (colon == string::npos || colon == 0 || colon + 1 == arg.size()) {
+      cerr << "Dataset inválido: " << arg << " (use <caminho_dataset>:<dimensao>)" << endl;
+      return 1;
+    }
+    DatasetSpec spec;
+    spec.path = arg.substr(0, colon);
+    spec.name = fs::path(spec.path).stem().string();
+    spec.dimension = static_cast<uint32_t>(stoul(arg.substr(colon + 1)));
+    datasets.push_back(spec);
+  }
+  if (datasets.empty()) {
+    cerr << "Uso: " << argv[0] << " <caminho_dataset>:<dimensao> [...] [--benchmark=./benchmark] [--validar=./validar] [--build=incremental|str|hilbert|external|parallel] [--benchmark-args=\"...\"] [--validar-args=\"...\"] [--baseline=results/regressao/baseline.csv] [--threshold=10] [--recall-tolerance=0.001] [--min-delta-ms=0.05] [--update-baseline] [--no-run]" << endl;
+    return 1;
+  }
+
+  string benchmarkBin = getOption(argc, argv, "benchmark", "./benchmark");
+  string validarBin = getOption(argc, argv, "validar", "./validar");
+  string buildMode = getOption(argc, argv, "build", "incremental");
+  vector<string> benchmarkArgs = splitWords(getOption(argc, argv, "benchmark-args", ""));
+  vector<string> validarArgs = splitWords(getOption(argc, argv, "validar-args", ""));
+  string baselinePath = getOption(argc, argv, "baseline", "results/regressao/baseline.csv");
+  double thresholdPct, recallTolerance, minDeltaMs;
+  try {
+    thresholdPct = stod(getOption(argc, argv, "threshold", "10"));
+    recallTolerance = stod(getOption(argc, argv, "recall-tolerance", "0.001"));
+    minDeltaMs = stod(getOption(argc, argv, "min-delta-ms", "0.05"));
+  } catch (std::exception& e) {
+    cerr << "Limite inválido: " << e.what() << endl;
+    return 1;
+  }
+  bool runTools = !hasOption(argc, argv, "no-run");
+
+  fs::create_directories("results/regressao");
+  char stamp[32];
+  time_t now = time(nullptr);
+  strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+  string runId = stamp;
+
+  // 1. Benchmark e validação de cada dataset
+  bool failed = false;
+  vector<pair<string, MetricList>> summary;
+  for (const DatasetSpec& ds : datasets) {
+    MetricList metrics;
+    string buildFile = "results/construcao_" + ds.name + ".csv";
+    size_t buildRowsBefore = readCsvRows(buildFile).size();
+    if (runTools) {
+      cout << "[" << ds.name << "] benchmark..." << flush;
+      vector<string> args = {benchmarkBin, ds.path, to_string(ds.dimension), "--build=" + buildMode};
+      args.insert(args.end(), benchmarkArgs.begin(), benchmarkArgs.end());
+      string log = "results/regressao/" + runId + "_" + ds.name + "_benchmark.log";
+      ProcessResult bench = runProcess(args, log);
+      cout << (bench.ok ? " ok" : " FALHOU") << " (" << bench.seconds << " s, log " << log << ")" << endl;
+      if (!bench.ok) {
+        failed = true;
+        continue;
+      }
+      metrics.push_back({"RSS_Pico_MB", bench.peakRssMB});
+
+      cout << "[" << ds.name << "] validar..." << flush;
+      args = {validarBin, ds.path, to_string(ds.dimension)};
+      args.insert(args.end(), validarArgs.begin(), validarArgs.end());
+      log = "results/regressao/" + runId + "_" + ds.name + "_validar.log";
+      ProcessResult validation = runProcess(args, log);
+      cout << (validation.ok ? " ok" : " FALHOU") << " (" << validation.seconds << " s, log " << log << ")" << endl;
+      if (!validation.ok) failed = true;
+    }
+
+    // Construção desta execução (sem --no-run, a linha acrescentada pelo benchmark)
+    vector<map<string, string>> buildRows = readCsvRows(buildFile);
+    if (!buildRows.empty() && (!runTools || buildRows.size() > buildRowsBefore)) {
+      metrics.insert(metrics.begin(), {"Disco_MB", toNumber(buildRows.back(), "Disco_MB")});
+      metrics.insert(metrics.begin(), {"Construcao_s", toNumber(buildRows.back(), "Tempo_s")});
+    }
+    collectQueryMetrics(ds.name, metrics);
+    // Colunas ausentes ou vazias viram NaN: ficam fora do resumo (JSON não tem NaN)
+    metrics.erase(remove_if(metrics.begin(), metrics.end(), [](const pair<string, double>& m) { return !std::isfinite(m.second); }),
+                  metrics.end());
+    summary.push_back({ds.name, metrics});
+  }
+
+  // 2. Resumo da execução
+  string jsonPath = "results/regressao/" + runId + ".json";
+  string csvPath = "results/regressao/" + runId + ".csv";
+  writeSummaryJson(jsonPath, runId, thresholdPct, summary);
+  writeSummaryCsv(csvPath, runId, summary);
+  cout << "\nResumo salvo em " << jsonPath << " e " << csvPath << endl;
+
+  // 3. Comparação com a linha de base
+  int regressions = 0;
+  if (!fs::exists(baselinePath)) {
+    cout << "Sem linha de base em " << baselinePath << " (use --update-baseline para gravar esta execução)" << endl;
+  } else {
+    map<pair<string, string>, double> baseline = loadBaseline(baselinePath);
+    cout << "\n--- COMPARACAO COM " << baselinePath << " (limite " << thresholdPct << "%) ---" << endl;
+    cout << left << setw(12) << "Dataset" << setw(24) << "Metrica" << right << setw(14) << "Base" << setw(14) << "Atual"
+         << setw(10) << "Delta_%" << "  Estado" << endl;
+    for (const auto& dataset : summary) {
+      for (const auto& metric : dataset.second) {
+        auto it = baseline.find({dataset.first, metric.first});
+        if (it == baseline.end() || std::isnan(metric.second)) continue;
+        double base = it->second, current = metric.second;
+        double deltaPct = base != 0 ? 100.0 * (current - base) / fabs(base) : 0.0;
+        // Piora no sentido da métrica: recall pela tolerância absoluta, tempos abaixo de
+        // --min-delta-ms são ruído, o resto pelo limite relativo
+        double worse = higherIsBetter(metric.first) ? base - current : current - base;
+        bool regressed;
+        if (metric.first.find("Recall") != string::npos) regressed = worse > recallTolerance;
+        else if (metric.first.find("_ms") != string::npos && worse <= minDeltaMs) regressed = false;
+        else regressed = base != 0 && worse > 0 && 100.0 * worse / fabs(base) > thresholdPct;
+        if (regressed) regressions++;
+        cout << left << setw(12) << dataset.first << setw(24) << metric.first << right << setw(14) << base << setw(14)
+             << current << setw(10) << fixed << setprecision(1) << deltaPct << defaultfloat << setprecision(6) << "  "
+             << (regressed ? "REGRESSAO" : "ok") << endl;
+      }
+    }
+    cout << regressions << " métrica(s) com regressão" << endl;
+  }
+
+  if (hasOption(argc, argv, "update-baseline")) {
+    // Um dataset que falhou fica fora do resumo: a linha de base parcial deixaria de compará-lo
+    if (failed) {
+      cerr << "Linha de base mantida: a execução teve falhas (veja os logs em results/regressao/)" << endl;
+      return 1;
+    }
+    fs::copy_file(csvPath, baselinePath, fs::copy_options::overwrite_existing);
+    cout << "Linha de base atualizada: " << baselinePath << endl;
+    return 0;
+  }
+  if (failed) return 1;
+  return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "l2_kernels.h"
+#include "ball_query.h"
+#include "traversal_trace.h"
+
+// --- Buffer de Resultados ---
+// As ferramentas consumiam os resultados um a um pelo IVisitor: cada entrada de folha vira
+// uma chamada virtual com um IData, do qual o visitor tira o ponto e recalcula a distância.
+// ResultBuffer é a alternativa: a consulta preenche um buffer do chamador, reservado uma vez
+// e reaproveitado entre consultas, com pares (id, distância²) em ordem de distância.
+//
+//  * RTree da libspatialindex: ResultCollector é o IVisitor que grava no buffer, lendo o
+//    ponto direto do RTree::Data (sem getShape); collectNearestNeighbors / collectRange
+//    executam a consulta e ordenam.
+//  * FlatRTree (flat_index.h): as sobrecargas com ResultBuffer gravam a MINDIST² que a
+//    busca já calculou (para pontos, a distância² exata), sem visitor nem cópia do ponto.
+//
+// growths() conta as vezes em que o buffer passou da capacidade reservada (cada uma é uma
+// realocação); com a capacidade do maior resultado esperado ela fica em zero.
+
+struct QueryResult {
+  SpatialIndex::id_type id;
+  double dist2;
+};
+
+class ResultBuffer {
+  public:
+    explicit ResultBuffer(size_t capacity = 0) { items.reserve(capacity); }
+
+    void reserve(size_t capacity) { items.reserve(capacity); }
+    void clear() { items.clear(); }
+
+    void add(SpatialIndex::id_type id, double dist2) {
+      if (items.size() == items.capacity()) growCount++;
+      items.push_back({id, dist2});
+    }
+
+    // Distância crescente, empates por id
+    void sortByDistance() {
+      std::sort(items.begin(), items.end(), [](const QueryResult& a, const QueryResult& b) {
+        return a.dist2 < b.dist2 || (a.dist2 == b.dist2 && a.id < b.id);
+      });
+    }
+
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    size_t capacity() const { return items.capacity(); }
+    uint64_t growths() const { return growCount; }
+
+    const QueryResult& operator[](size_t i) const { return items[i]; }
+    std::vector<QueryResult>::const_iterator begin() const { return items.begin(); }
+    std::vector<QueryResult>::const_iterator end() const { return items.end(); }
+
+  private:
+    std::vector<QueryResult> items;
+    uint64_t growCount = 0;
+};
+
+// Grava no buffer as entradas de folha com distância² <= radius² (k-NN: sem raio)
+class ResultCollector : public SpatialIndex::IVisitor {
+  public:
+    TraversalTrace* trace = nullptr;   // Nós lidos por nível (opcional)
+    uint64_t candidates = 0;           // Entradas de folha entregues pela árvore
+    double (*l2Squared)(const double*, const double*, uint32_t) = l2SquaredScalar;
+
+    ResultCollector(ResultBuffer& buffer, const double* q, uint32_t dim, double radius = INFINITY)
+        : out(buffer), query(q), dimension(dim), radius2(radius * radius) {}
+
+    void visitNode(const SpatialIndex::INode& n) override {
+      if (trace != nullptr) trace->recordNode(n);
+    }
+
+    void visitData(const SpatialIndex::IData& d) override {
+      candidates++;
+      // Pontos: low == high, lido direto do MBR público do RTree::Data
+      const SpatialIndex::RTree::Data* data = dynamic_cast<const SpatialIndex::RTree::Data*>(&d);
+      double dist2;
+      if (data != nullptr) {
+        dist2 = l2Squared(data->m_region.m_pLow, query, dimension);
+      } else {
+        SpatialIndex::IShape* shape;
+        d.getShape(&shape);
+        SpatialIndex::Region mbr;
+        shape->getMBR(mbr);
+        dist2 = l2Squared(mbr.m_pLow, query, dimension);
+        delete shape;
+      }
+      if (dist2 <= radius2) out.add(d.getIdentifier(), dist2);
+    }
+
+    void visitData(std::vector<const SpatialIndex::IData*>&) override {}
+
+  private:
+    ResultBuffer& out;
+    const double* query;
+    uint32_t dimension;
+    double radius2;
+};
+
+// k-NN na RTree: os k vizinhos (mais os empatados com o k-ésimo) em "out", em ordem de distância
+inline uint64_t collectNearestNeighbors(SpatialIndex::ISpatialIndex& tree, const double* q, uint32_t dim, uint32_t k,
+                                        ResultBuffer& out, TraversalTrace* trace = nullptr) {
+  out.clear();
+  ResultCollector collector(out, q, dim);
+  collector.trace = trace;
+  SpatialIndex::Point queryPoint(q, dim);
+  tree.nearestNeighborQuery(k, queryPoint, collector);
+  out.sortByDistance();
+  return collector.candidates;
+}
+
+// Range na RTree (bola L2 exata ou caixa de lado 2·raio filtrada pela distância): os pontos
+// a até "radius" de q em "out", em ordem de distância. Devolve os candidatos examinados.
+inline uint64_t collectRange(SpatialIndex::ISpatialIndex& tree, const double* q, uint32_t dim, double radius, bool ballShape,
+                             ResultBuffer& out, TraversalTrace* trace = nullptr) {
+  out.clear();
+  ResultCollector collector(out, q, dim, radius);
+  collector.trace = trace;
+  if (ballShape) {
+    BallRegion ball(q, radius, dim);
+    tree.intersectsWithQuery(ball, collector);
+  } else {
+    std::vector<double> low(q, q + dim), high(q, q + dim);
+    for (uint32_t d = 0; d < dim; d++) {
+      low[d] -= radius;
+      high[d] += radius;
+    }
+    SpatialIndex::Region box(low.data(), high.data(), dim);
+    tree.intersectsWithQuery(box, collector);
+  }
+  out.sortByDistance();
+  return collector.candidates;
+}
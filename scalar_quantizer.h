@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "dataset_io.h"
+
+// --- Precisão das Coordenadas ---
+// Compartilhado pelo índice quantizado (quantized_storage.h) e pelo Ground Truth
+// (ground_truth.h): float64 (original), float32 ou int8 com quantização escalar por dimensão.
+
+enum class CoordPrecision : uint8_t { Float64 = 0, Float32 = 1, Int8 = 2 };
+
+inline CoordPrecision parseCoordPrecision(const std::string& name) {
+  if (name == "float64" || name == "double") return CoordPrecision::Float64;
+  if (name == "float32" || name == "float") return CoordPrecision::Float32;
+  if (name == "int8") return CoordPrecision::Int8;
+  throw std::invalid_argument("Precisão inválida: " + name + " (use float64, float32 ou int8)");
+}
+
+inline std::string coordPrecisionName(CoordPrecision p) {
+  switch (p) {
+    case CoordPrecision::Float32: return "float32";
+    case CoordPrecision::Int8: return "int8";
+    default: return "float64";
+  }
+}
+
+// Quantização escalar por dimensão: valor = min + código * escala, código em [0, 255]
+struct ScalarQuantizer {
+  std::vector<double> minV;
+  std::vector<double> scale;
+
+  static ScalarQuantizer fromDataset(const Dataset& data) {
+    uint32_t dim = data.dimension();
+    ScalarQuantizer sq;
+    std::vector<double> maxV(dim, -std::numeric_limits<double>::infinity());
+    sq.minV.assign(dim, std::numeric_limits<double>::infinity());
+    std::vector<double> scratch(dim);
+    for (uint64_t i = 0; i < data.size(); i++) {
+      const double* r = data.row(i, scratch.data());
+      for (uint32_t d = 0; d < dim; d++) {
+        sq.minV[d] = std::min(sq.minV[d], r[d]);
+        maxV[d] = std::max(maxV[d], r[d]);
+      }
+    }
+    sq.scale.resize(dim);
+    for (uint32_t d = 0; d < dim; d++) {
+      if (data.size() == 0) { sq.minV[d] = 0; maxV[d] = 0; }
+      double range = maxV[d] - sq.minV[d];
+      sq.scale[d] = range > 0 ? range / 255.0 : 1.0;
+    }
+    return sq;
+  }
+
+  double decode(uint32_t d, uint8_t c) const { return minV[d] + c * scale[d]; }
+
+  // Maior código cujo valor decodificado é <= x (para low) ...
+  uint8_t encodeDown(uint32_t d, double x) const {
+    double v = std::floor((x - minV[d]) / scale[d]);
+    int c = static_cast<int>(std::max(0.0, std::min(255.0, v)));
+    while (c < 255 && decode(d, c + 1) <= x) c++;
+    while (c > 0 && decode(d, c) > x) c--;
+    return static_cast<uint8_t>(c);
+  }
+
+  // ... e menor código cujo valor decodificado é >= x (para high)
+  uint8_t encodeUp(uint32_t d, double x) const {
+    double v = std::ceil((x - minV[d]) / scale[d]);
+    int c = static_cast<int>(std::max(0.0, std::min(255.0, v)));
+    while (c > 0 && decode(d, c - 1) >= x) c--;
+    while (c < 255 && decode(d, c) < x) c++;
+    return static_cast<uint8_t>(c);
+  }
+
+  // Arquivo <índice>.quant: magic "RTQUANT1" | uint32 dim | min[dim] | escala[dim]
+  void save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint32_t dim = static_cast<uint32_t>(minV.size());
+    out.write("RTQUANT1", 8);
+    out.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+    out.write(reinterpret_cast<const char*>(minV.data()), dim * sizeof(double));
+    out.write(reinterpret_cast<const char*>(scale.data()), dim * sizeof(double));
+    if (!out) throw std::runtime_error("Falha ao gravar " + path);
+  }
+
+  static ScalarQuantizer load(const std::string& path, uint32_t expectedDim) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    uint32_t dim = 0;
+    in.read(magic, 8);
+    in.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+    if (!in || memcmp(magic, "RTQUANT1", 8) != 0 || dim != expectedDim) {
+      throw std::runtime_error("Parâmetros de quantização inválidos ou ausentes: " + path);
+    }
+    ScalarQuantizer sq;
+    sq.minV.resize(dim);
+    sq.scale.resize(dim);
+    in.read(reinterpret_cast<char*>(sq.minV.data()), dim * sizeof(double));
+    in.read(reinterpret_cast<char*>(sq.scale.data()), dim * sizeof(double));
+    if (!in) throw std::runtime_error("Arquivo de quantização truncado: " + path);
+    return sq;
+  }
+};
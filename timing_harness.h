@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+
+// --- Medição Repetida ---
+// Uma única execução por consulta mistura o custo da consulta com page faults, cache frio
+// e ruído do escalonador. O benchmark pode repetir cada consulta (--repeat), aquecer antes
+// (--warmup), rodar com o índice fora do page cache do SO (--cold-cache) e fixar a thread
+// de medição num núcleo (--pin-cpu). Aqui ficam as peças reutilizáveis dessas opções.
+
+// Estatísticas de uma amostra de tempos (ms). O IC de 95% da média usa a distribuição t
+// de Student (n - 1 graus de liberdade), pois o número de amostras costuma ser pequeno.
+struct TimingSummary {
+  size_t samples = 0;
+  double mean = 0;
+  double median = 0;
+  double stddev = 0;   // Desvio padrão amostral (n - 1)
+  double min = 0;
+  double max = 0;
+  double ciLow = 0;    // IC de 95% da média
+  double ciHigh = 0;
+};
+
+// Quantil 0.975 da t de Student por graus de liberdade (1..30); acima disso converge para a normal
+inline double studentT975(size_t df) {
+  static const double table[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  if (df == 0) return 0.0;
+  if (df <= 30) return table[df - 1];
+  if (df <= 60) return 2.000;
+  if (df <= 120) return 1.980;
+  return 1.960;
+}
+
+inline TimingSummary summarizeTimings(std::vector<double> values) {
+  TimingSummary s;
+  s.samples = values.size();
+  if (values.empty()) return s;
+  std::sort(values.begin(), values.end());
+  size_t n = values.size();
+  s.min = values.front();
+  s.max = values.back();
+  s.median = (n % 2) ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+  s.mean = std::accumulate(values.begin(), values.end(), 0.0) / n;
+  double sq = 0;
+  for (double v : values) sq += (v - s.mean) * (v - s.mean);
+  s.stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0.0;
+  double half = studentT975(n - 1) * s.stddev / std::sqrt(static_cast<double>(n));
+  s.ciLow = s.mean - half;
+  s.ciHigh = s.mean + half;
+  return s;
+}
+
+// Remove um arquivo do page cache do SO. As páginas sujas são gravadas antes (fdatasync),
+// pois POSIX_FADV_DONTNEED só descarta páginas limpas. Retorna false se não for possível.
+inline bool dropFileFromPageCache(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  bool ok = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+  ::close(fd);
+  return ok;
+}
+
+// Fixa a thread atual num núcleo enquanto o objeto existir e restaura a afinidade original
+// no destrutor. As threads criadas nesse intervalo herdam a afinidade, então o escopo deve
+// cobrir só a medição sequencial (o modo concorrente roda depois, sem o pin).
+class ScopedCpuPin {
+  public:
+    explicit ScopedCpuPin(int cpu) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE || sched_getaffinity(0, sizeof(previous), &previous) != 0) return;
+      cpu_set_t target;
+      CPU_ZERO(&target);
+      CPU_SET(cpu, &target);
+      pinned = sched_setaffinity(0, sizeof(target), &target) == 0;
+    }
+
+    ~ScopedCpuPin() {
+      if (pinned) sched_setaffinity(0, sizeof(previous), &previous);
+    }
+
+    ScopedCpuPin(const ScopedCpuPin&) = delete;
+    ScopedCpuPin& operator=(const ScopedCpuPin&) = delete;
+
+    bool active() const { return pinned; }
+
+  private:
+    cpu_set_t previous;
+    bool pinned = false;
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// --- Rastreamento da Travessia ---
+// A RTree chama visitor.visitNode(nó) para cada nó lido numa consulta (internos e folhas,
+// tanto na Range quanto no k-NN). TraversalTrace acumula, por consulta:
+//
+//  * nós visitados por nível (0 = folhas) e o total de filhos desses nós;
+//  * eficiência da poda: fração dos filhos dos nós internos visitados que NÃO foi lida
+//    (1 - nós lidos abaixo da raiz / filhos examinados);
+//  * com "geometry" ligado (--trace), a geometria dos nós internos visitados: fração de
+//    pares de filhos cujos MBRs se sobrepõem e espaço morto (1 - Σ volume dos filhos /
+//    volume do nó, calculado em log para não estourar em 282-d). Esses cálculos copiam os
+//    MBRs dos filhos e por isso ficam fora do modo padrão.
+//
+// reset() preserva a capacidade dos vetores, então o mesmo objeto pode ser reaproveitado
+// entre consultas sem novas alocações no modo padrão.
+
+class TraversalTrace {
+  public:
+    bool geometry = false;
+
+    void reset() {
+      std::fill(nodesPerLevel.begin(), nodesPerLevel.end(), 0);
+      std::fill(childrenPerLevel.begin(), childrenPerLevel.end(), 0);
+      overlapSum = 0;
+      overlapNodes = 0;
+      deadSpaceSum = 0;
+      deadSpaceNodes = 0;
+    }
+
+    void recordNode(const SpatialIndex::INode& node) {
+      uint32_t level = node.getLevel();
+      if (level >= nodesPerLevel.size()) {
+        nodesPerLevel.resize(level + 1, 0);
+        childrenPerLevel.resize(level + 1, 0);
+      }
+      nodesPerLevel[level]++;
+      childrenPerLevel[level] += node.getChildrenCount();
+      if (geometry && !node.isLeaf()) recordGeometry(node);
+    }
+
+    uint64_t leafNodes() const { return nodesPerLevel.empty() ? 0 : nodesPerLevel[0]; }
+
+    uint64_t internalNodes() const {
+      uint64_t n = 0;
+      for (size_t l = 1; l < nodesPerLevel.size(); l++) n += nodesPerLevel[l];
+      return n;
+    }
+
+    // 1 - (nós lidos abaixo do nível mais alto visitado) / (filhos dos nós internos visitados)
+    double pruningEfficiency() const {
+      uint64_t examined = 0, descended = 0;
+      size_t top = topLevel();
+      for (size_t l = 0; l < nodesPerLevel.size(); l++) {
+        if (l >= 1) examined += childrenPerLevel[l];
+        if (l < top) descended += nodesPerLevel[l];
+      }
+      return examined > 0 ? 1.0 - (double)descended / examined : 0.0;
+    }
+
+    // Média, nos nós internos visitados, da fração de pares de filhos sobrepostos (só com geometry)
+    double overlapFraction() const { return overlapNodes > 0 ? overlapSum / overlapNodes : 0.0; }
+
+    // Espaço morto médio dos nós internos visitados com volume não nulo (só com geometry)
+    double deadSpace() const { return deadSpaceNodes > 0 ? deadSpaceSum / deadSpaceNodes : 0.0; }
+
+    // Histograma compacto "nível:nós", do nível mais alto para as folhas (ex: "3:1 2:4 1:31 0:228")
+    void writeLevels(std::ostream& out) const {
+      bool first = true;
+      for (size_t l = nodesPerLevel.size(); l-- > 0;) {
+        if (nodesPerLevel[l] == 0) continue;
+        out << (first ? "" : " ") << l << ":" << nodesPerLevel[l];
+        first = false;
+      }
+    }
+
+    // Uma linha JSON (JSON Lines) com o rastreamento completo de uma consulta
+    void writeJson(std::ostream& out, uint64_t queryId, const std::string& type, double param,
+                   uint64_t candidates, uint64_t results) const {
+      out << "{\"query\":" << queryId << ",\"tipo\":\"" << type << "\",\"param\":" << param
+          << ",\"nos_internos\":" << internalNodes() << ",\"nos_folha\":" << leafNodes()
+          << ",\"candidatos\":" << candidates << ",\"resultados\":" << results
+          << ",\"eficiencia_poda\":" << pruningEfficiency() << ",\"niveis\":[";
+      bool first = true;
+      for (size_t l = nodesPerLevel.size(); l-- > 0;) {
+        if (nodesPerLevel[l] == 0) continue;
+        out << (first ? "" : ",") << "{\"nivel\":" << l << ",\"nos\":" << nodesPerLevel[l]
+            << ",\"filhos\":" << childrenPerLevel[l] << "}";
+        first = false;
+      }
+      out << "]";
+      if (geometry) out << ",\"sobreposicao\":" << overlapFraction() << ",\"espaco_morto\":" << deadSpace();
+      out << "}\n";
+    }
+
+  private:
+    std::vector<uint64_t> nodesPerLevel;
+    std::vector<uint64_t> childrenPerLevel;
+    double overlapSum = 0;
+    uint64_t overlapNodes = 0;
+    double deadSpaceSum = 0;
+    uint64_t deadSpaceNodes = 0;
+    std::vector<SpatialIndex::Region> children;  // MBRs dos filhos do nó atual (reaproveitado)
+
+    size_t topLevel() const {
+      for (size_t l = nodesPerLevel.size(); l-- > 0;) {
+        if (nodesPerLevel[l] > 0) return l;
+      }
+      return 0;
+    }
+
+    // log(volume) do MBR; -inf se alguma dimensão tiver extensão nula
+    static double logVolume(const SpatialIndex::Region& r) {
+      double sum = 0;
+      for (uint32_t d = 0; d < r.m_dimension; d++) {
+        double extent = r.m_pHigh[d] - r.m_pLow[d];
+        if (extent <= 0) return -INFINITY;
+        sum += std::log(extent);
+      }
+      return sum;
+    }
+
+    void recordGeometry(const SpatialIndex::INode& node) {
+      uint32_t count = node.getChildrenCount();
+      children.resize(count);
+      for (uint32_t c = 0; c < count; c++) {
+        SpatialIndex::IShape* shape;
+        node.getChildShape(c, &shape);
+        shape->getMBR(children[c]);
+        delete shape;
+      }
+
+      uint64_t pairs = (uint64_t)count * (count - 1) / 2, overlapping = 0;
+      for (uint32_t a = 0; a < count; a++) {
+        for (uint32_t b = a + 1; b < count; b++) overlapping += children[a].intersectsRegion(children[b]);
+      }
+      // Cada nó pesa igual na média, qualquer que seja o número de filhos
+      if (pairs > 0) {
+        overlapSum += (double)overlapping / pairs;
+        overlapNodes++;
+      }
+
+      SpatialIndex::IShape* shape;
+      node.getShape(&shape);
+      SpatialIndex::Region mbr;
+      shape->getMBR(mbr);
+      delete shape;
+      double nodeLog = logVolume(mbr);
+      if (!std::isfinite(nodeLog)) return;
+      double covered = 0;
+      for (const SpatialIndex::Region& child : children) {
+        double childLog = logVolume(child);
+        if (std::isfinite(childLog)) covered += std::exp(childLog - nodeLog);
+      }
+      deadSpaceSum += std::max(0.0, 1.0 - covered);
+      deadSpaceNodes++;
+    }
+};
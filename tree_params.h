@@ -0,0 +1,125 @@
+#pragma once
+
+#include <spatialindex/SpatialIndex.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "cli_options.h"
+
+// --- Parâmetros da Árvore ---
+// Tamanho de página, capacidades, fill factor e variante usados na criação do índice.
+// No modo normal vêm de --page-size, --index-capacity, --leaf-capacity, --fill-factor e
+// --variant; no modo --sweep cada opção no plural aceita uma lista e o benchmark percorre
+// o produto cartesiano delas.
+
+struct TreeParams {
+  uint32_t pageSize = 4096;               // Tamanho da página em disco
+  double fillFactor = 0.7;                // Ocupação mínima dos nós (construção incremental)
+  uint32_t indexCapacity = 100;           // Capacidade dos nós internos
+  uint32_t leafCapacity = 10;             // Capacidade das folhas
+  double bulkFillFactor = 0.99;           // Ocupação alvo dos nós no bulk loading (STR e Hilbert)
+  SpatialIndex::RTree::RTreeVariant variant = SpatialIndex::RTree::RV_RSTAR;
+
+  // O fill factor tem sentidos diferentes por modo: ocupação mínima na construção
+  // incremental e ocupação alvo no bulk loading (str, parallel e o empacotamento hilbert/external).
+  void setFillFactor(const std::string& buildMode, double f) {
+    if (isBulkMode(buildMode)) bulkFillFactor = f;
+    else fillFactor = f;
+  }
+
+  double activeFillFactor(const std::string& buildMode) const {
+    return isBulkMode(buildMode) ? bulkFillFactor : fillFactor;
+  }
+
+  static bool isBulkMode(const std::string& buildMode) {
+    return buildMode == "str" || buildMode == "parallel" || buildMode == "hilbert" || buildMode == "external";
+  }
+
+  // Modos em que bulkFillFactor vai para o bulk loader STR da biblioteca; no hilbert/external
+  // ele só define a ocupação do empacotamento (packed_tree.h)
+  static bool isLibraryBulkMode(const std::string& buildMode) { return buildMode == "str" || buildMode == "parallel"; }
+
+  // Faixas aceitas: a biblioteca exige fill factor em (0, 1) em createNewRTree e no STR; o
+  // empacotamento hilbert/external aceita até 1 (nós completamente cheios)
+  void validate(const std::string& buildMode) const {
+    if (!(fillFactor > 0.0 && fillFactor < 1.0)) {
+      throw std::invalid_argument("fill factor " + std::to_string(fillFactor) + " fora de (0, 1)");
+    }
+    bool packed = isBulkMode(buildMode) && !isLibraryBulkMode(buildMode);
+    if (!(bulkFillFactor > 0.0 && (packed ? bulkFillFactor <= 1.0 : bulkFillFactor < 1.0))) {
+      throw std::invalid_argument("fill factor " + std::to_string(bulkFillFactor) + " fora de " +
+                                  (packed ? "(0, 1]" : "(0, 1)") + " no modo " + buildMode);
+    }
+  }
+
+  // As variantes linear e quadratic da biblioteca recusam fill factor acima de 0.5. Limita os
+  // fill factors que chegam à biblioteca no modo (fillFactor vai sempre para createNewRTree) e
+  // devolve true se algum foi reduzido.
+  bool limitFillFactorToVariant(const std::string& buildMode) {
+    if (variant == SpatialIndex::RTree::RV_RSTAR) return false;
+    bool libraryBulk = isLibraryBulkMode(buildMode);
+    bool changed = fillFactor > 0.5 || (libraryBulk && bulkFillFactor > 0.5);
+    fillFactor = std::min(fillFactor, 0.5);
+    if (libraryBulk) bulkFillFactor = std::min(bulkFillFactor, 0.5);
+    return changed;
+  }
+};
+
+inline SpatialIndex::RTree::RTreeVariant parseTreeVariant(const std::string& name) {
+  if (name == "rstar") return SpatialIndex::RTree::RV_RSTAR;
+  if (name == "quadratic") return SpatialIndex::RTree::RV_QUADRATIC;
+  if (name == "linear") return SpatialIndex::RTree::RV_LINEAR;
+  throw std::invalid_argument("Variante inválida: " + name + " (use rstar, quadratic ou linear)");
+}
+
+inline std::string treeVariantName(SpatialIndex::RTree::RTreeVariant v) {
+  switch (v) {
+    case SpatialIndex::RTree::RV_QUADRATIC: return "quadratic";
+    case SpatialIndex::RTree::RV_LINEAR: return "linear";
+    default: return "rstar";
+  }
+}
+
+// Sufixo que identifica a configuração no nome do índice (ex: ps4096_ic100_lc10_ff0.7_rstar)
+inline std::string treeParamsTag(const TreeParams& p, const std::string& buildMode) {
+  std::ostringstream tag;
+  tag << "ps" << p.pageSize << "_ic" << p.indexCapacity << "_lc" << p.leafCapacity
+      << "_ff" << p.activeFillFactor(buildMode) << "_" << treeVariantName(p.variant);
+  return tag.str();
+}
+
+// Produto cartesiano das listas de --page-sizes, --index-capacities, --leaf-capacities,
+// --fill-factors e --variants. Listas omitidas usam o valor de "base". Sem --fill-factors,
+// as variantes linear e quadratic usam fill factor 0.5 (o padrão delas seria recusado).
+inline std::vector<TreeParams> expandParameterSweep(int argc, char** argv, const TreeParams& base,
+                                                    const std::string& buildMode) {
+  auto listOr = [&](const std::string& name, const std::string& fallback) {
+    std::vector<std::string> items = splitOptionList(getOption(argc, argv, name, fallback));
+    if (items.empty()) items.push_back(fallback);
+    return items;
+  };
+  bool explicitFill = hasOption(argc, argv, "fill-factors");
+  std::ostringstream baseFill;
+  baseFill << base.activeFillFactor(buildMode);
+
+  std::vector<TreeParams> configs;
+  for (const std::string& ps : listOr("page-sizes", std::to_string(base.pageSize)))
+    for (const std::string& ic : listOr("index-capacities", std::to_string(base.indexCapacity)))
+      for (const std::string& lc : listOr("leaf-capacities", std::to_string(base.leafCapacity)))
+        for (const std::string& ff : listOr("fill-factors", baseFill.str()))
+          for (const std::string& v : listOr("variants", treeVariantName(base.variant))) {
+            TreeParams p = base;
+            p.pageSize = static_cast<uint32_t>(std::stoul(ps));
+            p.indexCapacity = static_cast<uint32_t>(std::stoul(ic));
+            p.leafCapacity = static_cast<uint32_t>(std::stoul(lc));
+            p.setFillFactor(buildMode, std::stod(ff));
+            p.variant = parseTreeVariant(v);
+            p.validate(buildMode);
+            if (!explicitFill) p.limitFillFactorToVariant(buildMode);
+            configs.push_back(p);
+          }
+  return configs;
+}
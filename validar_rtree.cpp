@@ -10,8 +10,25 @@
 #include <cmath>
 #include <random>
 #include <iomanip>
+#include <numeric>
 #include <unistd.h>
 
+#include "cli_options.h"
+#include "dataset_io.h"
+#include "ground_truth.h"
+#include "gt_cache.h"
+#include "page_cache.h"
+#include "ball_query.h"
+#include "batch_knn.h"
+#include "quantized_storage.h"
+#include "pca_projection.h"
+#include "traversal_trace.h"
+#include "perf_counters.h"
+#include "flat_index.h"
+#include "mixed_workload.h"
+#include "result_buffer.h"
+#include "query_workload.h"
+
 using namespace SpatialIndex;
 using namespace std;
 namespace fs = std::filesystem;
@@ -25,33 +42,47 @@ double getRAMUsageMB() {
   return 0.0;
 }
 
-double getL2(const vector<double>& p1, const double* p2, int dim) {
-  double sum = 0;
-  for (int i = 0; i < dim; ++i) {
-    double diff = p1[i] - p2[i];
-    sum += diff * diff;
-  }
-  return sqrt(sum);
+// Prints the throughput of the brute-force ground truth passes
+void printGroundTruthRate(const string& label, double seconds, size_t queries, const GroundTruthStore& store, unsigned threads) {
+  double gflops = (seconds > 0) ? groundTruthFlops(store) * queries / seconds / 1e9 : 0.0;
+  cout << "Ground truth " << label << ": " << seconds << " s for " << queries << " queries, "
+       << gflops << " GFLOP/s (kernel=" << store.kernel().name << ", threads=" << threads << ")" << endl;
 }
 
-// --- Structures ---
-
-struct PointEntry {
-  uint64_t id;
-  vector<double> coords;
-  double dist;
-};
+// Times the k-NN ground truth at 1, 2, 4, ... maxThreads threads and prints speedup/efficiency
+void reportGroundTruthScaling(const GroundTruthStore& store, const vector<vector<double>>& queries, uint32_t K, unsigned maxThreads) {
+  cout << "\n--- Ground truth scaling (k-NN, " << queries.size() << " queries) ---" << endl;
+  double baseSeconds = 0;
+  for (unsigned t = 1; ; t = min(t * 2, maxThreads)) {
+    auto start = chrono::high_resolution_clock::now();
+    knnGroundTruthAll(store, queries, K, t);
+    double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    if (t == 1) baseSeconds = seconds;
+    double speedup = seconds > 0 ? baseSeconds / seconds : 0.0;
+    cout << "threads=" << t << " time=" << seconds << " s speedup=" << speedup
+         << " efficiency=" << speedup / t << endl;
+    if (t == maxThreads) break;
+  }
+}
 
 // --- Validation Visitor ---
-// Captures IDs of results.
-// For Range Queries, explicitly checks L2 distance to filter false positives from MBR search.
+// Collects (id, squared L2 distance) pairs into a ResultBuffer (see result_buffer.h).
+// For Range Queries, explicitly checks (squared) L2 distance to filter false positives from MBR search.
+// The visitor is reused across queries so the buffer is allocated once.
 class ValidationVisitor : public IVisitor {
 public:
-  vector<uint64_t> neighborIds;
+  ResultBuffer results;
   const double* queryPoint;
   double queryRadius;
   uint32_t dimension;
   bool isRangeQuery;
+  double (*l2Squared)(const double*, const double*, uint32_t) = l2SquaredScalar;
+  // PCA index: the tree holds projected points, so range distances come from the full rows
+  const Dataset* exactRows = nullptr;
+  vector<double> scratch;
+  // Nodes read per level (see traversal_trace.h) and leaf entries handed to the visitor
+  TraversalTrace* trace = nullptr;
+  uint64_t candidates = 0;
 
   ValidationVisitor() : queryPoint(nullptr), queryRadius(0), dimension(0), isRangeQuery(false) {}
   
@@ -60,28 +91,37 @@ public:
       queryRadius = r;
       dimension = d;
       isRangeQuery = isRange;
-      neighborIds.clear();
+      results.clear();
+      candidates = 0;
   }
 
-  void visitNode(const INode& n) override {}
+  void visitNode(const INode& n) override {
+      if (trace != nullptr) trace->recordNode(n);
+  }
   
   void visitData(const IData& d) override { 
-      if (isRangeQuery) {
-          IShape* shape;
-          d.getShape(&shape);
-          Region mbr;
-          shape->getMBR(mbr);
-          
-          // Assuming point data, low == high == point coords
-          double dist = getL2(vector<double>(mbr.m_pLow, mbr.m_pLow + dimension), queryPoint, dimension);
-          if (dist <= queryRadius) {
-               neighborIds.push_back(d.getIdentifier());
-          }
-          delete shape;
+      candidates++;
+      double dist2;
+      if (exactRows != nullptr) {
+          scratch.resize(dimension);
+          dist2 = l2Squared(exactRows->row(static_cast<uint64_t>(d.getIdentifier()), scratch.data()), queryPoint, dimension);
       } else {
-          // k-NN handles its own filtering
-          neighborIds.push_back(d.getIdentifier()); 
+          // Assuming point data, low == high == point coords. RTree::Data exposes its
+          // region, so read it in place instead of allocating a copy via getShape.
+          const RTree::Data* data = dynamic_cast<const RTree::Data*>(&d);
+          if (data != nullptr) {
+              dist2 = l2Squared(data->m_region.m_pLow, queryPoint, dimension);
+          } else {
+              IShape* shape;
+              d.getShape(&shape);
+              Region mbr;
+              shape->getMBR(mbr);
+              dist2 = l2Squared(mbr.m_pLow, queryPoint, dimension);
+              delete shape;
+          }
       }
+      // k-NN handles its own filtering
+      if (!isRangeQuery || dist2 <= queryRadius * queryRadius) results.add(d.getIdentifier(), dist2);
   }
   
   void visitData(vector<const IData*>& v) override {}
@@ -89,7 +129,7 @@ public:
 
 int main(int argc, char** argv) {
   if (argc < 3) {
-    cerr << "Uso: " << argv[0] << " <caminho_dataset> <dimensao>" << endl;
+    cerr << "Uso: " << argv[0] << " <caminho_dataset> <dimensao> [--format=auto|csv] [--layout=row|blocked] [--kernel=auto|scalar|avx2|avx512] [--threads=N] [--gt-scaling] [--gt-cache=dir] [--no-gt-cache] [--range-shape=ball|box] [--knn-batch=N] [--gt-precision=float64|float32|int8] [--approx-sweep [--approx-eps=...] [--approx-leaves=...]] [--pca=M] [--memory-budget=256MB] [--flat] [--churn] [--queries=name]" << endl;
     return 1;
   }
 
@@ -99,6 +139,15 @@ int main(int argc, char** argv) {
   unsigned int dimension = stoi(argv[2]);
 
   string baseName = "rtree_index_" + datasetName;
+  // --pca=M validates the reduced index built by benchmark_rstar --pca=M (filter + exact refinement)
+  uint32_t pcaDim = static_cast<uint32_t>(stoul(getOption(argc, argv, "pca", "0")));
+  bool usePca = pcaDim > 0;
+  if (usePca) baseName += "_pca" + to_string(pcaDim);
+  uint32_t treeDim = usePca ? pcaDim : dimension;
+  // --churn validates the index left by benchmark_rstar --workload: rtree_index_<name>_churn,
+  // with ground truth over the live set described by <index>.churn
+  bool useChurn = hasOption(argc, argv, "churn");
+  if (useChurn) baseName += "_churn";
 
   // --- 1. Load Ground Truth ---
   cout << "Loading Ground Truth Dataset..." << endl;
@@ -109,6 +158,9 @@ int main(int argc, char** argv) {
             "../datasets/" + dataset_arg + ".txt",
             "data/" + dataset_arg + ".txt",
             "datasets_processed/Imagenet32_train/" + dataset_arg + ".txt",
+            "./datasets/" + dataset_arg + ".bin",
+            "../datasets/" + dataset_arg + ".bin",
+            "data/" + dataset_arg + ".bin",
             dataset_arg
         };
         for (const auto& path : searchPaths) {
@@ -124,23 +176,179 @@ int main(int argc, char** argv) {
       return 1;
   }
 
-  vector<PointEntry> fullData;
-  ifstream infile(datasetPath);
-  string line; uint64_t currentId = 0;
-  while (getline(infile, line)) {
-    stringstream ss(line); string val; vector<double> c;
-    while (getline(ss, val, ',')) c.push_back(stod(val));
-    if (c.size() == dimension) fullData.push_back({currentId++, c, 0.0});
+  // Uses the binary (mmap) version produced by converter_dataset when present, else parses the CSV
+  bool useBinary = getOption(argc, argv, "format", "auto") != "csv";
+  // Range queries use the exact L2 ball by default; "box" restores the cube + post-filter path
+  bool ballShape = getOption(argc, argv, "range-shape", "ball") != "box";
+  // --flat: answer the k-NN and Range queries with the in-memory flat engine (flat_index.h)
+  bool useFlat = hasOption(argc, argv, "flat");
+  // --memory-budget: never load the dataset; ground truth is computed block-wise from a
+  // chunked reader, half of the budget per chunk (the rest for answers and scan scratch)
+  uint64_t memoryBudget = 0;
+  try {
+    if (hasOption(argc, argv, "memory-budget")) memoryBudget = parseByteSize(getOption(argc, argv, "memory-budget", "256MB"));
+  } catch (std::exception& e) {
+    cerr << e.what() << endl;
+    return 1;
   }
-  cout << "Loaded " << fullData.size() << " points." << endl;
+  bool streamed = memoryBudget > 0;
+  size_t chunkRows = streamed ? max<uint64_t>(1, memoryBudget / 2 / (dimension * sizeof(double))) : 0;
+  if (streamed && (usePca || getOption(argc, argv, "gt-precision", "float64") != "float64")) {
+    cerr << "--memory-budget cannot be combined with --pca or --gt-precision (both keep the dataset in memory)." << endl;
+    return 1;
+  }
+  if (useChurn && (streamed || usePca)) {
+    cerr << "--churn cannot be combined with --memory-budget or --pca." << endl;
+    return 1;
+  }
+
+  Dataset dataset;
+  DatasetChunkReader chunkReader;
+  try {
+    if (streamed) chunkReader.open(datasetPath, dimension, useBinary);
+    else dataset.open(datasetPath, dimension, useBinary);
+  } catch (std::exception& e) {
+    cerr << "Error loading dataset: " << e.what() << endl;
+    return 1;
+  }
+  // Churned index: the dataset is replaced by its live rows; liveIds maps row -> index id
+  vector<uint64_t> liveIds;
+  if (useChurn) {
+    try {
+      ChurnLog churn = ChurnLog::load(baseName + ".churn", dimension);
+      vector<double> liveValues;
+      churn.liveRows(dataset, liveValues, liveIds);
+      string label = dataset.sourcePath() + " (live set after churn)";
+      dataset.assign(std::move(liveValues), dimension, label);
+      cout << "Churn log: " << churn.deleted.size() << " points deleted, " << churn.insertedIds.size()
+           << " inserted and still live" << endl;
+    } catch (std::exception& e) {
+      cerr << "Error loading churn log: " << e.what() << endl;
+      return 1;
+    }
+  }
+  if (streamed) {
+    cout << "Dataset source: " << chunkReader.sourcePath() << " (streamed in blocks of " << chunkRows
+         << " rows, budget " << memoryBudget / (1024.0 * 1024.0) << " MB)" << endl;
+  } else {
+    cout << "Dataset source: " << dataset.sourcePath() << " (" << dataset.formatName() << "), load time "
+         << dataset.loadSeconds << " s, RSS " << getResidentMemoryMB() << " MB" << endl;
+  }
+
+  // Ground truth lives in one contiguous aligned buffer, scanned with SIMD squared-L2 kernels
+  L2Kernels kernels = selectL2Kernels(getOption(argc, argv, "kernel", "auto"));
+  GroundTruthStore::Layout layout = getOption(argc, argv, "layout", "row") == "blocked"
+                                      ? GroundTruthStore::Layout::Blocked : GroundTruthStore::Layout::RowMajor;
+  unsigned threads = resolveThreadCount(getOption(argc, argv, "threads", "auto"));
+  // float32 / int8 keep compressed coordinates in memory and re-rank exactly against the dataset
+  CoordPrecision gtPrecision;
+  try {
+    gtPrecision = parseCoordPrecision(getOption(argc, argv, "gt-precision", "float64"));
+  } catch (std::exception& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  // Built lazily: when every answer comes from the ground truth cache the linear scan is never needed
+  GroundTruthStore fullData;
+  bool storeReady = false;
+  auto groundTruthStore = [&]() -> const GroundTruthStore& {
+    if (!storeReady) {
+      fullData.build(dataset, layout, kernels, gtPrecision);
+      storeReady = true;
+      cout << "Loaded " << fullData.size() << " points (layout="
+           << (fullData.layout() == GroundTruthStore::Layout::Blocked ? "blocked" : "row")
+           << ", kernel=" << kernels.name << ", precision=" << coordPrecisionName(gtPrecision)
+           << (fullData.isZeroCopy() ? ", zero-copy" : "") << ", " << fullData.memoryMB() << " MB, RSS "
+           << getResidentMemoryMB() << " MB)." << endl;
+    }
+    return fullData;
+  };
+
+  // Ground truth cache, keyed by dataset values, query vectors and K / radius
+  bool useGtCache = !hasOption(argc, argv, "no-gt-cache");
+  string gtCacheDir = getOption(argc, argv, "gt-cache", "gt_cache");
+  uint64_t datasetHash = !useGtCache ? 0 : streamed ? hashDatasetStreamed(chunkReader, chunkRows) : hashDataset(dataset);
+
+  // Loads the exact answers from the cache, or computes them in parallel and stores them
+  auto computeGroundTruth = [&](GroundTruthKind kind, const vector<vector<double>>& queries, double param) {
+    string label = (kind == GroundTruthKind::Knn) ? "k-NN" : "Range";
+    GroundTruthSet gt;
+    string cachePath;
+    if (useGtCache) {
+      uint64_t key = groundTruthCacheKey(datasetHash, queries, kind, param);
+      cachePath = groundTruthCachePath(gtCacheDir, datasetName, kind, key);
+      if (loadGroundTruth(cachePath, kind, key, queries.size(), gt)) {
+        cout << "Ground truth " << label << " loaded from cache " << cachePath << endl;
+        return gt;
+      }
+    }
+
+    if (streamed) {
+      resetPeakResidentMemory();
+      auto gtStart = chrono::high_resolution_clock::now();
+      gt = (kind == GroundTruthKind::Knn)
+             ? knnGroundTruthStreamed(chunkReader, chunkRows, queries, static_cast<uint32_t>(param), kernels, threads)
+             : rangeGroundTruthStreamed(chunkReader, chunkRows, queries, param, kernels, threads);
+      double gtSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - gtStart).count();
+      cout << "Ground truth " << label << " (block-wise): " << gtSeconds << " s for " << queries.size()
+           << " queries, " << chunkReader.position() << " points, peak RSS " << getPeakResidentMemoryMB() << " MB" << endl;
+    } else {
+      const GroundTruthStore& store = groundTruthStore();
+      auto gtStart = chrono::high_resolution_clock::now();
+      gt = (kind == GroundTruthKind::Knn) ? knnGroundTruthAll(store, queries, static_cast<uint32_t>(param), threads)
+                                          : rangeGroundTruthAll(store, queries, param, threads);
+      double gtSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - gtStart).count();
+      printGroundTruthRate(label, gtSeconds, queries.size(), store, threads);
+    }
+
+    if (useGtCache) {
+      saveGroundTruth(cachePath, kind, groundTruthCacheKey(datasetHash, queries, kind, param), gt);
+      cout << "Ground truth " << label << " cached in " << cachePath << endl;
+    }
+    return gt;
+  };
+
+  // Ground truth ids are dataset rows; on a churned index they are mapped back to index ids
+  auto obtainGroundTruth = [&](GroundTruthKind kind, const vector<vector<double>>& queries, double param) {
+    GroundTruthSet gt = computeGroundTruth(kind, queries, param);
+    if (!liveIds.empty()) {
+      // Live-set rows -> index ids; range answers stay sorted by id
+      for (size_t q = 0; q < gt.ids.size(); q++) {
+        for (uint64_t& id : gt.ids[q]) id = liveIds[id];
+        if (kind == GroundTruthKind::Range) {
+          vector<size_t> order(gt.ids[q].size());
+          iota(order.begin(), order.end(), size_t(0));
+          sort(order.begin(), order.end(), [&](size_t a, size_t b) { return gt.ids[q][a] < gt.ids[q][b]; });
+          vector<uint64_t> ids(order.size());
+          vector<double> dists(order.size());
+          for (size_t i = 0; i < order.size(); i++) {
+            ids[i] = gt.ids[q][order[i]];
+            dists[i] = gt.dists[q][order[i]];
+          }
+          gt.ids[q].swap(ids);
+          gt.dists[q].swap(dists);
+        }
+      }
+    }
+    return gt;
+  };
 
   // --- 2. Load R-Tree ---
   // Ensure we look in r_tree folder if baseName doesn't have it, but we added it above.
   cout << "Loading R-Tree: " << baseName << " (Index ID: 1)" << endl;
   try {
-      IStorageManager* storage = StorageManager::loadDiskStorageManager(baseName);
+      PcaProjection pca;
+      if (usePca) {
+          pca = PcaProjection::load(baseName + ".pca", dimension, pcaDim);
+          cout << "PCA projection: " << pcaDim << " of " << dimension << " dimensions, "
+               << 100.0 * pca.explainedVariance() << "% of the variance" << endl;
+      }
+      IStorageManager* diskStorage = StorageManager::loadDiskStorageManager(baseName);
+      // Counts node reads without the per-call Statistics allocation of getStatistics()
+      CountingStorageManager* storage = new CountingStorageManager(*diskStorage);
       ISpatialIndex* tree = nullptr;
       vector<id_type> idsToTry = {1, 2, 0};
+      id_type loadedId = 0;
       bool loaded = false;
       for (id_type id : idsToTry) {
         try {
@@ -152,8 +360,8 @@ int main(int argc, char** argv) {
             // If dimension is mismatch, it throws IllegalArgumentException.
             try {
                 ValidationVisitor dummyVisitor;
-                dummyVisitor.setQuery(new double[dimension]{}, 0, dimension, false); // dummy zero point
-                Point dummyPoint(dummyVisitor.queryPoint, dimension);
+                dummyVisitor.setQuery(new double[treeDim]{}, 0, treeDim, false); // dummy zero point
+                Point dummyPoint(dummyVisitor.queryPoint, treeDim);
                 tree->nearestNeighborQuery(1, dummyPoint, dummyVisitor);
                 delete[] dummyVisitor.queryPoint; 
             } catch (Tools::IllegalArgumentException&) {
@@ -164,6 +372,7 @@ int main(int argc, char** argv) {
             }
             
             cout << "Successfully loaded Index ID " << id << " with correct dimension." << endl;
+            loadedId = id;
             loaded = true;
             break;
         } catch (...) {
@@ -172,64 +381,108 @@ int main(int argc, char** argv) {
       }
       
       if (!loaded || !tree) {
-         cerr << "Could not load any valid R-Tree index with dimension " << dimension << "." << endl;
+         cerr << "Could not load any valid R-Tree index with dimension " << treeDim << "." << endl;
          delete storage;
+         delete diskStorage;
          return 1;
       }
 
+      unique_ptr<FlatRTree> flat;
+      if (useFlat && usePca) {
+          cout << "Ignoring --flat: the PCA index is only queried with exact refinement." << endl;
+      } else if (useFlat) {
+          auto start = chrono::high_resolution_clock::now();
+          flat.reset(new FlatRTree(*diskStorage, loadedId, treeDim));
+          cout << "Flat in-memory engine: " << flat->nodeCount() << " nodes, " << flat->memoryBytes() / (1024.0 * 1024.0)
+               << " MB, loaded in " << chrono::duration<double>(chrono::high_resolution_clock::now() - start).count()
+               << " s (kernel " << flat->kernelName() << "). Paginas_Lidas is 0 for its queries." << endl;
+      }
+
       // --- 3. Run Validation ---
       string resultsFile = "./results/validacao_rtree_" + datasetName + ".csv";
       if (!fs::exists("./results")) fs::create_directory("./results");
       
       ofstream report(resultsFile);
-      report << "Query_ID,Tipo,K_ou_Raio,Tempo_ms,Paginas_Lidas,Recall,Resultados_Encontrados\n";
+      report << "Query_ID,Tipo,K_ou_Raio,Tempo_ms,Paginas_Lidas,Recall,Resultados_Encontrados,Candidatos,Nos_Internos,Nos_Folha,Nos_por_Nivel,Eficiencia_Poda"
+             << ",Ciclos,Instrucoes,IPC,LLC_Misses,Branch_Misses,DTLB_Misses\n";
+      TraversalTrace trace;
+      auto writeTrace = [&](uint64_t candidates) {
+          report << "," << candidates << "," << trace.internalNodes() << "," << trace.leafNodes() << ",";
+          trace.writeLevels(report);
+          report << "," << trace.pruningEfficiency();
+      };
+
+      // Per-query hardware counters of this thread (empty columns when perf_event_open is denied)
+      PerfCounters perf;
+      PerfSample counters;
+      cout << "Hardware counters: " << perf.describe() << endl;
 
-      // Load Queries
+      // Load Queries (binary if a .bin sibling exists, else CSV). --queries=<name> selects a
+      // calibrated set generated by the benchmark (query_workload.h) and its calibrated radius.
       string knnPath = "./queries/" + datasetName + "_knn.csv";
-      ifstream qfile(knnPath);
-      vector<vector<double>> knnQueries;
-      while(getline(qfile, line)) {
-        stringstream ss(line); string val; vector<double> c;
-        while(getline(ss, val, ',')) c.push_back(stod(val));
-        if (c.size() == dimension) knnQueries.push_back(c);
-      }
-      
       string rangePath = "./queries/" + datasetName + "_range.csv";
-      ifstream rfile(rangePath);
-      vector<vector<double>> rangeQueries;
-      while(getline(rfile, line)) {
-        stringstream ss(line); string val; vector<double> c;
-        while(getline(ss, val, ',')) c.push_back(stod(val));
-        if (c.size() == dimension) rangeQueries.push_back(c);
+      double radius = 0.1;
+      string querySet = getOption(argc, argv, "queries", "");
+      if (!querySet.empty()) {
+          QueryWorkloadPaths paths = queryWorkloadPaths(datasetName, querySet);
+          QueryWorkloadInfo info;
+          try {
+              info = QueryWorkloadInfo::load(paths.params);
+          } catch (std::exception& e) {
+              cerr << e.what() << " (generate it with the benchmark's --selectivity / --query-dist)" << endl;
+              return 1;
+          }
+          // The calibrated radius targets an L2 ball; a box with the same half-width is not that workload
+          if (info.selectivity > 0 && !ballShape) {
+              cerr << "Query set " << querySet << " has a radius calibrated for the L2 ball; use --range-shape=ball." << endl;
+              return 1;
+          }
+          knnPath = paths.knn;
+          rangePath = paths.range;
+          if (info.radius > 0) radius = info.radius;
+          cout << "Query set " << querySet << " (" << info.distribution << ", target selectivity " << info.selectivity
+               << ", radius " << radius << ")" << endl;
       }
+      vector<vector<double>> knnQueries = loadQueries(knnPath, dimension);
+      vector<vector<double>> rangeQueries = loadQueries(rangePath, dimension);
 
       int K = 5;
       cout << "\nRunning " << knnQueries.size() << " k-NN queries (k=" << K << ")..." << endl;
       
+      if (hasOption(argc, argv, "gt-scaling") && !streamed) reportGroundTruthScaling(groundTruthStore(), knnQueries, K, threads);
+
+      // GT for all queries at once (cached, or sharded across the thread pool)
+      GroundTruthSet knnGt = obtainGroundTruth(GroundTruthKind::Knn, knnQueries, K);
+
+      vector<double> reducedQuery(treeDim);
       int qId = 0;
+      ValidationVisitor visitor;
+      visitor.results.reserve(K);
       for (auto& q : knnQueries) {
-          // GT
-          for (auto& entry : fullData) {
-              entry.dist = getL2(q, entry.coords.data(), dimension);
-          }
-          partial_sort(fullData.begin(), fullData.begin() + K, fullData.end(), [](const PointEntry& a, const PointEntry& b) {
-              return a.dist < b.dist;
-          });
-          vector<uint64_t> gtIds;
-          for(int k=0; k<K; ++k) gtIds.push_back(fullData[k].id);
+          const vector<uint64_t>& gtIds = knnGt.ids[qId];
 
           // R-Tree
-          ValidationVisitor visitor;
           visitor.setQuery(q.data(), 0, dimension, false);
+          trace.reset();
+          visitor.trace = &trace;
           
-          IStatistics* statsPre; tree->getStatistics(&statsPre);
-          uint64_t readsPre = statsPre->getReads();
+          uint64_t readsPre = storage->reads();
+          PerfSample perfPre = perf.read();
           
           auto start = chrono::high_resolution_clock::now();
           Point queryPoint(q.data(), dimension);
           
           try {
-            tree->nearestNeighborQuery(K, queryPoint, visitor);
+            if (usePca) {
+                // Candidates in projected-distance order, re-ranked with the full coordinates
+                pca.project(q.data(), reducedQuery.data());
+                RerankedKnn knn = rerankedNearestNeighbors(*tree, reducedQuery.data(), treeDim, q.data(), K, dataset);
+                for (const auto& n : knn.neighbors) visitor.results.add(n.second, n.first);
+            } else if (flat) {
+                flat->nearestNeighborQuery(K, q.data(), visitor);
+            } else {
+                tree->nearestNeighborQuery(K, queryPoint, visitor);
+            }
           } catch (Tools::IllegalArgumentException& e) {
              cerr << "Error running k-NN: " << e.what() << endl;
              cerr << "Hint: The R-Tree might have been built with a different dimension than " << dimension << "." << endl;
@@ -237,66 +490,173 @@ int main(int argc, char** argv) {
           }
           
           auto end = chrono::high_resolution_clock::now();
+          counters = PerfCounters::delta(perfPre, perf.read());
           
-          IStatistics* statsPost; tree->getStatistics(&statsPost);
+          uint64_t reads = storage->reads() - readsPre;
 
           // Recall
           int matches = 0;
-          for (auto id : visitor.neighborIds) {
-              if (find(gtIds.begin(), gtIds.end(), id) != gtIds.end()) matches++;
+          for (const QueryResult& r : visitor.results) {
+              if (find(gtIds.begin(), gtIds.end(), static_cast<uint64_t>(r.id)) != gtIds.end()) matches++;
           }
           double recall = (double)matches / K;
           
           double time_ms = chrono::duration<double, milli>(end - start).count();
-          report << qId++ << ",kNN," << K << "," << time_ms << "," << (statsPost->getReads() - readsPre) << "," << recall << "," << visitor.neighborIds.size() << "\n";
+          report << qId++ << ",kNN," << K << "," << time_ms << "," << reads << "," << recall << "," << visitor.results.size();
+          writeTrace(visitor.candidates);
+          report << ",";
+          writePerfColumns(report, counters);
+          report << "\n";
           cout << "kNN " << qId-1 << ": Recall=" << recall << " Time=" << time_ms << "ms" << endl;
       }
 
+      // Batched k-NN: same queries, one traversal per block of --knn-batch queries
+      size_t knnBatch = stoul(getOption(argc, argv, "knn-batch", "0"));
+      if ((knnBatch > 0 || hasOption(argc, argv, "approx-sweep")) && usePca) {
+          cout << "Skipping --knn-batch / --approx-sweep: the PCA index is only queried with exact refinement." << endl;
+      } else if (knnBatch > 0) {
+          uint64_t readsPre = storage->reads();
+          auto start = chrono::high_resolution_clock::now();
+          double recallSum = 0;
+          for (size_t begin = 0; begin < knnQueries.size(); begin += knnBatch) {
+              size_t end = min(knnQueries.size(), begin + knnBatch);
+              BatchKnnStrategy batch = batchNearestNeighbors(*tree, knnQueries, begin, end, dimension, K);
+              for (size_t i = begin; i < end; i++) {
+                  // Distance-based recall, so ties at the K-th distance are not counted as misses
+                  const vector<double>& gtDists = knnGt.dists[i];
+                  double kth = gtDists.empty() ? 0.0 : *max_element(gtDists.begin(), gtDists.end());
+                  int matches = 0;
+                  for (const KnnNeighbor& n : batch.results(i - begin)) {
+                      if (n.dist2 <= kth * (1 + 1e-12)) matches++;
+                  }
+                  recallSum += (double)min<size_t>(matches, K) / K;
+              }
+          }
+          double elapsed = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+          size_t n = max<size_t>(1, knnQueries.size());
+          cout << "Batched kNN (batch=" << knnBatch << "): mean recall=" << recallSum / n
+               << " amortized=" << elapsed / n << "ms pages/query=" << (double)(storage->reads() - readsPre) / n << endl;
+      }
+
+      // Approximate k-NN: sweep the epsilon-relaxed pruning and the leaf budget, one curve
+      // point per setting (recall vs latency and recall vs pages), using the same Recall as above
+      if (hasOption(argc, argv, "approx-sweep") && !usePca) {
+          vector<pair<string, KnnSearchBudget>> settings;
+          for (const string& e : splitOptionList(getOption(argc, argv, "approx-eps", "0,0.1,0.25,0.5,1,2"))) {
+              KnnSearchBudget b;
+              b.epsilon = stod(e);
+              settings.push_back({"eps", b});
+          }
+          for (const string& l : splitOptionList(getOption(argc, argv, "approx-leaves", "1,2,4,8,16,32,64,128,256"))) {
+              KnnSearchBudget b;
+              b.maxLeaves = stoull(l);
+              settings.push_back({"folhas", b});
+          }
+
+          string curveFile = "./results/aproximado_" + datasetName + ".csv";
+          ofstream curve(curveFile);
+          curve << "Modo,Parametro,Consultas,Recall_Medio,Latencia_Media_ms,p99_ms,Paginas_Media,Folhas_Media\n";
+          cout << "\nApproximate k-NN sweep (" << settings.size() << " settings, k=" << K << ")" << endl;
+          for (const auto& setting : settings) {
+              const KnnSearchBudget& budget = setting.second;
+              vector<double> latencies;
+              double recallSum = 0;
+              uint64_t pages = 0, leaves = 0;
+              for (size_t i = 0; i < knnQueries.size(); i++) {
+                  uint64_t readsPre = storage->reads();
+                  auto start = chrono::high_resolution_clock::now();
+                  BatchKnnStrategy knn = batchNearestNeighbors(*tree, knnQueries, i, i + 1, dimension, K, budget);
+                  latencies.push_back(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count());
+                  pages += storage->reads() - readsPre;
+                  leaves += knn.getLeavesRead();
+
+                  const vector<uint64_t>& gtIds = knnGt.ids[i];
+                  int matches = 0;
+                  for (const KnnNeighbor& n : knn.results(0)) {
+                      if (find(gtIds.begin(), gtIds.end(), static_cast<uint64_t>(n.id)) != gtIds.end()) matches++;
+                  }
+                  recallSum += (double)matches / K;
+              }
+              size_t n = max<size_t>(1, knnQueries.size());
+              sort(latencies.begin(), latencies.end());
+              double meanMs = accumulate(latencies.begin(), latencies.end(), 0.0) / n;
+              double p99 = latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, (size_t)ceil(0.99 * latencies.size()) - 1)];
+              double param = setting.first == "eps" ? budget.epsilon : (double)budget.maxLeaves;
+              curve << setting.first << "," << param << "," << knnQueries.size() << "," << recallSum / n << ","
+                    << meanMs << "," << p99 << "," << (double)pages / n << "," << (double)leaves / n << "\n";
+              cout << "  " << setting.first << "=" << param << ": recall=" << recallSum / n << " latency=" << meanMs
+                   << "ms p99=" << p99 << "ms pages=" << (double)pages / n << endl;
+          }
+          cout << "Saved approximate k-NN curve to " << curveFile << endl;
+      }
+
       // Range
-      double radius = 0.1;
       cout << "\nRunning " << rangeQueries.size() << " Range queries (r=" << radius << ")..." << endl;
       
+      GroundTruthSet rangeGt = obtainGroundTruth(GroundTruthKind::Range, rangeQueries, radius);
+
       qId = 0;
+      // Sized for the largest ground-truth answer, so range results never reallocate
+      size_t largestRange = 0;
+      for (const auto& ids : rangeGt.ids) largestRange = max(largestRange, ids.size());
+      visitor.results.reserve(largestRange);
+      vector<uint64_t> foundIds;
       for (auto& q : rangeQueries) {
-          // GT
-          vector<uint64_t> gtIds;
-          for (auto& entry : fullData) {
-              // Recalc dist
-              double dist = getL2(q, entry.coords.data(), dimension);
-              if (dist <= radius) gtIds.push_back(entry.id);
-          }
-          sort(gtIds.begin(), gtIds.end());
+          const vector<uint64_t>& gtIds = rangeGt.ids[qId];
 
           // R-Tree
-          ValidationVisitor visitor;
           visitor.setQuery(q.data(), radius, dimension, true);
+          visitor.l2Squared = kernels.row;
+          if (usePca) visitor.exactRows = &dataset;
+          trace.reset();
+          visitor.trace = &trace;
 
-          IStatistics* statsPre; tree->getStatistics(&statsPre);
-          uint64_t readsPre = statsPre->getReads();
+          uint64_t readsPre = storage->reads();
+          PerfSample perfPre = perf.read();
 
           auto start = chrono::high_resolution_clock::now();
-          vector<double> lowV(dimension), highV(dimension);
-          for(uint32_t d=0; d<dimension; d++) { 
-             lowV[d] = q[d] - radius; 
-             highV[d] = q[d] + radius; 
-          }
-          Region queryRegion(lowV.data(), highV.data(), dimension);
           
           try {
-            tree->intersectsWithQuery(queryRegion, visitor);
+            if (usePca) {
+                // Same radius in the projected space (a superset, since projection never grows
+                // distances), with a tiny slack for rounding; the visitor filters exactly
+                pca.project(q.data(), reducedQuery.data());
+                BallRegion ball(reducedQuery.data(), radius * (1 + 1e-9), treeDim);
+                tree->intersectsWithQuery(ball, visitor);
+            } else if (flat && ballShape) {
+                flat->intersectsWithBall(q.data(), radius, visitor);
+            } else if (ballShape) {
+                BallRegion ball(q.data(), radius, dimension);
+                tree->intersectsWithQuery(ball, visitor);
+            } else {
+                vector<double> lowV(dimension), highV(dimension);
+                for(uint32_t d=0; d<dimension; d++) { 
+                   lowV[d] = q[d] - radius; 
+                   highV[d] = q[d] + radius; 
+                }
+                if (flat) {
+                    flat->intersectsWithQuery(lowV.data(), highV.data(), visitor);
+                } else {
+                    Region queryRegion(lowV.data(), highV.data(), dimension);
+                    tree->intersectsWithQuery(queryRegion, visitor);
+                }
+            }
           } catch (Tools::IllegalArgumentException& e) {
              cerr << "Error running Range Query: " << e.what() << endl;
              return 1;
           }
            
           auto end = chrono::high_resolution_clock::now();
+          counters = PerfCounters::delta(perfPre, perf.read());
 
-          IStatistics* statsPost; tree->getStatistics(&statsPost);
+          uint64_t reads = storage->reads() - readsPre;
 
           // Recall
-          sort(visitor.neighborIds.begin(), visitor.neighborIds.end());
+          foundIds.clear();
+          for (const QueryResult& r : visitor.results) foundIds.push_back(static_cast<uint64_t>(r.id));
+          sort(foundIds.begin(), foundIds.end());
           vector<uint64_t> intersection;
-          set_intersection(visitor.neighborIds.begin(), visitor.neighborIds.end(),
+          set_intersection(foundIds.begin(), foundIds.end(),
                            gtIds.begin(), gtIds.end(),
                            back_inserter(intersection));
           
@@ -305,12 +665,17 @@ int main(int argc, char** argv) {
           else recall = 1.0;
 
           double time_ms = chrono::duration<double, milli>(end - start).count();
-          report << qId++ << ",Range," << radius << "," << time_ms << "," << (statsPost->getReads() - readsPre) << "," << recall << "," << visitor.neighborIds.size() << "\n";
-          cout << "Range " << qId-1 << ": Recall=" << recall << " Time=" << time_ms << "ms (Found " << visitor.neighborIds.size() << "/" << gtIds.size() << ")" << endl;
+          report << qId++ << ",Range," << radius << "," << time_ms << "," << reads << "," << recall << "," << visitor.results.size();
+          writeTrace(visitor.candidates);
+          report << ",";
+          writePerfColumns(report, counters);
+          report << "\n";
+          cout << "Range " << qId-1 << ": Recall=" << recall << " Time=" << time_ms << "ms (Found " << visitor.results.size() << "/" << gtIds.size() << ")" << endl;
       }
 
       delete tree; 
       delete storage;
+      delete diskStorage;
       report.close();
       cout << "Saved validation to " << resultsFile << endl;
 